@@ -0,0 +1,297 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : access_pattern.h
+Purpose             : Block address generator shared by kernel.cl and the host
+                      code, so the host can regenerate the exact address
+                      sequence a kernel run touched
+Revision History    : 2017.07.10
+******************************************************************************
+*/
+#ifndef ACCESS_PATTERN_H
+#define ACCESS_PATTERN_H
+
+#ifdef __OPENCL_VERSION__
+typedef ulong       ap_ulong         ;
+typedef uint        ap_uint          ;
+#define AP_INLINE
+#else
+#include <stdint.h>
+#include <string.h>
+typedef uint64_t    ap_ulong         ;
+typedef uint32_t    ap_uint          ;
+#define AP_INLINE   static inline
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////
+//Access patterns
+//Every pattern is a pure function of (seed, iteration), so the kernel needs no
+//state carried between iterations and the host can replay any sub-range.
+//
+//LEGACY      original (i*101 + 12345)%32768 stream, out-of-range folded to 0
+//UNIFORM     uniform random over [0, num_blocks)
+//STRIDE      start at seed%num_blocks, advance param0 blocks per access
+//SEQUENTIAL  start at seed%num_blocks, advance one block per access
+//HOTSET      param1 percent of accesses go uniformly to the param0 hot blocks
+//            at the start of the buffer, the rest uniformly to the whole buffer
+//BLOCKED     random start block, then param0 sequential blocks from there
+#define AP_PATTERN_LEGACY       0
+#define AP_PATTERN_UNIFORM      1
+#define AP_PATTERN_STRIDE       2
+#define AP_PATTERN_SEQUENTIAL   3
+#define AP_PATTERN_HOTSET       4
+#define AP_PATTERN_BLOCKED      5
+#define AP_NUM_PATTERNS         6
+
+//size of one block in bytes (one uint16)
+#define AP_BLOCK_BYTES          64
+
+/////////////////////////////////////////////////////////////////////////////////
+//Port pairs
+//The copy kernels have AP_MAX_PAIRS input/output buffer pairs, num_pairs of
+//them in use. REPLICATE copies every access through each pair at the same
+//address. INTERLEAVE stripes the units over the pairs, unit u lives in pair
+//u % num_pairs at unit u / num_pairs of that pair.
+#define AP_MAX_PAIRS            4
+#define AP_PORTS_REPLICATE      0
+#define AP_PORTS_INTERLEAVE     1
+
+//bit p set when pair p copies unit, num_pairs is 1 << pair_shift
+AP_INLINE ap_uint ap_pair_mask(ap_uint port_mode, ap_uint pair_shift, ap_ulong unit)
+{
+    if (port_mode == AP_PORTS_INTERLEAVE)
+        return 1U << (unit & ((1UL << pair_shift) - 1));
+    return (1U << (1U << pair_shift)) - 1;
+}
+
+//unit index inside the buffers of its pair
+AP_INLINE ap_ulong ap_pair_unit(ap_uint port_mode, ap_uint pair_shift, ap_ulong unit)
+{
+    return (port_mode == AP_PORTS_INTERLEAVE) ? (unit >> pair_shift) : unit;
+}
+
+//splitmix64 finalizer, a cheap full-avalanche 64-bit mixer
+AP_INLINE ap_ulong ap_mix(ap_ulong x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+    return x ^ (x >> 31);
+}
+
+//random 64-bit value for iteration i of stream seed
+AP_INLINE ap_ulong ap_random(ap_ulong seed, ap_ulong i)
+{
+    return ap_mix(seed + (i + 1) * 0x9e3779b97f4a7c15UL);
+}
+
+//map the upper 32 bits of r onto [0, n), n must not exceed AP_MAX_UNITS
+//or the product overflows and the upper part of the range is never drawn
+#define AP_MAX_UNITS            (1ULL << 32)
+
+AP_INLINE ap_ulong ap_scale(ap_ulong r, ap_ulong n)
+{
+    return ((r >> 32) * n) >> 32;
+}
+
+//block index accessed by iteration i
+AP_INLINE ap_ulong ap_block_index(ap_uint pattern, ap_ulong seed, ap_ulong i,
+                                  ap_ulong num_blocks, ap_ulong param0, ap_ulong param1)
+{
+    ap_ulong r;
+    ap_ulong idx;
+    ap_ulong run;
+
+    switch (pattern) {
+    case AP_PATTERN_LEGACY:
+        idx = (i*101 + 12345)%32768;
+        if ((idx >= num_blocks) || (idx == 0))
+            idx = 0;
+        break;
+    case AP_PATTERN_STRIDE:
+        idx = (seed + i*param0) % num_blocks;
+        break;
+    case AP_PATTERN_SEQUENTIAL:
+        idx = (seed + i) % num_blocks;
+        break;
+    case AP_PATTERN_HOTSET:
+        r = ap_random(seed, i);
+        if ((((r & 0xffffffffUL) * 100) >> 32) < param1)
+            idx = ap_scale(r, (param0 < num_blocks) ? param0 : num_blocks);
+        else
+            idx = ap_scale(r, num_blocks);
+        break;
+    case AP_PATTERN_BLOCKED:
+        run = (param0 > 0) ? param0 : 1;
+        r = ap_random(seed, i / run);
+        idx = (ap_scale(r, num_blocks) + i % run) % num_blocks;
+        break;
+    default:
+        idx = ap_scale(ap_random(seed, i), num_blocks);
+        break;
+    }
+    return idx;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//Trace entries
+//A trace is an array of 64-bit entries, the low 62 bits give the block index,
+//taken modulo the number of blocks, the top two bits the operation:
+//neither or both  copy the input block to the output block
+//READ only        read the input block into the kernel checksum
+//WRITE only       write the block index into every uint of the output block
+#define AP_TRACE_READ_FLAG      (1UL << 62)
+#define AP_TRACE_WRITE_FLAG     (1UL << 63)
+#define AP_TRACE_INDEX_MASK     (AP_TRACE_READ_FLAG - 1)
+
+#define AP_TRACE_COPY           0
+#define AP_TRACE_READ           1
+#define AP_TRACE_WRITE          2
+
+AP_INLINE ap_uint ap_trace_op(ap_ulong entry)
+{
+    ap_ulong flags = entry >> 62;
+    return (flags == 1) ? AP_TRACE_READ : ((flags == 2) ? AP_TRACE_WRITE : AP_TRACE_COPY);
+}
+
+AP_INLINE ap_ulong ap_trace_block(ap_ulong entry, ap_ulong num_blocks)
+{
+    return (entry & AP_TRACE_INDEX_MASK) % num_blocks;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//GUPS
+//HPCC RandomAccess update stream, every step shifts the 64-bit value left and
+//folds the carried out bit back in with the primitive polynomial x^63+x^2+x+1
+#define AP_GUPS_POLY            0x0000000000000007UL
+#define AP_GUPS_PERIOD          1317624576693539401UL
+
+AP_INLINE ap_ulong ap_gups_next(ap_ulong ran)
+{
+    return (ran << 1) ^ ((ran >> 63) ? AP_GUPS_POLY : 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//Block cache
+//Counters bandwidth_cached writes to its stats buffer, in uint16 lines. DDR
+//reads are the misses, DDR writes the evictions plus the final flush.
+#define AP_CACHE_HITS           0
+#define AP_CACHE_MISSES         1
+#define AP_CACHE_EVICTIONS      2
+#define AP_CACHE_FLUSHED        3
+#define AP_CACHE_LINES          4
+#define AP_CACHE_WAYS           5
+#define AP_CACHE_NUM_STATS      6
+
+/////////////////////////////////////////////////////////////////////////////////
+//Units
+//bandwidth_unit runs as num_units compute units or work items. Unit u copies
+//through pair u % num_pairs, so the units spread over the banks. SLICE gives
+//every unit a disjoint slice of its pair's blocks walked with the shared seed,
+//SEED the whole buffer walked with a seed of its own.
+#define AP_PARTITION_SLICE      0
+#define AP_PARTITION_SEED       1
+
+AP_INLINE ap_uint ap_unit_pair(ap_uint pair_shift, ap_uint unit)
+{
+    return unit & ((1U << pair_shift) - 1);
+}
+
+//blocks of the slice of every unit sharing the pair of unit, a multiple of 4
+//blocks so each slice starts 256 byte aligned in the fill pattern
+AP_INLINE ap_ulong ap_unit_slice_blocks(ap_ulong num_blocks, ap_uint pair_shift,
+                                        ap_uint unit, ap_uint num_units)
+{
+    ap_uint pair = ap_unit_pair(pair_shift, unit);
+    ap_uint peers = (num_units - pair + (1U << pair_shift) - 1) >> pair_shift;
+    return (num_blocks / peers) & ~3UL;
+}
+
+//first block of the slice of unit
+AP_INLINE ap_ulong ap_unit_slice_start(ap_ulong num_blocks, ap_uint pair_shift,
+                                       ap_uint unit, ap_uint num_units)
+{
+    return (unit >> pair_shift) * ap_unit_slice_blocks(num_blocks, pair_shift, unit, num_units);
+}
+
+//stream seed of unit under SEED, unit 0 keeps seed
+AP_INLINE ap_ulong ap_unit_seed(ap_ulong seed, ap_uint unit)
+{
+    return seed + unit * 0x9e3779b97f4a7c15UL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//Dataflow
+//Depth of the pipes between the address, load and store stages of the
+//dataflow kernels, the most requests one run can keep in flight
+#define AP_DATAFLOW_DEPTH       64
+
+/////////////////////////////////////////////////////////////////////////////////
+//Loop stats
+//Counters bandwidth_stats writes to its stats buffer. CYCLES are ticks of the
+//bandwidth_clock kernel between the start and the end of the copy loop, BEATS
+//the loop iterations of one uint16 each. IN_RANGE and FALLBACK split the
+//accesses into those the pattern placed and those the legacy pattern folded
+//to block 0. PAIR_BYTES + p holds the bytes pair p read, and wrote.
+#define AP_STATS_CYCLES         0
+#define AP_STATS_BEATS          1
+#define AP_STATS_IN_RANGE       2
+#define AP_STATS_FALLBACK       3
+#define AP_STATS_PAIR_BYTES     4
+#define AP_STATS_NUM            (AP_STATS_PAIR_BYTES + AP_MAX_PAIRS)
+
+//requests to bandwidth_clock, SAMPLE answers the current tick, STOP ends it
+#define AP_CLOCK_SAMPLE         0
+#define AP_CLOCK_STOP           1
+
+//bandwidth_clock also ends by itself after max_cycles ticks, so it can't be
+//left spinning when bandwidth_stats never starts. The host allows
+//AP_CLOCK_BEAT_CYCLES per beat of the copy loop and at least AP_CLOCK_MIN_CYCLES,
+//far beyond what a copy takes.
+#define AP_CLOCK_BEAT_CYCLES    1024ULL
+#define AP_CLOCK_MIN_CYCLES     (1ULL << 32)
+
+//1 when access i of pattern was out of range and folded to block 0
+AP_INLINE ap_uint ap_block_folded(ap_uint pattern, ap_ulong i, ap_ulong num_blocks)
+{
+    return (pattern == AP_PATTERN_LEGACY) && ((i*101 + 12345)%32768 >= num_blocks);
+}
+
+#ifndef __OPENCL_VERSION__
+/////////////////////////////////////////////////////////////////////////////////
+//Host side description of one address stream, mirrors the kernel arguments
+struct access_pattern {
+    ap_uint     pattern;
+    ap_ulong    seed;
+    ap_ulong    iterations;
+    ap_ulong    param0;
+    ap_ulong    param1;
+};
+
+static const char *ap_pattern_names[AP_NUM_PATTERNS] = {
+    "legacy", "uniform", "stride", "sequential", "hotset", "blocked"
+};
+
+AP_INLINE const char *ap_pattern_name(ap_uint pattern)
+{
+    return (pattern < AP_NUM_PATTERNS) ? ap_pattern_names[pattern] : "unknown";
+}
+
+//Return value
+// pattern id on success
+//-1       unknown pattern name
+AP_INLINE int ap_pattern_from_name(const char *name)
+{
+    for (int p=0; p<AP_NUM_PATTERNS; p++) {
+        if (strcmp(name, ap_pattern_names[p]) == 0)
+            return p;
+    }
+    return -1;
+}
+
+AP_INLINE ap_ulong ap_pattern_block(const struct access_pattern *ap, ap_ulong i, ap_ulong num_blocks)
+{
+    return ap_block_index(ap->pattern, ap->seed, i, num_blocks, ap->param0, ap->param1);
+}
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : bench.cpp
+Purpose             : Helpers shared by the host side execution engines
+Revision History    : 2017.07.12
+******************************************************************************
+*/
+#include <stdio.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "bench.h"
+
+double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / ((double) 1000000000);
+}
+
+double cpu_seconds(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / ((double) 1000000) +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / ((double) 1000000);
+}
+
+void print_throughput(const char *memory_name, const struct bench_result *r)
+{
+    double dmbread = r->bytes_read / (((double)1024) * ((double)1024));
+    double dmbwritten = r->bytes_written / (((double)1024) * ((double)1024));
+    double mbpersec = (dmbread + dmbwritten) / r->seconds;
+    double accpersec = r->accesses / r->seconds;
+
+    printf("Kernel read %.1lf MB bytes from and wrote %.1lf MB to %s.\n", dmbread, dmbwritten, memory_name);
+    printf("Execution time = %f (sec) \n", r->seconds);
+    printf("Concurrent Read and Write Throughput = %f (MB/sec) \n", mbpersec);
+    printf("Random Access Rate = %f (accesses/sec) \n", accpersec);
+}
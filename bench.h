@@ -0,0 +1,182 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : bench.h
+Purpose             : Options, results and helpers shared by the host side
+                      execution engines
+Revision History    : 2017.07.12
+******************************************************************************
+*/
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "access_pattern.h"
+
+//execution engines selectable with --backend
+#define BACKEND_FPGA            0
+#define BACKEND_CPU             1
+
+//benchmarks selectable with --mode
+#define MODE_BANDWIDTH          0
+#define MODE_LATENCY            1
+#define MODE_SWEEP              2
+#define MODE_PIPELINE           3
+#define MODE_TRACE              4
+#define MODE_GUPS               5
+#define MODE_DATAFLOW           6
+#define MODE_UNITS              7
+#define MODE_DEVICES            8
+#define MODE_TRANSFER           9
+#define MODE_HOSTMEM            10
+#define MODE_CONTENTION         11
+#define MODE_STEADY             12
+#define MODE_LOOKUP             13
+
+//how the units mode starts its units, selectable with --unit-launch
+#define UNITS_CU                0
+#define UNITS_WORKITEM          1
+
+//host/device transfer strategies of the transfer mode selectable with --transfer
+#define TRANSFER_MAP            0
+#define TRANSFER_RW             1
+#define TRANSFER_HOSTPTR        2
+#define TRANSFER_ALLOCHOST      3
+#define NUM_TRANSFERS           4
+
+//DDR bank placement of the bandwidth buffers selectable with --placement
+#define PLACE_SAME              0
+#define PLACE_SPLIT             1
+#define PLACE_INTERLEAVE        2
+
+//most DDR banks of a card
+#define MAX_BANKS               4
+
+//most accelerators a host is searched for
+#define MAX_DEVICES             16
+
+//sweep output formats
+#define SWEEP_CSV               0
+#define SWEEP_JSON              1
+
+//longest --sizes or --widths list
+#define MAX_SWEEP_POINTS        64
+
+/////////////////////////////////////////////////////////////////////////////////
+//bench_options
+//Run time configuration collected from the command line
+struct bench_options {
+    const char              *xclbin;
+    int                     backend;
+    int                     mode;
+    unsigned int            threads;
+    size_t                  buffer_size;
+    unsigned int            access_bytes;
+    struct access_pattern   ap;
+
+    //DDR banks of the card and buffer placement over them
+    unsigned int            banks;
+    int                     placement;
+
+    //largest device buffer before tiling, 0 for the device limit
+    size_t                  tile_size;
+
+    //on-chip block cache in front of the bandwidth kernel
+    int                     cache;
+
+    //instrumented bandwidth kernel with in-loop counters
+    int                     stats;
+
+    //benchmark runs over one device session
+    unsigned int            runs;
+
+    //host buffers, HOST_PAGES_* page kind and NUMA node or HOST_NODE_*
+    int                     host_pages;
+    int                     host_node;
+
+    //result verification
+    int                     verify;
+    unsigned int            verify_report;
+
+    //latency mode
+    unsigned int            samples;
+    int                     histogram;
+
+    //sweep mode
+    size_t                  sweep_sizes[MAX_SWEEP_POINTS];
+    unsigned int            num_sweep_sizes;
+    size_t                  sweep_widths[MAX_SWEEP_POINTS];
+    unsigned int            num_sweep_widths;
+    unsigned int            warmup;
+    unsigned int            reps;
+    int                     format;
+    const char              *output;
+
+    //pipeline mode
+    size_t                  chunk_size;
+    unsigned int            pipeline_depth;
+
+    //trace mode
+    const char              *trace;
+    uint64_t                trace_window;
+
+    //gups mode
+    uint64_t                gups_updates;
+    double                  gups_tolerance;
+
+    //dataflow mode, requests in flight of each point
+    size_t                  outstanding[MAX_SWEEP_POINTS];
+    unsigned int            num_outstanding;
+
+    //units mode, unit counts of each point, launch and AP_PARTITION_*
+    size_t                  units[MAX_SWEEP_POINTS];
+    unsigned int            num_units;
+    int                     unit_launch;
+    unsigned int            partition;
+
+    //devices mode, indices of the devices to open, none for all
+    unsigned int            devices[MAX_DEVICES];
+    unsigned int            num_devices;
+
+    //transfer mode, TRANSFER_* strategies to measure
+    int                     transfers[NUM_TRANSFERS];
+    unsigned int            num_transfers;
+
+    //contention mode, DDR bank of the DMA stream buffers
+    unsigned int            dma_bank;
+
+    //steady mode, wall clock budget, launches queued and enqueued at once
+    double                  duration;
+    unsigned int            in_flight;
+    unsigned int            batch;
+
+    //lookup mode, DRAM_MAP_* model the batches are reordered by, its page
+    //size and banks
+    int                     reorder;
+    int                     dram_map;
+    size_t                  dram_page;
+    unsigned int            dram_banks;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//bench_result
+//What one measured run moved and how long it took
+struct bench_result {
+    double      seconds;
+    uint64_t    accesses;
+    uint64_t    bytes_read;
+    uint64_t    bytes_written;
+};
+
+//monotonic wall clock in seconds
+double now_seconds(void);
+
+//user plus system cpu time of the process in seconds
+double cpu_seconds(void);
+
+//print a result in the same layout for every backend
+void print_throughput(const char *memory_name, const struct bench_result *r);
+
+#endif
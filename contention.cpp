@@ -0,0 +1,391 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : contention.cpp
+Purpose             : Host DMA streams running on their own queues while the
+                      bandwidth kernel does random access in DDR
+Revision History    : 2017.09.06
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "contention.h"
+#include "cpu_backend.h"
+#include "fill.h"
+#include "host_alloc.h"
+
+//DMA streams, one thread, queue and buffer each
+#define CT_H2D                  0
+#define CT_D2H                  1
+#define CT_STREAMS              2
+#define CT_BOTH                 ((1U << CT_H2D) | (1U << CT_D2H))
+
+//shortest time the streams are measured without the kernel, in seconds
+#define CT_MIN_WINDOW           0.5
+
+static const char *ct_stream_names[CT_STREAMS] = {
+    "host to device", "device to host"
+};
+
+struct ct_stream {
+    pthread_t           thread;
+    unsigned int        dir;
+    cl_command_queue    queue;
+    cl_mem              mem;
+    unsigned char       *host;
+    size_t              size;
+    struct cpu_start    *start;
+    int                 running;
+    int                 stop;
+
+    //bytes moved and completion time of the last transfer, under lock
+    pthread_mutex_t     lock;
+    uint64_t            bytes;
+    double              last;
+    cl_int              status;
+};
+
+//bytes a stream had moved and when its last transfer completed
+struct ct_mark {
+    uint64_t    bytes;
+    double      time;
+};
+
+struct contention {
+    struct fpga_bandwidth   bw;
+    struct ct_stream        stream[CT_STREAMS];
+    struct cpu_start        start;
+};
+
+static void *ct_stream_run(void *arg)
+{
+    struct ct_stream *s = (struct ct_stream *)arg;
+    cl_int err;
+
+    cpu_wait_start(s->start);
+    if (__atomic_load_n(&s->start->abort, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    while (!__atomic_load_n(&s->stop, __ATOMIC_ACQUIRE)) {
+        if (s->dir == CT_H2D)
+            err = clEnqueueWriteBuffer(s->queue, s->mem, CL_TRUE, 0, s->size, s->host, 0, NULL, NULL);
+        else
+            err = clEnqueueReadBuffer(s->queue, s->mem, CL_TRUE, 0, s->size, s->host, 0, NULL, NULL);
+        double now = now_seconds();
+        pthread_mutex_lock(&s->lock);
+        if (err == CL_SUCCESS) {
+            s->bytes += s->size;
+            s->last = now;
+        } else {
+            s->status = err;
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (err != CL_SUCCESS)
+            break;
+    }
+    return NULL;
+}
+
+static void ct_mark(struct contention *ct, struct ct_mark *marks)
+{
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        struct ct_stream *s = &ct->stream[d];
+        pthread_mutex_lock(&s->lock);
+        marks[d].bytes = s->bytes;
+        marks[d].time = s->last;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+//MB/sec of the transfers completed between two marks, 0 when none did
+static double ct_rate(const struct ct_mark *from, const struct ct_mark *to)
+{
+    if (to->bytes == from->bytes || to->time <= from->time)
+        return 0;
+    return (to->bytes - from->bytes) / (((double)1024) * ((double)1024)) / (to->time - from->time);
+}
+
+static int ct_streams_stop(struct contention *ct)
+{
+    int ret = 0;
+
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        struct ct_stream *s = &ct->stream[d];
+        if (!s->running)
+            continue;
+        __atomic_store_n(&s->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(s->thread, NULL);
+        s->running = 0;
+        if (s->status != CL_SUCCESS) {
+            printf("Error: %s transfer failed %d\n", ct_stream_names[d], s->status);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//ct_streams_start
+//Start the streams of mask together and wait until each has completed a
+//transfer, so a window marked from here on sees them in steady state
+//Return value
+// 0    Success
+//-1    Thread or transfer failure, the streams are stopped again
+
+static int ct_streams_start(struct contention *ct, unsigned int mask)
+{
+    unsigned int started = 0;
+    int ret = 0;
+
+    memset(&ct->start, 0, sizeof(ct->start));
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        struct ct_stream *s = &ct->stream[d];
+        if (!(mask & (1U << d)))
+            continue;
+        s->start = &ct->start;
+        s->stop = 0;
+        s->bytes = 0;
+        s->last = 0;
+        s->status = CL_SUCCESS;
+        if (pthread_create(&s->thread, NULL, ct_stream_run, s) != 0) {
+            printf("Error: Failed to start %s thread\n", ct_stream_names[d]);
+            ret = -1;
+            break;
+        }
+        s->running = 1;
+        started++;
+    }
+    cpu_release_start(&ct->start, started, ret != 0);
+
+    for (unsigned int d=0; d<CT_STREAMS && ret == 0; d++) {
+        struct ct_stream *s = &ct->stream[d];
+        uint64_t bytes = 0;
+        cl_int status = CL_SUCCESS;
+        while (s->running && bytes == 0 && status == CL_SUCCESS) {
+            usleep(100);
+            pthread_mutex_lock(&s->lock);
+            bytes = s->bytes;
+            status = s->status;
+            pthread_mutex_unlock(&s->lock);
+        }
+        if (status != CL_SUCCESS)
+            ret = -1;
+    }
+    if (ret != 0)
+        ct_streams_stop(ct);
+    return ret;
+}
+
+//run the streams of mask alone for seconds and leave their MB/sec in rates
+static int ct_measure_streams(struct contention *ct, unsigned int mask, double seconds, double *rates)
+{
+    struct ct_mark from[CT_STREAMS], to[CT_STREAMS];
+
+    if (ct_streams_start(ct, mask) != 0)
+        return -1;
+    ct_mark(ct, from);
+    double end = now_seconds() + seconds;
+    while (now_seconds() < end)
+        usleep(10000);
+    ct_mark(ct, to);
+    if (ct_streams_stop(ct) != 0)
+        return -1;
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        if (mask & (1U << d))
+            rates[d] = ct_rate(&from[d], &to[d]);
+    }
+    return 0;
+}
+
+//mean kernel time of opts->reps bandwidth launches
+static int ct_measure_kernel(struct fpga_env *env, struct contention *ct,
+                             const struct bench_options *opts, double *seconds)
+{
+    double launch;
+
+    *seconds = 0;
+    for (unsigned int r=0; r<opts->reps; r++) {
+        if (fpga_bandwidth_launch(env, &ct->bw, opts, &launch) != 0)
+            return -1;
+        *seconds += launch;
+    }
+    *seconds /= opts->reps;
+    return 0;
+}
+
+static void ct_release(struct fpga_env *env, struct contention *ct)
+{
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        struct ct_stream *s = &ct->stream[d];
+        fpga_release_buffer(env, s->mem);
+        if (s->queue)
+            clReleaseCommandQueue(s->queue);
+        host_free(s->host);
+        pthread_mutex_destroy(&s->lock);
+    }
+    fpga_bandwidth_release(&ct->bw);
+}
+
+//the streams start from the pattern on both sides, so every device to host
+//transfer brings the pattern back and the buffers can be checked at the end
+static int ct_setup_streams(struct fpga_env *env, struct contention *ct,
+                            const struct bench_options *opts, size_t size)
+{
+    cl_int err;
+
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        struct ct_stream *s = &ct->stream[d];
+        s->dir = d;
+        s->size = size;
+        s->queue = clCreateCommandQueue(env->context, env->device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+        if (!s->queue || err != CL_SUCCESS) {
+            printf("Error: Failed to create %s command queue %d\n", ct_stream_names[d], err);
+            return -1;
+        }
+        s->mem = fpga_create_bank_buffer(env, size, opts->dma_bank, &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to allocate %s buffer of size %zu\n", ct_stream_names[d], size);
+            return -1;
+        }
+        s->host = (unsigned char *)host_alloc(size, opts->host_pages, opts->host_node);
+        if (s->host == NULL) {
+            printf("Error: Failed to allocate %zu bytes of host memory\n", size);
+            return -1;
+        }
+        fill_pattern(s->host, size, 0, opts->threads);
+    }
+    err = clEnqueueWriteBuffer(ct->stream[CT_D2H].queue, ct->stream[CT_D2H].mem, CL_TRUE, 0, size,
+                               ct->stream[CT_D2H].host, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        printf("Error: Failed to write device to host buffer %d\n", err);
+        return -1;
+    }
+    return 0;
+}
+
+//compare what the last transfers of both streams left against the pattern
+static int ct_check_streams(struct contention *ct)
+{
+    struct ct_stream *h2d = &ct->stream[CT_H2D];
+    struct ct_stream *d2h = &ct->stream[CT_D2H];
+    int ret = 0;
+
+    if (memcmp(d2h->host, h2d->host, d2h->size) != 0) {
+        printf("Verify device to host transfer: FAIL, data read back differs\n");
+        ret = -2;
+    }
+    cl_int err = clEnqueueReadBuffer(d2h->queue, h2d->mem, CL_TRUE, 0, h2d->size, d2h->host, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        printf("Error: Failed to read back host to device buffer %d\n", err);
+        return -1;
+    }
+    if (memcmp(d2h->host, h2d->host, h2d->size) != 0) {
+        printf("Verify host to device transfer: FAIL, data written differs\n");
+        ret = -2;
+    }
+    if (ret == 0)
+        printf("Verify transfers: PASS\n");
+    return ret;
+}
+
+int fpga_run_contention(struct fpga_env *env, const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    struct contention ct;
+    struct ct_mark from[CT_STREAMS], to[CT_STREAMS];
+    double alone[CT_STREAMS], both[CT_STREAMS], contended[CT_STREAMS];
+    double kernel_alone, kernel_contended, seconds, dmkernel;
+    double mb = ((double)1024) * ((double)1024);
+    int ret = -1;
+
+    size_t dma_size = (opts->chunk_size > 0) ? opts->chunk_size : opts->buffer_size / 16;
+    dma_size = (dma_size + 4095) & ~(size_t)4095;
+
+    memset(&ct, 0, sizeof(ct));
+    for (unsigned int d=0; d<CT_STREAMS; d++)
+        pthread_mutex_init(&ct.stream[d].lock, NULL);
+    if (fpga_bandwidth_setup(env, opts, opts->buffer_size, &ct.bw) != 0 ||
+        ct_setup_streams(env, &ct, opts, dma_size) != 0)
+        goto cleanup;
+
+    {
+        const struct fpga_layout *layout = &ct.bw.layout;
+        int shared = (env->num_banks <= 1);
+        for (unsigned int p=0; p<layout->num_pairs; p++) {
+            if (layout->input_bank[p] == opts->dma_bank || layout->output_bank[p] == opts->dma_bank)
+                shared = 1;
+        }
+        printf("Kernel buffers of %.1f MB placed %s over %u banks, DMA buffers of %.1f MB in bank %u, %s\n",
+               opts->buffer_size / mb, fpga_placement_name(opts->placement), opts->banks,
+               dma_size / mb, opts->dma_bank,
+               shared ? "a bank the kernel also uses" : "a bank the kernel does not use");
+        printf("Access pattern %s, seed %llu, %llu accesses of %u bytes, %u measured launches\n",
+               ap_pattern_name(ap->pattern), (unsigned long long)ap->seed,
+               (unsigned long long)ap->iterations, opts->access_bytes, opts->reps);
+    }
+    dmkernel = 2 * fpga_bandwidth_bytes(&ct.bw, opts) / mb;
+
+    //every stream alone first
+    for (unsigned int r=0; r<opts->warmup; r++) {
+        if (fpga_bandwidth_launch(env, &ct.bw, opts, &seconds) != 0)
+            goto cleanup;
+    }
+    if (ct_measure_kernel(env, &ct, opts, &kernel_alone) != 0)
+        goto cleanup;
+    printf("Kernel alone: %f sec, %f MB/sec\n", kernel_alone, dmkernel / kernel_alone);
+
+    seconds = kernel_alone * opts->reps;
+    if (seconds < CT_MIN_WINDOW)
+        seconds = CT_MIN_WINDOW;
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        if (ct_measure_streams(&ct, 1U << d, seconds, alone) != 0)
+            goto cleanup;
+        printf("Stream %s alone: %f MB/sec\n", ct_stream_names[d], alone[d]);
+    }
+    if (ct_measure_streams(&ct, CT_BOTH, seconds, both) != 0)
+        goto cleanup;
+    printf("Both streams: host to device %f MB/sec, device to host %f MB/sec\n",
+           both[CT_H2D], both[CT_D2H]);
+
+    //then the kernel under both streams, the transfers completed while it
+    //ran give their contended rates
+    if (ct_streams_start(&ct, CT_BOTH) != 0)
+        goto cleanup;
+    ct_mark(&ct, from);
+    ret = ct_measure_kernel(env, &ct, opts, &kernel_contended);
+    ct_mark(&ct, to);
+    if (ct_streams_stop(&ct) != 0 || ret != 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    printf("Contended kernel: %f sec, %f MB/sec, %.1f%% of alone\n",
+           kernel_contended, dmkernel / kernel_contended, 100.0 * kernel_alone / kernel_contended);
+    for (unsigned int d=0; d<CT_STREAMS; d++) {
+        contended[d] = ct_rate(&from[d], &to[d]);
+        if (contended[d] == 0) {
+            printf("Contended %s: no transfer completed while the kernel ran, lower --chunk-size or raise -n\n",
+                   ct_stream_names[d]);
+            continue;
+        }
+        printf("Contended %s: %f MB/sec, %.1f%% of alone, %.1f%% of both streams without the kernel\n",
+               ct_stream_names[d], contended[d], 100.0 * contended[d] / alone[d],
+               100.0 * contended[d] / both[d]);
+    }
+
+    ret = fpga_bandwidth_check(env, &ct.bw, opts);
+    if (opts->verify) {
+        int sret = ct_check_streams(&ct);
+        if (sret != 0 && ret != -1)
+            ret = sret;
+    }
+
+cleanup:
+    ct_streams_stop(&ct);
+    ct_release(env, &ct);
+    return ret;
+}
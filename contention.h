@@ -0,0 +1,31 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : contention.h
+Purpose             : Host DMA streams running on their own queues while the
+                      bandwidth kernel does random access in DDR
+Revision History    : 2017.09.06
+******************************************************************************
+*/
+#ifndef CONTENTION_H
+#define CONTENTION_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_contention
+//Keep a host to device and a device to host stream of blocking --chunk-size
+//transfers running, each from its own host thread and command queue over its
+//own buffer in bank opts->dma_bank, while the bandwidth kernel runs
+//opts->reps launches of the access stream over the buffers of the bank
+//layout on the session queue. The kernel alone, each stream alone and both
+//streams together are measured first, the contended kernel time and the
+//transfers completed while it ran are then reported against them.
+//Return value
+// 0    Success
+//-1    Allocation, thread or OpenCL failure
+//-2    Output or transfer data mismatch
+int fpga_run_contention(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
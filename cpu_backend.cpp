@@ -0,0 +1,297 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : cpu_backend.cpp
+Purpose             : Host native execution of the bandwidth kernel
+Revision History    : 2017.07.12
+******************************************************************************
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "cpu_backend.h"
+#include "fill.h"
+#include "verify.h"
+#include "host_alloc.h"
+
+struct cpu_worker {
+    pthread_t                   thread;
+    unsigned int                id;
+    const struct access_pattern *ap;
+    const unsigned char         *input;
+    unsigned char               *output;
+    unsigned int                unit_bytes;
+    uint64_t                    num_units;
+    uint64_t                    first;
+    uint64_t                    last;
+    struct cpu_start            *start;
+    double                      tstart;
+    double                      tend;
+};
+
+unsigned int cpu_default_threads(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (unsigned int)n : 1;
+}
+
+int cpu_pin_self(unsigned int index)
+{
+    cpu_set_t allowed, set;
+    unsigned int count, found;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return -1;
+    count = CPU_COUNT(&allowed);
+    if (count == 0)
+        return -1;
+    index %= count;
+
+    found = 0;
+    for (int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        if (found++ == index) {
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+    }
+    return -1;
+}
+
+void cpu_wait_start(struct cpu_start *start)
+{
+    __atomic_add_fetch(&start->ready, 1, __ATOMIC_ACQ_REL);
+    while (!__atomic_load_n(&start->go, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+void cpu_release_start(struct cpu_start *start, unsigned int threads, int abort)
+{
+    if (!abort) {
+        while (__atomic_load_n(&start->ready, __ATOMIC_ACQUIRE) < threads)
+            sched_yield();
+    }
+    __atomic_store_n(&start->abort, abort, __ATOMIC_RELEASE);
+    __atomic_store_n(&start->go, 1, __ATOMIC_RELEASE);
+}
+
+//fixed size copies for the common widths so they compile to plain moves
+static inline void cpu_copy_unit(unsigned char *dst, const unsigned char *src, unsigned int bytes)
+{
+    switch (bytes) {
+    case 4:  memcpy(dst, src, 4);  break;
+    case 8:  memcpy(dst, src, 8);  break;
+    case 16: memcpy(dst, src, 16); break;
+    case 32: memcpy(dst, src, 32); break;
+    case 64: memcpy(dst, src, 64); break;
+    default: memcpy(dst, src, bytes); break;
+    }
+}
+
+static void *cpu_bandwidth_worker(void *arg)
+{
+    struct cpu_worker *w = (struct cpu_worker *)arg;
+    const struct access_pattern *ap = w->ap;
+    unsigned int bytes = w->unit_bytes;
+
+    cpu_pin_self(w->id);
+    cpu_wait_start(w->start);
+    if (__atomic_load_n(&w->start->abort, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    w->tstart = now_seconds();
+    for (uint64_t i=w->first; i<w->last; i++) {
+        uint64_t offset = ap_pattern_block(ap, i, w->num_units) * bytes;
+        cpu_copy_unit(w->output + offset, w->input + offset, bytes);
+    }
+    w->tend = now_seconds();
+    return NULL;
+}
+
+int cpu_bandwidth_setup(const struct bench_options *opts, size_t size, struct cpu_bandwidth *bw)
+{
+    memset(bw, 0, sizeof(*bw));
+    bw->size = size;
+    bw->threads = (opts->threads > 0) ? opts->threads : cpu_default_threads();
+
+    double start = now_seconds();
+    bw->input = (unsigned char *)host_alloc(size, opts->host_pages, opts->host_node);
+    if (bw->input == NULL) {
+        printf("Error: Failed to allocate host input buffer of size %zu\n", size);
+        return -1;
+    }
+    bw->output = (unsigned char *)host_alloc(size, opts->host_pages, opts->host_node);
+    if (bw->output == NULL) {
+        printf("Error: Failed to allocate host output buffer of size %zu\n", size);
+        cpu_bandwidth_release(bw);
+        return -1;
+    }
+    //host_alloc faulted every page in, pooled buffers were faulted before
+    bw->alloc_seconds = now_seconds() - start;
+    bw->fill_seconds = fill_pattern(bw->input, size, 0, bw->threads);
+    memset(bw->output, 0, size);
+    return 0;
+}
+
+int cpu_bandwidth_launch(struct cpu_bandwidth *bw, const struct bench_options *opts, double *seconds)
+{
+    const struct access_pattern *ap = &opts->ap;
+    unsigned int threads = bw->threads;
+    struct cpu_worker *workers;
+    struct cpu_start start;
+    int ret = 0;
+
+    workers = (struct cpu_worker *)calloc(threads, sizeof(struct cpu_worker));
+    if (workers == NULL)
+        return -1;
+
+    memset(&start, 0, sizeof(start));
+    unsigned int started = 0;
+    for (unsigned int t=0; t<threads; t++) {
+        struct cpu_worker *w = &workers[t];
+        w->id = t;
+        w->ap = ap;
+        w->input = bw->input;
+        w->output = bw->output;
+        w->unit_bytes = opts->access_bytes;
+        w->num_units = bw->size / opts->access_bytes;
+        w->first = ap->iterations * t / threads;
+        w->last = ap->iterations * (t+1) / threads;
+        w->start = &start;
+        if (pthread_create(&w->thread, NULL, cpu_bandwidth_worker, w) != 0) {
+            printf("Error: Failed to start CPU worker thread %u\n", t);
+            ret = -1;
+            break;
+        }
+        started++;
+    }
+    cpu_release_start(&start, started, ret != 0);
+
+    double tstart = 0, tend = 0;
+    for (unsigned int t=0; t<started; t++) {
+        pthread_join(workers[t].thread, NULL);
+        if (t == 0 || workers[t].tstart < tstart)
+            tstart = workers[t].tstart;
+        if (t == 0 || workers[t].tend > tend)
+            tend = workers[t].tend;
+    }
+    free(workers);
+    *seconds = tend - tstart;
+    return ret;
+}
+
+int cpu_bandwidth_check(struct cpu_bandwidth *bw, const struct bench_options *opts)
+{
+    const unsigned char *output = bw->output;
+    const unsigned int bank = 0;
+    struct verify_report report;
+    int err;
+
+    if (!opts->verify)
+        return 0;
+    err = verify_touched(&output, &bank, 1, &opts->ap, bw->size / opts->access_bytes,
+                         opts->access_bytes, bw->threads, opts->verify_report, &report);
+    if (opts->mode != MODE_SWEEP || err != 0)
+        verify_print("host output", &report);
+    if (err == -2)
+        return -1;
+    return (err == 0) ? 0 : -2;
+}
+
+void cpu_bandwidth_release(struct cpu_bandwidth *bw)
+{
+    host_free(bw->input);
+    host_free(bw->output);
+    memset(bw, 0, sizeof(*bw));
+}
+
+int cpu_run_bandwidth(const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    struct cpu_bandwidth bw;
+    struct bench_result r;
+    int ret;
+
+    if (cpu_bandwidth_setup(opts, opts->buffer_size, &bw) != 0)
+        return -1;
+
+    printf("CPU backend: %u pinned threads\n", bw.threads);
+    printf("Setup: filled %.1f MB in %f sec (%f MB/sec)\n",
+           bw.size / (((double)1024) * ((double)1024)), bw.fill_seconds,
+           bw.size / (((double)1024) * ((double)1024)) / bw.fill_seconds);
+    printf("Access pattern %s, seed %llu, %llu accesses of %u bytes over %llu blocks\n",
+           ap_pattern_name(ap->pattern), (unsigned long long)ap->seed,
+           (unsigned long long)ap->iterations, opts->access_bytes,
+           (unsigned long long)(bw.size / opts->access_bytes));
+
+    ret = cpu_bandwidth_launch(&bw, opts, &r.seconds);
+    if (ret == 0) {
+        r.accesses = ap->iterations;
+        r.bytes_read = ap->iterations * opts->access_bytes;
+        r.bytes_written = ap->iterations * opts->access_bytes;
+        print_throughput("host memory", &r);
+        ret = cpu_bandwidth_check(&bw, opts);
+    }
+
+    cpu_bandwidth_release(&bw);
+    return ret;
+}
+
+int cpu_run_hostmem(const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    struct bench_options page_opts = *opts;
+    double mb = ((double)1024) * ((double)1024);
+    int kinds[2] = { HOST_PAGES_4K, opts->host_pages };
+    int ret = 0;
+
+    if (kinds[1] == HOST_PAGES_4K)
+        kinds[1] = HOST_PAGES_THP;
+    printf("Host memory: %.1f MB buffers, NUMA node %d, %llu accesses of %u bytes\n",
+           opts->buffer_size / mb,
+           (opts->host_node == HOST_NODE_DEVICE) ? host_device_node() : opts->host_node,
+           (unsigned long long)ap->iterations, opts->access_bytes);
+
+    for (unsigned int k=0; k<2 && ret == 0; k++) {
+        struct cpu_bandwidth bw;
+        struct verify_report report;
+        const unsigned char *output;
+        const unsigned int bank = 0;
+        double seconds;
+
+        page_opts.host_pages = kinds[k];
+        if (cpu_bandwidth_setup(&page_opts, opts->buffer_size, &bw) != 0)
+            return -1;
+        ret = cpu_bandwidth_launch(&bw, &page_opts, &seconds);
+        if (ret == 0) {
+            output = bw.output;
+            ret = verify_touched(&output, &bank, 1, ap, bw.size / opts->access_bytes,
+                                 opts->access_bytes, bw.threads, opts->verify_report, &report);
+            ret = (ret == -2) ? -1 : (ret == 0) ? 0 : -2;
+        }
+        if (ret == 0) {
+            double dmbytes = ap->iterations * (double)opts->access_bytes / mb;
+            printf("%-4s pages: map and fault %f MB/sec, fill %f MB/sec, copy %f MB/sec, "
+                   "verify %f MB/sec (%llu units)\n",
+                   host_pages_name(kinds[k]),
+                   2 * bw.size / mb / bw.alloc_seconds, bw.size / mb / bw.fill_seconds,
+                   2 * dmbytes / seconds,
+                   report.checked * (double)opts->access_bytes / mb / report.seconds,
+                   (unsigned long long)report.checked);
+        } else if (ret == -2) {
+            verify_print("host output", &report);
+        }
+        cpu_bandwidth_release(&bw);
+    }
+    host_pool_print();
+    return ret;
+}
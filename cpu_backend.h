@@ -0,0 +1,73 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : cpu_backend.h
+Purpose             : Host native execution of the bandwidth kernel, used as
+                      a CPU-DRAM baseline and to run the harness without a board
+Revision History    : 2017.07.12
+******************************************************************************
+*/
+#ifndef CPU_BACKEND_H
+#define CPU_BACKEND_H
+
+#include "bench.h"
+
+//number of worker threads used when --threads is not given
+unsigned int cpu_default_threads(void);
+
+//pin the calling thread to the index-th cpu of the process affinity mask
+int cpu_pin_self(unsigned int index);
+
+//start line all workers wait on after pinning themselves, so the measured
+//region starts once every thread is in place. cpu_release_start waits for
+//threads workers to arrive, abort lets them return without working.
+struct cpu_start {
+    unsigned int    ready;
+    int             go;
+    int             abort;
+};
+
+void cpu_wait_start(struct cpu_start *start);
+void cpu_release_start(struct cpu_start *start, unsigned int threads, int abort);
+
+/////////////////////////////////////////////////////////////////////////////////
+//cpu_bandwidth
+//Host buffers of the bandwidth mode, created once per buffer size and reused
+//by every launch of a sweep point
+struct cpu_bandwidth {
+    size_t          size;
+    unsigned int    threads;
+    unsigned char   *input;
+    unsigned char   *output;
+    double          alloc_seconds;
+    double          fill_seconds;
+};
+
+int cpu_bandwidth_setup(const struct bench_options *opts, size_t size, struct cpu_bandwidth *bw);
+int cpu_bandwidth_launch(struct cpu_bandwidth *bw, const struct bench_options *opts, double *seconds);
+int cpu_bandwidth_check(struct cpu_bandwidth *bw, const struct bench_options *opts);
+void cpu_bandwidth_release(struct cpu_bandwidth *bw);
+
+/////////////////////////////////////////////////////////////////////////////////
+//cpu_run_bandwidth
+//Run the bandwidth kernel semantics, copy the opts->access_bytes wide unit at
+//every index of the access stream from input to output, split over
+//opts->threads pinned threads
+//Return value
+// 0    Success
+//-1    Allocation or thread failure
+//-2    Result check failed
+int cpu_run_bandwidth(const struct bench_options *opts);
+
+/////////////////////////////////////////////////////////////////////////////////
+//cpu_run_hostmem
+//Run cpu_run_bandwidth on host buffers of 4 KB pages and then of the
+//opts->host_pages kind, transparent huge pages when that is 4 KB too, and
+//compare the allocation, fill, copy and verify throughput of the two
+//Return value
+// 0    Success
+//-1    Allocation or thread failure
+//-2    Result check failed
+int cpu_run_hostmem(const struct bench_options *opts);
+
+#endif
@@ -0,0 +1,195 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : dataflow.cpp
+Purpose             : Decoupled address/load/store dataflow variant of the
+                      bandwidth mode with a run time outstanding request depth
+Revision History    : 2017.08.24
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dataflow.h"
+
+//dataflow stages, one in-order queue and kernel each
+#define DF_ADDR                 0
+#define DF_LOAD                 1
+#define DF_STORE                2
+#define DF_STAGES               3
+
+static const char *df_kernel_names[DF_STAGES] = {
+    "bandwidth_addr", "bandwidth_load", "bandwidth_store"
+};
+
+struct dataflow {
+    cl_command_queue    queue[DF_STAGES];
+    cl_kernel           kernel[DF_STAGES];
+};
+
+static void dataflow_release(struct fpga_env *env, struct dataflow *df)
+{
+    for (unsigned int s=0; s<DF_STAGES; s++) {
+        fpga_release_kernel(env, df->kernel[s]);
+        if (df->queue[s])
+            clReleaseCommandQueue(df->queue[s]);
+    }
+    memset(df, 0, sizeof(*df));
+}
+
+static int dataflow_setup(struct fpga_env *env, struct dataflow *df)
+{
+    cl_int err;
+
+    memset(df, 0, sizeof(*df));
+    for (unsigned int s=0; s<DF_STAGES; s++) {
+        df->queue[s] = clCreateCommandQueue(env->context, env->device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+        if (!df->queue[s] || err != CL_SUCCESS) {
+            printf("Error: Failed to create dataflow command queue %d\n", err);
+            return -1;
+        }
+        df->kernel[s] = fpga_create_kernel(env, df_kernel_names[s], &err);
+        if (!df->kernel[s] || err != CL_SUCCESS) {
+            printf("Error: Failed to create %s kernel!\n", df_kernel_names[s]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//dataflow_launch
+//Start the three stages over pair 0 of bw with at most outstanding beats in
+//flight. The consumers are enqueued first so they are waiting on their pipes
+//when the address stage starts.
+//Return value
+// 0    Success, *seconds holds the span of the three kernels
+//-1    Error
+
+static int dataflow_launch(struct dataflow *df, struct fpga_bandwidth *bw,
+                           const struct bench_options *opts, cl_uint outstanding, double *seconds)
+{
+    const struct access_pattern *ap = &opts->ap;
+    cl_ulong num_blocks = bw->size / opts->access_bytes;
+    cl_uint shift = 0;
+    cl_event events[DF_STAGES];
+    cl_int err;
+
+    while ((1U << shift) < opts->access_bytes / AP_BLOCK_BYTES)
+        shift++;
+    cl_ulong num_beats = ap->iterations << shift;
+
+    int arg_num = 0;
+    err  = 0;
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_ulong), &num_blocks);
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_uint),  &shift);
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_uint),  &ap->pattern);
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_ulong), &ap->seed);
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_ulong), &ap->iterations);
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_ulong), &ap->param0);
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_ulong), &ap->param1);
+    err |= clSetKernelArg(df->kernel[DF_ADDR], arg_num++, sizeof(cl_uint),  &outstanding);
+    err |= clSetKernelArg(df->kernel[DF_LOAD],  0, sizeof(cl_mem),   &bw->input[0]);
+    err |= clSetKernelArg(df->kernel[DF_LOAD],  1, sizeof(cl_ulong), &num_beats);
+    err |= clSetKernelArg(df->kernel[DF_STORE], 0, sizeof(cl_mem),   &bw->output[0]);
+    err |= clSetKernelArg(df->kernel[DF_STORE], 1, sizeof(cl_ulong), &num_beats);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to set dataflow kernel arguments! %d\n", err);
+        return -1;
+    }
+
+    size_t global[1] = {1};
+    size_t local[1] = {1};
+    for (int s=DF_STORE; s>=DF_ADDR; s--) {
+        err = clEnqueueNDRangeKernel(df->queue[s], df->kernel[s], 1, NULL, global, local,
+                                     0, NULL, &events[s]);
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to execute %s %d\n", df_kernel_names[s], err);
+            for (int t=DF_STORE; t>s; t--)
+                clReleaseEvent(events[t]);
+            return -1;
+        }
+        clFlush(df->queue[s]);
+    }
+    for (unsigned int s=0; s<DF_STAGES; s++)
+        clFinish(df->queue[s]);
+
+    *seconds = events_span(events, DF_STAGES);
+    fpga_note_kernel(bw->env, *seconds);
+    for (unsigned int s=0; s<DF_STAGES; s++) {
+        profile_record(&bw->profile, df_kernel_names[s], PHASE_KERNEL,
+                       (s == DF_ADDR) ? 0 : fpga_bandwidth_bytes(bw, opts), events[s]);
+        clReleaseEvent(events[s]);
+    }
+    return 0;
+}
+
+static void dataflow_print(const char *name, const struct fpga_bandwidth *bw,
+                           const struct bench_options *opts, double seconds, double baseline)
+{
+    double dmbytes = 2 * fpga_bandwidth_bytes(bw, opts) / (((double)1024) * ((double)1024));
+
+    printf("%-22s %f sec, %f MB/sec, %f accesses/sec", name, seconds, dmbytes / seconds,
+           opts->ap.iterations / seconds);
+    if (baseline > 0)
+        printf(", %.2fx the monolithic rate", baseline / seconds);
+    printf("\n");
+}
+
+int fpga_run_dataflow(struct fpga_env *env, const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    struct fpga_bandwidth bw;
+    struct dataflow df;
+    double baseline, seconds;
+    char name[32];
+    int ret = -1;
+
+    memset(&df, 0, sizeof(df));
+    if (fpga_bandwidth_setup(env, opts, opts->buffer_size, &bw) != 0)
+        goto cleanup;
+    if (bw.layout.num_pairs != 1) {
+        printf("Error: the dataflow kernels use one port pair, %u pairs are in use\n",
+               bw.layout.num_pairs);
+        goto cleanup;
+    }
+    if (dataflow_setup(env, &df) != 0)
+        goto cleanup;
+
+    printf("Access pattern %s, seed %llu, %llu accesses of %u bytes over %llu blocks\n",
+           ap_pattern_name(ap->pattern), (unsigned long long)ap->seed,
+           (unsigned long long)ap->iterations, opts->access_bytes,
+           (unsigned long long)(bw.size / opts->access_bytes));
+
+    for (unsigned int w=0; w<opts->warmup; w++) {
+        if (fpga_bandwidth_launch(env, &bw, opts, &baseline) != 0)
+            goto cleanup;
+    }
+    if (fpga_bandwidth_launch(env, &bw, opts, &baseline) != 0)
+        goto cleanup;
+    dataflow_print("Monolithic:", &bw, opts, baseline, 0);
+
+    ret = 0;
+    for (unsigned int i=0; i<opts->num_outstanding && ret == 0; i++) {
+        cl_uint outstanding = (cl_uint)opts->outstanding[i];
+        if (opts->verify && fpga_bandwidth_clear_outputs(env, &bw) != 0) {
+            ret = -1;
+            break;
+        }
+        if (dataflow_launch(&df, &bw, opts, outstanding, &seconds) != 0) {
+            ret = -1;
+            break;
+        }
+        snprintf(name, sizeof(name), "Dataflow %u in flight:", outstanding);
+        dataflow_print(name, &bw, opts, seconds, baseline);
+        ret = fpga_bandwidth_check(env, &bw, opts);
+    }
+    if (ret == 0)
+        profile_print(&bw.profile);
+
+cleanup:
+    dataflow_release(env, &df);
+    fpga_bandwidth_release(&bw);
+    return ret;
+}
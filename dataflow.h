@@ -0,0 +1,29 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : dataflow.h
+Purpose             : Decoupled address/load/store dataflow variant of the
+                      bandwidth mode with a run time outstanding request depth
+Revision History    : 2017.08.24
+******************************************************************************
+*/
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_dataflow
+//Run the access stream of opts once through the monolithic bandwidth kernel as
+//the baseline, then through the bandwidth_addr, bandwidth_load and
+//bandwidth_store kernels once per depth of opts->outstanding, each stage on its
+//own queue. Every point reports its rate against the baseline, and the output
+//is cleared and checked after each dataflow run.
+//Return value
+// 0    Success
+//-1    Allocation or OpenCL failure
+//-2    Output mismatch
+int fpga_run_dataflow(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
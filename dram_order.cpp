@@ -0,0 +1,154 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : dram_order.cpp
+Purpose             : DRAM bank/row address model and the host side radix
+                      reordering of block index batches by bank and row
+Revision History    : 2017.09.11
+******************************************************************************
+*/
+#include <string.h>
+
+#include "dram_order.h"
+
+//key bits sorted per radix pass
+#define DRAM_RADIX_BITS         8
+#define DRAM_RADIX              (1U << DRAM_RADIX_BITS)
+
+static const char *dram_map_names[DRAM_NUM_MAPS] = {
+    "rbc", "brc", "xor"
+};
+
+const char *dram_map_name(int map)
+{
+    return (map >= 0 && map < DRAM_NUM_MAPS) ? dram_map_names[map] : "unknown";
+}
+
+int dram_map_parse(const char *name)
+{
+    for (int m=0; m<DRAM_NUM_MAPS; m++) {
+        if (strcmp(name, dram_map_names[m]) == 0)
+            return m;
+    }
+    return -1;
+}
+
+static unsigned int dram_log2(uint64_t v)
+{
+    unsigned int bits = 0;
+    while ((1ULL << bits) < v)
+        bits++;
+    return bits;
+}
+
+void dram_model_init(struct dram_model *m, int map, size_t page_bytes, unsigned int banks,
+                     uint64_t num_blocks, unsigned int pair_shift, unsigned int port_mode)
+{
+    uint64_t units = (port_mode == AP_PORTS_INTERLEAVE) ? (num_blocks >> pair_shift) : num_blocks;
+    unsigned int addr_bits = dram_log2(units);
+
+    memset(m, 0, sizeof(*m));
+    m->map = map;
+    m->column_bits = dram_log2(page_bytes / AP_BLOCK_BYTES);
+    m->bank_bits = dram_log2(banks);
+    m->pair_shift = pair_shift;
+    m->port_mode = port_mode;
+    if (map == DRAM_MAP_BRC) {
+        m->row_shift = m->column_bits;
+        m->bank_shift = (addr_bits > m->column_bits + m->bank_bits) ? addr_bits - m->bank_bits
+                                                                    : m->column_bits;
+        m->row_bits = m->bank_shift - m->column_bits;
+    } else {
+        m->bank_shift = m->column_bits;
+        m->row_shift = m->column_bits + m->bank_bits;
+        m->row_bits = (addr_bits > m->row_shift) ? addr_bits - m->row_shift : 0;
+    }
+}
+
+//pair, bank and row of block
+static void dram_decode(const struct dram_model *m, uint64_t block,
+                        unsigned int *pair, unsigned int *bank, uint64_t *row)
+{
+    uint64_t unit = ap_pair_unit(m->port_mode, m->pair_shift, block);
+    uint64_t bank_mask = (1ULL << m->bank_bits) - 1;
+
+    *pair = (m->port_mode == AP_PORTS_INTERLEAVE) ? (unsigned int)(block & ((1ULL << m->pair_shift) - 1)) : 0;
+    *bank = (unsigned int)((unit >> m->bank_shift) & bank_mask);
+    *row = (unit >> m->row_shift) & ((1ULL << m->row_bits) - 1);
+    if (m->map == DRAM_MAP_XOR)
+        *bank ^= (unsigned int)(*row & bank_mask);
+}
+
+uint64_t dram_key(const struct dram_model *m, uint64_t block)
+{
+    unsigned int pair, bank;
+    uint64_t row;
+
+    dram_decode(m, block, &pair, &bank, &row);
+    return (row << m->bank_bits) | bank;
+}
+
+void dram_reorder(const struct dram_model *m, const uint64_t *entries, uint64_t count,
+                  uint64_t num_blocks, uint64_t *sorted, uint64_t *perm, uint64_t *scratch)
+{
+    uint64_t *key = scratch;
+    uint64_t *key_next = scratch + count;
+    uint64_t *pos = perm;
+    uint64_t *pos_next = scratch + 2 * count;
+    unsigned int key_bits = m->row_bits + m->bank_bits;
+
+    for (uint64_t i=0; i<count; i++) {
+        key[i] = dram_key(m, ap_trace_block(entries[i], num_blocks));
+        pos[i] = i;
+    }
+
+    for (unsigned int shift=0; shift<key_bits; shift+=DRAM_RADIX_BITS) {
+        uint64_t offset[DRAM_RADIX];
+        uint64_t sum = 0;
+
+        memset(offset, 0, sizeof(offset));
+        for (uint64_t i=0; i<count; i++)
+            offset[(key[i] >> shift) & (DRAM_RADIX - 1)]++;
+        for (unsigned int d=0; d<DRAM_RADIX; d++) {
+            uint64_t n = offset[d];
+            offset[d] = sum;
+            sum += n;
+        }
+        for (uint64_t i=0; i<count; i++) {
+            uint64_t o = offset[(key[i] >> shift) & (DRAM_RADIX - 1)]++;
+            key_next[o] = key[i];
+            pos_next[o] = pos[i];
+        }
+
+        uint64_t *t = key;
+        key = key_next;
+        key_next = t;
+        t = pos;
+        pos = pos_next;
+        pos_next = t;
+    }
+
+    if (pos != perm)
+        memcpy(perm, pos, count * sizeof(uint64_t));
+    for (uint64_t i=0; i<count; i++)
+        sorted[i] = entries[perm[i]];
+}
+
+uint64_t dram_row_hits(const struct dram_model *m, const uint64_t *entries, uint64_t count,
+                       uint64_t num_blocks)
+{
+    uint64_t open[AP_MAX_PAIRS][DRAM_MAX_BANKS];
+    uint64_t hits = 0;
+
+    memset(open, 0xff, sizeof(open));
+    for (uint64_t i=0; i<count; i++) {
+        unsigned int pair, bank;
+        uint64_t row;
+
+        dram_decode(m, ap_trace_block(entries[i], num_blocks), &pair, &bank, &row);
+        if (open[pair][bank] == row)
+            hits++;
+        open[pair][bank] = row;
+    }
+    return hits;
+}
@@ -0,0 +1,74 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : dram_order.h
+Purpose             : DRAM bank/row address model and the host side radix
+                      reordering of block index batches by bank and row
+Revision History    : 2017.09.11
+******************************************************************************
+*/
+#ifndef DRAM_ORDER_H
+#define DRAM_ORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "access_pattern.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//DRAM address maps selectable with --dram-map
+//The block address inside the buffer of a pair is split into row, bank and
+//column, from the top:
+//rbc   row, bank, column, consecutive rows rotate through the banks
+//brc   bank, row, column, each bank holds one contiguous part of the buffer
+//xor   rbc with the bank bits xored with the low row bits, as controllers
+//      hash banks to spread strided streams
+#define DRAM_MAP_RBC            0
+#define DRAM_MAP_BRC            1
+#define DRAM_MAP_XOR            2
+#define DRAM_NUM_MAPS           3
+
+//most banks the row buffer model tracks
+#define DRAM_MAX_BANKS          64
+
+struct dram_model {
+    int             map;
+    unsigned int    column_bits;
+    unsigned int    bank_bits;
+    unsigned int    bank_shift;
+    unsigned int    row_bits;
+    unsigned int    row_shift;
+    unsigned int    pair_shift;
+    unsigned int    port_mode;
+};
+
+const char *dram_map_name(int map);
+
+//DRAM_MAP_* of name, -1 when unknown
+int dram_map_parse(const char *name);
+
+//model of map with pages of page_bytes (a power of two of at least
+//AP_BLOCK_BYTES) in banks banks, over num_blocks blocks spread over the port
+//pairs of pair_shift and port_mode as the kernels spread them
+void dram_model_init(struct dram_model *m, int map, size_t page_bytes, unsigned int banks,
+                     uint64_t num_blocks, unsigned int pair_shift, unsigned int port_mode);
+
+//(row << bank_bits) | bank of block, the order dram_reorder sorts by
+uint64_t dram_key(const struct dram_model *m, uint64_t block);
+
+/////////////////////////////////////////////////////////////////////////////////
+//dram_reorder
+//Stable LSD radix sort of count trace format entries by the dram_key of their
+//block, 8 key bits per pass. sorted[i] receives entries[perm[i]], so the
+//result of sorted entry i belongs at position perm[i] of the request order.
+//Entries of the same block keep their relative order. scratch holds 3 *
+//count words.
+void dram_reorder(const struct dram_model *m, const uint64_t *entries, uint64_t count,
+                  uint64_t num_blocks, uint64_t *sorted, uint64_t *perm, uint64_t *scratch);
+
+//accesses of count entries that find their row open, with every bank of every
+//pair keeping the row of its last access open
+uint64_t dram_row_hits(const struct dram_model *m, const uint64_t *entries, uint64_t count,
+                       uint64_t num_blocks);
+
+#endif
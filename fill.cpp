@@ -0,0 +1,118 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : fill.cpp
+Purpose             : Parallel vectorized generator of the i%256 input data
+Revision History    : 2017.08.02
+******************************************************************************
+*/
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fill.h"
+#include "bench.h"
+#include "cpu_backend.h"
+
+//two periods of the pattern, so 256 contiguous bytes start at any phase
+static unsigned char fill_template[512] __attribute__((aligned(64)));
+static pthread_once_t fill_template_once = PTHREAD_ONCE_INIT;
+
+static void fill_template_init(void)
+{
+    for (int i=0; i<512; i++)
+        fill_template[i] = FILL_BYTE(i);
+}
+
+static void fill_range(unsigned char *dst, size_t offset, size_t len)
+{
+    size_t i = 0;
+
+    //head up to a 64 byte boundary
+    while (i < len && ((uintptr_t)(dst + i) & 63))
+        dst[i] = FILL_BYTE(offset + i), i++;
+
+#ifdef __SSE2__
+    //streaming stores, the data is not read back by this thread
+    for (; i + 64 <= len; i += 64) {
+        const unsigned char *src = fill_template + ((offset + i) & 255);
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(src));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(src + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i *)(src + 48));
+        _mm_stream_si128((__m128i *)(dst + i),      v0);
+        _mm_stream_si128((__m128i *)(dst + i + 16), v1);
+        _mm_stream_si128((__m128i *)(dst + i + 32), v2);
+        _mm_stream_si128((__m128i *)(dst + i + 48), v3);
+    }
+    _mm_sfence();
+#else
+    for (; i + 256 <= len; i += 256)
+        memcpy(dst + i, fill_template + ((offset + i) & 255), 256);
+#endif
+
+    for (; i < len; i++)
+        dst[i] = FILL_BYTE(offset + i);
+}
+
+struct fill_job {
+    pthread_t       thread;
+    unsigned int    id;
+    unsigned char   *dst;
+    size_t          offset;
+    size_t          len;
+};
+
+static void *fill_worker(void *arg)
+{
+    struct fill_job *job = (struct fill_job *)arg;
+    cpu_pin_self(job->id);
+    fill_range(job->dst, job->offset, job->len);
+    return NULL;
+}
+
+double fill_pattern(unsigned char *dst, size_t size, size_t offset, unsigned int threads)
+{
+    struct fill_job jobs[256];
+    unsigned int started = 0;
+    double tstart = now_seconds();
+
+    pthread_once(&fill_template_once, fill_template_init);
+    if (threads == 0)
+        threads = cpu_default_threads();
+    if (threads > 256)
+        threads = 256;
+    //not worth a thread below 1MB per thread
+    while (threads > 1 && size / threads < (1 << 20))
+        threads--;
+
+    //split at 4KB boundaries, the last job takes the remainder
+    size_t chunk = (size / threads) & ~(size_t)4095;
+    for (unsigned int t=1; t<threads && chunk > 0; t++) {
+        struct fill_job *job = &jobs[t];
+        job->id = t;
+        job->dst = dst + t*chunk;
+        job->offset = offset + t*chunk;
+        job->len = (t == threads-1) ? size - t*chunk : chunk;
+        if (pthread_create(&job->thread, NULL, fill_worker, job) != 0)
+            break;
+        started = t;
+    }
+    //the calling thread fills the first chunk and whatever no thread took
+    fill_range(dst, offset, (started == 0) ? size : chunk);
+    if (started > 0 && started < threads-1)
+        fill_range(dst + (started+1)*chunk, offset + (started+1)*chunk, size - (started+1)*chunk);
+    for (unsigned int t=1; t<=started; t++)
+        pthread_join(jobs[t].thread, NULL);
+
+    return now_seconds() - tstart;
+}
+
+const unsigned char *fill_template_at(size_t offset)
+{
+    pthread_once(&fill_template_once, fill_template_init);
+    return fill_template + (offset & 255);
+}
@@ -0,0 +1,30 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : fill.h
+Purpose             : Parallel vectorized generator of the i%256 input data,
+                      written straight into mapped buffers
+Revision History    : 2017.08.02
+******************************************************************************
+*/
+#ifndef FILL_H
+#define FILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//value of the input data at byte offset of a buffer
+#define FILL_BYTE(offset)       ((unsigned char)((offset) % 256))
+
+/////////////////////////////////////////////////////////////////////////////////
+//fill_pattern
+//Write FILL_BYTE(offset + i) to dst[i] for i in [0, size), split over threads
+//threads (0 means all cpus), with 16 byte streaming stores where available
+//Return value
+//  seconds spent filling
+double fill_pattern(unsigned char *dst, size_t size, size_t offset, unsigned int threads);
+
+//256 contiguous bytes of the pattern starting at offset
+const unsigned char *fill_template_at(size_t offset);
+
+#endif
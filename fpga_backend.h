@@ -0,0 +1,184 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : fpga_backend.h
+Purpose             : OpenCL handles and helpers shared by the FPGA run modes
+Revision History    : 2017.07.18
+******************************************************************************
+*/
+#ifndef FPGA_BACKEND_H
+#define FPGA_BACKEND_H
+
+#include <CL/opencl.h>
+#include <CL/cl_ext.h>
+
+#include "bench.h"
+#include "profile.h"
+
+struct fpga_session;
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_env
+//Handles created by opencl_setup for the selected accelerator. With a session
+//the kernels and buffers below come from its pools and outlive the run.
+//max_alloc is the largest buffer the device allows, or --tile-size when
+//smaller, 0 when unknown.
+struct fpga_env {
+    cl_platform_id      platform_id;
+    cl_device_id        device_id;
+    cl_context          context;
+    cl_command_queue    command_queue;
+    cl_program          program;
+    unsigned int        num_banks;
+    cl_ulong            max_alloc;
+    struct fpga_session *session;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_layout
+//How the port pairs of the copy kernels map onto DDR banks, derived from
+//--banks and --placement:
+//same        one pair per bank, input and output in the same bank
+//split       one pair per two banks, input in bank 2p, output in bank 2p+1
+//interleave  one pair per bank, units striped over the pairs, output of pair
+//            p one bank after its input
+//A buffer too large for one allocation is tiled by fpga_layout_tile, the
+//pairs become tiles with the units interleaved over them.
+struct fpga_layout {
+    unsigned int    num_pairs;
+    unsigned int    pair_shift;
+    unsigned int    port_mode;
+    unsigned int    tiled;
+    unsigned int    input_bank[AP_MAX_PAIRS];
+    unsigned int    output_bank[AP_MAX_PAIRS];
+};
+
+void fpga_layout_init(const struct bench_options *opts, struct fpga_layout *layout);
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_layout_tile
+//When a pair buffer of a size byte logical buffer exceeds max_alloc bytes,
+//split it into the fewest power of two tiles, at least one per pair, that
+//fit. Tile t takes the banks of pair t of the placement, wrapping around, and
+//the units are interleaved over the tiles, so replicated placements then move
+//each access through one tile only. max_alloc 0 never tiles.
+//Return value
+// 0    Success, layout is unchanged when the buffer fits
+//-1    More than AP_MAX_PAIRS tiles needed
+int fpga_layout_tile(struct fpga_layout *layout, size_t size, uint64_t max_alloc);
+const char *fpga_placement_name(int placement);
+
+//bytes of each pair buffer holding a size byte logical buffer
+size_t fpga_layout_pair_bytes(const struct fpga_layout *layout, size_t size);
+
+//units of unit_bytes addressable in a size byte logical buffer
+uint64_t fpga_layout_units(const struct fpga_layout *layout, size_t size, unsigned int unit_bytes);
+
+//set the AP_MAX_PAIRS input/output buffer arguments starting at *arg_num,
+//pairs not in use get the buffers of pair 0
+cl_int fpga_set_pair_args(cl_kernel kernel, const struct fpga_layout *layout,
+                          const cl_mem *inputs, const cl_mem *outputs, int *arg_num);
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth
+//Kernels and buffers of the bandwidth mode, created once per buffer size and
+//reused by every launch of a sweep point. Pair p buffers hold pair_size bytes
+//and sit in the banks given by layout. With --cache the launch runs
+//bandwidth_cached and leaves its counters of the last launch in cache, with
+//--stats it runs bandwidth_stats timed by bandwidth_clock on clock_queue and
+//leaves the loop counters in stats.
+struct fpga_bandwidth {
+    struct fpga_env *env;
+    size_t          size;
+    size_t          pair_size;
+    struct fpga_layout layout;
+    cl_kernel       kernel;
+    cl_kernel       kernel_narrow;
+    cl_kernel       kernel_cached;
+    cl_mem          cache_stats;
+    cl_ulong        cache[AP_CACHE_NUM_STATS];
+    cl_kernel       kernel_stats;
+    cl_kernel       kernel_clock;
+    cl_command_queue clock_queue;
+    cl_mem          loop_stats;
+    cl_ulong        stats[AP_STATS_NUM];
+    cl_mem          input[AP_MAX_PAIRS];
+    cl_mem          output[AP_MAX_PAIRS];
+    double          fill_seconds;
+    double          setup_seconds;
+    struct profile_log profile;
+};
+
+int fpga_bandwidth_setup(struct fpga_env *env, const struct bench_options *opts,
+                         size_t size, struct fpga_bandwidth *bw);
+int fpga_bandwidth_launch(struct fpga_env *env, struct fpga_bandwidth *bw,
+                          const struct bench_options *opts, double *seconds);
+int fpga_bandwidth_check(struct fpga_env *env, struct fpga_bandwidth *bw,
+                         const struct bench_options *opts);
+void fpga_bandwidth_release(struct fpga_bandwidth *bw);
+
+//bandwidth or bandwidth_narrow kernel with the arguments of the access stream
+//of opts set, for callers enqueueing launches themselves, NULL on error
+cl_kernel fpga_bandwidth_kernel(struct fpga_env *env, struct fpga_bandwidth *bw,
+                                const struct bench_options *opts);
+
+//zero the output buffers of every pair in use
+int fpga_bandwidth_clear_outputs(struct fpga_env *env, struct fpga_bandwidth *bw);
+
+//bytes one launch reads, and writes, in global memory
+uint64_t fpga_bandwidth_bytes(const struct fpga_bandwidth *bw, const struct bench_options *opts);
+
+//print the bytes each bank read and wrote during a launch of seconds and the
+//resulting per bank and aggregate bandwidth
+void fpga_bandwidth_print_banks(const struct fpga_bandwidth *bw, const struct bench_options *opts,
+                                double seconds);
+
+//print the hit, miss and eviction counters of the last cached launch and the
+//DDR traffic the cache left
+void fpga_bandwidth_print_cache(const struct fpga_bandwidth *bw, const struct bench_options *opts,
+                                double seconds);
+
+//print the loop cycles, accesses and per pair bytes of the last instrumented
+//launch against its event time of seconds
+void fpga_bandwidth_print_stats(const struct fpga_bandwidth *bw, const struct bench_options *opts,
+                                double seconds);
+
+//create a read/write buffer, placed in DDR bank 0, or bank, when the card
+//has more than one bank, and give it back with fpga_release_buffer
+cl_mem fpga_create_buffer(struct fpga_env *env, size_t size, cl_int *err);
+cl_mem fpga_create_bank_buffer(struct fpga_env *env, size_t size, unsigned int bank, cl_int *err);
+void fpga_release_buffer(struct fpga_env *env, cl_mem mem);
+
+//fpga_create_bank_buffer that also tells whether a pooled buffer still holds
+//the input fill pattern, fpga_mark_filled records that it does
+cl_mem fpga_take_bank_buffer(struct fpga_env *env, size_t size, unsigned int bank,
+                             int *filled, cl_int *err);
+void fpga_mark_filled(struct fpga_env *env, cl_mem mem);
+
+//kernel of the program by name, give it back with fpga_release_kernel
+cl_kernel fpga_create_kernel(struct fpga_env *env, const char *name, cl_int *err);
+void fpga_release_kernel(struct fpga_env *env, cl_kernel kernel);
+
+//account a finished kernel of seconds to the session
+void fpga_note_kernel(struct fpga_env *env, double seconds);
+
+//CL_PROFILING_COMMAND_END - CL_PROFILING_COMMAND_START of event in seconds
+double event_seconds(cl_event event);
+
+//time from the earliest start to the latest end of count events in seconds
+double events_span(const cl_event *events, unsigned int count);
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_units
+//Scaling mode, run bandwidth_unit as every unit count of opts->units, either
+//one task per compute unit or work items of one unit, with the units spread
+//over the port pairs and partitioned by opts->partition. Every count reports
+//per unit and aggregate throughput and the scaling efficiency against the
+//first count.
+//Return value
+// 0    Success
+//-1    Allocation or OpenCL failure
+//-2    Output mismatch
+int fpga_run_units(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
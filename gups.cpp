@@ -0,0 +1,334 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : gups.cpp
+Purpose             : HPCC RandomAccess (GUPS) read-modify-write update mode
+Revision History    : 2017.08.21
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gups.h"
+#include "cpu_backend.h"
+#include "host_alloc.h"
+
+//what a gups worker does over its range
+#define GUPS_INIT               0
+#define GUPS_UPDATE             1
+#define GUPS_REPLAY             2
+#define GUPS_COUNT              3
+
+struct gups_worker {
+    pthread_t           thread;
+    unsigned int        id;
+    int                 op;
+    uint64_t            *table;
+    uint64_t            table_mask;
+    uint64_t            first;
+    uint64_t            last;
+    uint64_t            errors;
+    struct cpu_start    *start;
+    double              tstart;
+    double              tend;
+};
+
+uint64_t gups_starts(int64_t n)
+{
+    uint64_t m2[64];
+    uint64_t temp, ran;
+    int i;
+
+    while (n < 0)
+        n += AP_GUPS_PERIOD;
+    while (n > (int64_t)AP_GUPS_PERIOD)
+        n -= AP_GUPS_PERIOD;
+    if (n == 0)
+        return 0x1;
+
+    temp = 0x1;
+    for (i=0; i<64; i++) {
+        m2[i] = temp;
+        temp = ap_gups_next(temp);
+        temp = ap_gups_next(temp);
+    }
+
+    for (i=62; i>=0; i--) {
+        if ((n >> i) & 1)
+            break;
+    }
+
+    ran = 0x2;
+    while (i > 0) {
+        temp = 0;
+        for (int j=0; j<64; j++) {
+            if ((ran >> j) & 1)
+                temp ^= m2[j];
+        }
+        ran = temp;
+        i -= 1;
+        if ((n >> i) & 1)
+            ran = ap_gups_next(ran);
+    }
+    return ran;
+}
+
+static void *gups_worker_run(void *arg)
+{
+    struct gups_worker *w = (struct gups_worker *)arg;
+    uint64_t *table = w->table;
+    uint64_t ran;
+
+    cpu_pin_self(w->id);
+    cpu_wait_start(w->start);
+    if (__atomic_load_n(&w->start->abort, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    w->tstart = now_seconds();
+    switch (w->op) {
+    case GUPS_INIT:
+        for (uint64_t i=w->first; i<w->last; i++)
+            table[i] = i;
+        break;
+    case GUPS_UPDATE:
+        ran = gups_starts(w->first);
+        for (uint64_t i=w->first; i<w->last; i++) {
+            ran = ap_gups_next(ran);
+            table[ran & w->table_mask] ^= ran;
+        }
+        break;
+    case GUPS_REPLAY:
+        //the check itself must not lose updates
+        ran = gups_starts(w->first);
+        for (uint64_t i=w->first; i<w->last; i++) {
+            ran = ap_gups_next(ran);
+            __atomic_fetch_xor(&table[ran & w->table_mask], ran, __ATOMIC_RELAXED);
+        }
+        break;
+    case GUPS_COUNT:
+        for (uint64_t i=w->first; i<w->last; i++)
+            w->errors += (table[i] != i);
+        break;
+    }
+    w->tend = now_seconds();
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//gups_parallel
+//Run op over [0, count) split across threads pinned threads
+//Return value
+// 0    Success, *seconds holds the time from the first start to the last end
+//-1    Allocation or thread failure
+
+static int gups_parallel(int op, uint64_t *table, uint64_t table_mask, uint64_t count,
+                         unsigned int threads, uint64_t *errors, double *seconds)
+{
+    struct gups_worker *workers;
+    struct cpu_start start;
+    unsigned int started = 0;
+    int ret = 0;
+
+    workers = (struct gups_worker *)calloc(threads, sizeof(struct gups_worker));
+    if (workers == NULL)
+        return -1;
+
+    memset(&start, 0, sizeof(start));
+    for (unsigned int t=0; t<threads; t++) {
+        struct gups_worker *w = &workers[t];
+        w->id = t;
+        w->op = op;
+        w->table = table;
+        w->table_mask = table_mask;
+        w->first = count * t / threads;
+        w->last = count * (t+1) / threads;
+        w->start = &start;
+        if (pthread_create(&w->thread, NULL, gups_worker_run, w) != 0) {
+            printf("Error: Failed to start GUPS worker thread %u\n", t);
+            ret = -1;
+            break;
+        }
+        started++;
+    }
+    cpu_release_start(&start, started, ret != 0);
+
+    double tstart = 0, tend = 0;
+    if (errors != NULL)
+        *errors = 0;
+    for (unsigned int t=0; t<started; t++) {
+        pthread_join(workers[t].thread, NULL);
+        if (t == 0 || workers[t].tstart < tstart)
+            tstart = workers[t].tstart;
+        if (t == 0 || workers[t].tend > tend)
+            tend = workers[t].tend;
+        if (errors != NULL)
+            *errors += workers[t].errors;
+    }
+    free(workers);
+    if (seconds != NULL)
+        *seconds = tend - tstart;
+    return ret;
+}
+
+//largest power of two of 64-bit words that fits in size bytes
+static uint64_t gups_table_words(size_t size)
+{
+    uint64_t words = 1;
+    while (words * 2 * sizeof(uint64_t) <= size)
+        words *= 2;
+    return words;
+}
+
+static uint64_t gups_updates(const struct bench_options *opts, uint64_t words)
+{
+    return (opts->gups_updates > 0) ? opts->gups_updates : 4 * words;
+}
+
+static void gups_print(const char *memory_name, uint64_t words, uint64_t updates, double seconds)
+{
+    printf("GUPS: %llu updates over a %llu word (%.1f MB) table in %s\n",
+           (unsigned long long)updates, (unsigned long long)words,
+           words * sizeof(uint64_t) / (((double)1024) * ((double)1024)), memory_name);
+    printf("Execution time = %f (sec) \n", seconds);
+    printf("Update Rate = %.9f (GUP/s) \n", updates / seconds / 1e9);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//gups_check
+//Apply the stream again and count the words that differ from their index
+//Return value
+// 0    Within tolerance
+//-1    Thread failure
+//-2    Too many errors
+
+static int gups_check(const struct bench_options *opts, uint64_t *table, uint64_t words,
+                      uint64_t updates, unsigned int threads)
+{
+    uint64_t errors;
+    double replay_seconds, count_seconds;
+
+    if (gups_parallel(GUPS_REPLAY, table, words - 1, updates, threads, NULL, &replay_seconds) != 0 ||
+        gups_parallel(GUPS_COUNT, table, words - 1, words, threads, &errors, &count_seconds) != 0)
+        return -1;
+
+    double percent = 100.0 * errors / words;
+    int pass = (percent <= opts->gups_tolerance);
+    printf("Verify gups table: %llu of %llu words wrong (%f%%) in %f sec, tolerance %.3f%%: %s\n",
+           (unsigned long long)errors, (unsigned long long)words, percent,
+           replay_seconds + count_seconds, opts->gups_tolerance, pass ? "PASS" : "FAIL");
+    return pass ? 0 : -2;
+}
+
+int cpu_run_gups(const struct bench_options *opts)
+{
+    unsigned int threads = (opts->threads > 0) ? opts->threads : cpu_default_threads();
+    uint64_t words = gups_table_words(opts->buffer_size);
+    uint64_t updates = gups_updates(opts, words);
+    uint64_t *table;
+    double seconds;
+    int ret;
+
+    table = (uint64_t *)host_alloc(words * sizeof(uint64_t), opts->host_pages, opts->host_node);
+    if (table == NULL) {
+        printf("Error: Failed to allocate GUPS table of %llu words\n", (unsigned long long)words);
+        return -1;
+    }
+    printf("CPU backend: %u pinned threads\n", threads);
+    ret = gups_parallel(GUPS_INIT, table, words - 1, words, threads, NULL, NULL);
+    if (ret == 0)
+        ret = gups_parallel(GUPS_UPDATE, table, words - 1, updates, threads, NULL, &seconds);
+    if (ret == 0) {
+        gups_print("host memory", words, updates, seconds);
+        if (opts->verify)
+            ret = gups_check(opts, table, words, updates, threads);
+    }
+    host_free(table);
+    return ret;
+}
+
+int fpga_run_gups(struct fpga_env *env, const struct bench_options *opts)
+{
+    unsigned int threads = (opts->threads > 0) ? opts->threads : cpu_default_threads();
+    uint64_t words = gups_table_words(opts->buffer_size);
+    cl_ulong updates = gups_updates(opts, words);
+    cl_ulong table_mask = words - 1;
+    cl_ulong ran = gups_starts(0);
+    cl_event event;
+    uint64_t *map_table;
+    cl_int err;
+    int ret = -1;
+
+    cl_kernel kernel = fpga_create_kernel(env, "gups", &err);
+    if (!kernel || err != CL_SUCCESS) {
+        printf("Error: Failed to create gups kernel!\n");
+        return -1;
+    }
+    cl_mem table = fpga_create_buffer(env, words * sizeof(uint64_t), &err);
+    if (err != CL_SUCCESS) {
+        printf("Error: Failed to allocate GUPS table of %llu words\n", (unsigned long long)words);
+        fpga_release_kernel(env, kernel);
+        return -1;
+    }
+
+    map_table = (uint64_t *)clEnqueueMapBuffer(env->command_queue, table, CL_TRUE,
+                                               CL_MAP_WRITE_INVALIDATE_REGION, 0,
+                                               words * sizeof(uint64_t), 0, NULL, NULL, &err);
+    if (err != CL_SUCCESS) {
+        printf("Error: Failed to clEnqueueMapBuffer GUPS table\n");
+        goto cleanup;
+    }
+    //unmapped either way, the table goes back to the session pool
+    if (gups_parallel(GUPS_INIT, map_table, table_mask, words, threads, NULL, NULL) != 0) {
+        clEnqueueUnmapMemObject(env->command_queue, table, map_table, 0, NULL, NULL);
+        clFinish(env->command_queue);
+        goto cleanup;
+    }
+    clEnqueueUnmapMemObject(env->command_queue, table, map_table, 0, NULL, NULL);
+    clFinish(env->command_queue);
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem),   &table);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_ulong), &table_mask);
+    err |= clSetKernelArg(kernel, 2, sizeof(cl_ulong), &ran);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_ulong), &updates);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to set gups kernel arguments! %d\n", err);
+        goto cleanup;
+    }
+
+    {
+        size_t global[1] = {1};
+        size_t local[1] = {1};
+        err = clEnqueueNDRangeKernel(env->command_queue, kernel, 1, NULL, global, local,
+                                     0, NULL, &event);
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to execute kernel %d\n", err);
+            goto cleanup;
+        }
+        clFinish(env->command_queue);
+        fpga_note_kernel(env, event_seconds(event));
+        gups_print("global memory", words, updates, event_seconds(event));
+        clReleaseEvent(event);
+    }
+
+    ret = 0;
+    if (opts->verify) {
+        map_table = (uint64_t *)clEnqueueMapBuffer(env->command_queue, table, CL_TRUE,
+                                                   CL_MAP_READ | CL_MAP_WRITE, 0,
+                                                   words * sizeof(uint64_t), 0, NULL, NULL, &err);
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to read GUPS table %d\n", err);
+            ret = -1;
+            goto cleanup;
+        }
+        ret = gups_check(opts, map_table, words, updates, threads);
+        clEnqueueUnmapMemObject(env->command_queue, table, map_table, 0, NULL, NULL);
+        clFinish(env->command_queue);
+    }
+
+cleanup:
+    fpga_release_buffer(env, table);
+    fpga_release_kernel(env, kernel);
+    return ret;
+}
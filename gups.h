@@ -0,0 +1,34 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : gups.h
+Purpose             : HPCC RandomAccess (GUPS) read-modify-write update mode
+Revision History    : 2017.08.21
+******************************************************************************
+*/
+#ifndef GUPS_H
+#define GUPS_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+//value of the update stream after n steps from the start, HPCC_starts
+uint64_t gups_starts(int64_t n);
+
+/////////////////////////////////////////////////////////////////////////////////
+//cpu_run_gups / fpga_run_gups
+//Run opts->gups_updates updates (4 per table word when 0) of the HPCC stream
+//over a table of the largest power of two of 64-bit words that fits in
+//opts->buffer_size, initialised to table[i] = i, and report GUP/s. The check
+//applies the stream once more, which restores every word that saw all of its
+//updates, and counts the words that differ against opts->gups_tolerance
+//percent of the table. The CPU run splits the stream over opts->threads
+//threads without atomics, as HPCC allows.
+//Return value
+// 0    Success
+//-1    Allocation, thread or OpenCL failure
+//-2    More wrong table words than the tolerance allows
+int cpu_run_gups(const struct bench_options *opts);
+int fpga_run_gups(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
@@ -0,0 +1,252 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : host_alloc.cpp
+Purpose             : Pooled host buffers on huge pages, bound to a NUMA node
+                      and pre-faulted before use
+Revision History    : 2017.09.04
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "host_alloc.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT          26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB            (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB            (30 << MAP_HUGE_SHIFT)
+#endif
+//mbind policy of <numaif.h>, which needs libnuma headers
+#define HOST_MPOL_BIND          2
+
+//most buffers mapped at once
+#define HOST_MAX_BUFFERS        64
+
+struct host_buffer {
+    void            *ptr;
+    size_t          size;
+    int             pages;
+    int             node;
+    int             in_use;
+};
+
+static struct host_buffer host_pool[HOST_MAX_BUFFERS];
+static unsigned int host_mapped;
+static unsigned int host_reused;
+static pthread_mutex_t host_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *host_page_names[HOST_NUM_PAGES] = {
+    "4k", "thp", "2m", "1g"
+};
+
+const char *host_pages_name(int pages)
+{
+    return (pages >= 0 && pages < HOST_NUM_PAGES) ? host_page_names[pages] : "unknown";
+}
+
+int host_pages_parse(const char *name)
+{
+    for (int p=0; p<HOST_NUM_PAGES; p++) {
+        if (strcmp(name, host_page_names[p]) == 0)
+            return p;
+    }
+    return -1;
+}
+
+int host_device_node(void)
+{
+    const char *root = "/sys/bus/pci/devices";
+    char path[512], value[32];
+    struct dirent *entry;
+    int node = -1;
+    FILE *f;
+
+    DIR *dir = opendir(root);
+    if (dir == NULL)
+        return -1;
+    while (node < 0 && (entry = readdir(dir)) != NULL) {
+        snprintf(path, sizeof(path), "%s/%s/vendor", root, entry->d_name);
+        f = fopen(path, "r");
+        if (f == NULL)
+            continue;
+        int xilinx = (fgets(value, sizeof(value), f) != NULL) && (strtoul(value, NULL, 0) == 0x10ee);
+        fclose(f);
+        if (!xilinx)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s/numa_node", root, entry->d_name);
+        f = fopen(path, "r");
+        if (f == NULL)
+            continue;
+        if (fgets(value, sizeof(value), f) != NULL)
+            node = atoi(value);
+        fclose(f);
+    }
+    closedir(dir);
+    return node;
+}
+
+static size_t host_page_bytes(int pages)
+{
+    switch (pages) {
+    case HOST_PAGES_THP:
+    case HOST_PAGES_2M:
+        return 2UL << 20;
+    case HOST_PAGES_1G:
+        return 1UL << 30;
+    default:
+        return 4096;
+    }
+}
+
+//map size bytes of pages, *pages drops to thp when none are reserved
+static void *host_map(size_t size, int *pages)
+{
+    void *ptr = MAP_FAILED;
+
+    if (*pages == HOST_PAGES_2M || *pages == HOST_PAGES_1G) {
+        int huge = (*pages == HOST_PAGES_2M) ? MAP_HUGE_2MB : MAP_HUGE_1GB;
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | huge, -1, 0);
+        if (ptr != MAP_FAILED)
+            return ptr;
+        printf("Warning: no %s huge pages reserved for %zu bytes, using transparent huge pages\n",
+               host_pages_name(*pages), size);
+        *pages = HOST_PAGES_THP;
+    }
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+    if (*pages == HOST_PAGES_THP)
+        madvise(ptr, size, MADV_HUGEPAGE);
+    else
+        madvise(ptr, size, MADV_NOHUGEPAGE);
+    return ptr;
+}
+
+//free pooled buffers are unmapped with the lock held
+static void host_pool_drain_locked(void)
+{
+    for (unsigned int i=0; i<HOST_MAX_BUFFERS; i++) {
+        struct host_buffer *b = &host_pool[i];
+        if (b->ptr != NULL && !b->in_use) {
+            munmap(b->ptr, b->size);
+            memset(b, 0, sizeof(*b));
+        }
+    }
+}
+
+void *host_alloc(size_t size, int pages, int node)
+{
+    size_t page_bytes = host_page_bytes(pages);
+    size_t mapped = (size + page_bytes - 1) & ~(page_bytes - 1);
+    struct host_buffer *slot = NULL;
+    void *ptr;
+
+    if (node == HOST_NODE_DEVICE)
+        node = host_device_node();
+
+    pthread_mutex_lock(&host_pool_lock);
+    for (unsigned int i=0; i<HOST_MAX_BUFFERS; i++) {
+        struct host_buffer *b = &host_pool[i];
+        if (b->ptr != NULL && !b->in_use && b->size == mapped &&
+            b->pages == pages && b->node == node) {
+            b->in_use = 1;
+            host_reused++;
+            pthread_mutex_unlock(&host_pool_lock);
+            return b->ptr;
+        }
+    }
+    for (int pass=0; pass<2 && slot == NULL; pass++) {
+        if (pass == 1)
+            host_pool_drain_locked();
+        for (unsigned int i=0; i<HOST_MAX_BUFFERS && slot == NULL; i++) {
+            if (host_pool[i].ptr == NULL)
+                slot = &host_pool[i];
+        }
+    }
+    if (slot == NULL) {
+        pthread_mutex_unlock(&host_pool_lock);
+        printf("Error: more than %d host buffers in use\n", HOST_MAX_BUFFERS);
+        return NULL;
+    }
+
+    int mapped_pages = pages;
+    ptr = host_map(mapped, &mapped_pages);
+    if (ptr == NULL) {
+        //make room by dropping the free pooled buffers
+        host_pool_drain_locked();
+        mapped_pages = pages;
+        ptr = host_map(mapped, &mapped_pages);
+    }
+    if (ptr == NULL) {
+        pthread_mutex_unlock(&host_pool_lock);
+        return NULL;
+    }
+    if (node >= 0 && node < 64) {
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_mbind, ptr, mapped, HOST_MPOL_BIND, &mask, 64, 0) != 0)
+            printf("Warning: failed to bind host buffer to NUMA node %d\n", node);
+    }
+    //fault every page in now, on the bound node, so no run pays for it
+    for (size_t offset=0; offset<mapped; offset+=4096)
+        ((volatile unsigned char *)ptr)[offset] = 0;
+
+    //pooled under the requested kind so a fallback is not retried every time
+    slot->ptr = ptr;
+    slot->size = mapped;
+    slot->pages = pages;
+    slot->node = node;
+    slot->in_use = 1;
+    host_mapped++;
+    pthread_mutex_unlock(&host_pool_lock);
+    return ptr;
+}
+
+void host_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    pthread_mutex_lock(&host_pool_lock);
+    for (unsigned int i=0; i<HOST_MAX_BUFFERS; i++) {
+        if (host_pool[i].ptr == ptr) {
+            host_pool[i].in_use = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&host_pool_lock);
+}
+
+void host_pool_drain(void)
+{
+    pthread_mutex_lock(&host_pool_lock);
+    host_pool_drain_locked();
+    pthread_mutex_unlock(&host_pool_lock);
+}
+
+void host_pool_print(void)
+{
+    size_t bytes = 0;
+    unsigned int pooled = 0;
+
+    pthread_mutex_lock(&host_pool_lock);
+    for (unsigned int i=0; i<HOST_MAX_BUFFERS; i++) {
+        if (host_pool[i].ptr != NULL) {
+            bytes += host_pool[i].size;
+            pooled++;
+        }
+    }
+    pthread_mutex_unlock(&host_pool_lock);
+    printf("Host pool: %u buffers (%.1f MB) mapped, %u maps, %u reuses\n",
+           pooled, bytes / (((double)1024) * ((double)1024)), host_mapped, host_reused);
+}
@@ -0,0 +1,54 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : host_alloc.h
+Purpose             : Pooled host buffers on huge pages, bound to a NUMA node
+                      and pre-faulted before use
+Revision History    : 2017.09.04
+******************************************************************************
+*/
+#ifndef HOST_ALLOC_H
+#define HOST_ALLOC_H
+
+#include <stddef.h>
+
+//page kinds selectable with --huge-pages
+#define HOST_PAGES_4K           0
+#define HOST_PAGES_THP          1
+#define HOST_PAGES_2M           2
+#define HOST_PAGES_1G           3
+#define HOST_NUM_PAGES          4
+
+//--numa-node values besides a node number
+#define HOST_NODE_ANY           -1
+#define HOST_NODE_DEVICE        -2
+
+const char *host_pages_name(int pages);
+
+//HOST_PAGES_* of name, -1 when unknown
+int host_pages_parse(const char *name);
+
+//NUMA node of the first Xilinx PCIe device, -1 when unknown
+int host_device_node(void);
+
+/////////////////////////////////////////////////////////////////////////////////
+//host_alloc
+//A page aligned buffer of at least size bytes on pages of the given kind,
+//bound to node (HOST_NODE_ANY leaves placement to the kernel) and with every
+//page faulted in. A free pooled buffer of the same size, kind and node is
+//reused, its contents are left as the last user wrote them. When no 2 MB or
+//1 GB pages are reserved the buffer falls back to transparent huge pages.
+//Return value
+//  the buffer, NULL when out of memory
+void *host_alloc(size_t size, int pages, int node);
+
+//return a host_alloc buffer to the pool, NULL is ignored
+void host_free(void *ptr);
+
+//unmap the free pooled buffers
+void host_pool_drain(void);
+
+//buffers mapped and reused by the pool so far
+void host_pool_print(void);
+
+#endif
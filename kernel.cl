@@ -7,51 +7,815 @@ Revision History    : 2017.06.29
 Designer            :Gao Li
 ******************************************************************************
 */
+#include "access_pattern.h"
+
+/*
+ Random access copy kernel. One access copies a burst of (1 << burst_shift)
+ consecutive uint16 at the burst index given by the access pattern, the loop
+ runs over beats so every iteration moves exactly one uint16. The host places
+ the buffers of the (1 << pair_shift) pairs in use in DDR banks at run time,
+ port_mode replicates every access over the pairs or interleaves the units
+ across them (see access_pattern.h). Unused pairs are never touched.
+*/
 __kernel 
 __attribute__ ((reqd_work_group_size(1,1,1)))
 void bandwidth(
                __global uint16  * __restrict input0     , 
                __global uint16  * __restrict output0    ,               
-#ifdef USE_4DDR
                __global uint16  * __restrict input1     , 
                __global uint16  * __restrict output1    ,
-#endif
-               ulong num_blocks
+               __global uint16  * __restrict input2     , 
+               __global uint16  * __restrict output2    ,
+               __global uint16  * __restrict input3     , 
+               __global uint16  * __restrict output3    ,
+               ulong num_blocks ,
+               uint  burst_shift,
+               uint  pair_shift ,
+               uint  port_mode  ,
+               uint  pattern    ,
+               ulong seed       ,
+               ulong num_iters  ,
+               ulong param0     ,
+               ulong param1
                )
 {
 
+    ulong       beatindex        ;
     ulong       blockindex       ;
-    ulong       rand_addr_reg    ;
+    ulong       block            ;
     ulong       rand_addr        ;
-    ulong       num_blocks_2     ;
+    ulong       beat_mask        ;
+    uint        pairs            ;
 
     uint16      temp0            ;
     uint16      temp1            ;  
+    uint16      temp2            ;
+    uint16      temp3            ;
      
-    blockindex = 0               ;
-    num_blocks_2 =  10000        ;
+    beat_mask = (1UL << burst_shift) - 1 ;
+    __attribute__((xcl_pipeline_loop))
+    for (beatindex=0; beatindex<(num_iters << burst_shift); beatindex++)
+    {
+          blockindex = beatindex >> burst_shift ;
+          block      = ap_block_index(pattern, seed, blockindex, num_blocks, param0, param1) ;
+          pairs      = ap_pair_mask(port_mode, pair_shift, block) ;
+          rand_addr  = (ap_pair_unit(port_mode, pair_shift, block) << burst_shift)
+                       + (beatindex & beat_mask) ;
+
+          if (pairs & 1) {
+              temp0 = input0[rand_addr]       ;
+              output0[rand_addr] = temp0      ;
+          }
+          if (pairs & 2) {
+              temp1 = input1[rand_addr]       ;
+              output1[rand_addr] = temp1      ;
+          }
+          if (pairs & 4) {
+              temp2 = input2[rand_addr]       ;
+              output2[rand_addr] = temp2      ;
+          }
+          if (pairs & 8) {
+              temp3 = input3[rand_addr]       ;
+              output3[rand_addr] = temp3      ;
+          }
+    }
+}
+
+
+
+
+#ifdef BW_CACHE_LINES
+#ifndef BW_CACHE_WAYS
+#define BW_CACHE_WAYS           1
+#endif
+#define BW_CACHE_SETS           (BW_CACHE_LINES / BW_CACHE_WAYS)
+
+/*
+ Cached variant of bandwidth, built only when the kernel is compiled with
+ -DBW_CACHE_LINES=<n> (and optionally -DBW_CACHE_WAYS=<w>, default direct
+ mapped). A set associative cache of uint16 lines sits in front of pair 0,
+ a hit serves the beat from on-chip memory and folds the output write into
+ the dirty line, a miss reads DDR and writes back the round robin victim of
+ its set. Repeated blocks, such as the legacy pattern fallback to block 0 or
+ a hot set, therefore cost one DDR read and one DDR write per residency. The
+ dirty lines are flushed at the end and the counters written to stats (see
+ access_pattern.h).
+*/
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_cached(
+               __global uint16  * __restrict input0     , 
+               __global uint16  * __restrict output0    ,               
+               __global ulong   * __restrict stats      ,
+               ulong num_blocks ,
+               uint  burst_shift,
+               uint  pattern    ,
+               ulong seed       ,
+               ulong num_iters  ,
+               ulong param0     ,
+               ulong param1
+               )
+{
+
+    ulong       beatindex        ;
+    ulong       blockindex       ;
+    ulong       block            ;
+    ulong       rand_addr        ;
+    ulong       beat_mask        ;
+    ulong       set              ;
+    uint        way              ;
+    uint        hit              ;
+    uint        w                ;
+
+    ulong       hits             ;
+    ulong       misses           ;
+    ulong       evictions        ;
+    ulong       flushed          ;
+
+    //tags hold the beat address + 1, 0 marks an empty line
+    uint16      line_data[BW_CACHE_SETS][BW_CACHE_WAYS] __attribute__((xcl_array_partition(complete, 2)));
+    ulong       line_tag[BW_CACHE_SETS][BW_CACHE_WAYS]  __attribute__((xcl_array_partition(complete, 2)));
+    uint        victim[BW_CACHE_SETS]    ;
+
+    for (set=0; set<BW_CACHE_SETS; set++)
+    {
+          victim[set] = 0 ;
+          __attribute__((opencl_unroll_hint))
+          for (w=0; w<BW_CACHE_WAYS; w++)
+              line_tag[set][w] = 0 ;
+    }
+    hits      = 0 ;
+    misses    = 0 ;
+    evictions = 0 ;
+    flushed   = 0 ;
+
+    beat_mask = (1UL << burst_shift) - 1 ;
+    __attribute__((xcl_pipeline_loop))
+    for (beatindex=0; beatindex<(num_iters << burst_shift); beatindex++)
+    {
+          blockindex = beatindex >> burst_shift ;
+          block      = ap_block_index(pattern, seed, blockindex, num_blocks, param0, param1) ;
+          rand_addr  = (block << burst_shift) + (beatindex & beat_mask) ;
+          set        = rand_addr % BW_CACHE_SETS ;
+
+          hit = 0 ;
+          way = 0 ;
+          __attribute__((opencl_unroll_hint))
+          for (w=0; w<BW_CACHE_WAYS; w++) {
+              if (line_tag[set][w] == rand_addr + 1) {
+                  hit = 1 ;
+                  way = w ;
+              }
+          }
+
+          if (hit) {
+              hits++ ;
+          } else {
+              way = victim[set] ;
+              victim[set] = (way + 1 == BW_CACHE_WAYS) ? 0 : way + 1 ;
+              if (line_tag[set][way] != 0) {
+                  output0[line_tag[set][way] - 1] = line_data[set][way] ;
+                  evictions++ ;
+              }
+              line_data[set][way] = input0[rand_addr] ;
+              line_tag[set][way]  = rand_addr + 1     ;
+              misses++ ;
+          }
+    }
+
+    for (set=0; set<BW_CACHE_SETS; set++)
+    {
+          for (w=0; w<BW_CACHE_WAYS; w++) {
+              if (line_tag[set][w] != 0) {
+                  output0[line_tag[set][w] - 1] = line_data[set][w] ;
+                  flushed++ ;
+              }
+          }
+    }
+
+    stats[AP_CACHE_HITS]      = hits           ;
+    stats[AP_CACHE_MISSES]    = misses         ;
+    stats[AP_CACHE_EVICTIONS] = evictions      ;
+    stats[AP_CACHE_FLUSHED]   = flushed        ;
+    stats[AP_CACHE_LINES]     = BW_CACHE_LINES ;
+    stats[AP_CACHE_WAYS]      = BW_CACHE_WAYS  ;
+}
+#endif
+
+
+
+
+#ifdef BW_STATS
+/*
+ Instrumented variant of bandwidth, built only when the kernel is compiled
+ with -DBW_STATS. bandwidth_clock counts the cycles of its own pipelined loop
+ and answers every request of bandwidth_stats with the current count, so the
+ copy loop is timed on the device from its first to its last beat, without
+ the launch overhead of the event profile. The clock gives up after
+ max_cycles ticks, so a bandwidth_stats that never starts can't leave it
+ spinning. The copy loop also counts its
+ beats, the accesses the legacy pattern folded to block 0 and the bytes of
+ every pair, and writes them to stats (see access_pattern.h). Under sw_emu
+ the clock ticks once per iteration of the emulated loop.
+*/
+pipe ulong  bw_clock_req  __attribute__((xcl_reqd_pipe_depth(16)));
+pipe ulong  bw_clock_time __attribute__((xcl_reqd_pipe_depth(16)));
+
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_clock(
+               ulong max_cycles
+               )
+{
+
+    ulong       cycles           ;
+    ulong       req              ;
+
+    cycles = 0 ;
+    req    = AP_CLOCK_SAMPLE ;
+    __attribute__((xcl_pipeline_loop))
+    while (req != AP_CLOCK_STOP && cycles < max_cycles)
+    {
+          if (read_pipe(bw_clock_req, &req) == 0 && req == AP_CLOCK_SAMPLE)
+              write_pipe_block(bw_clock_time, &cycles) ;
+          cycles++ ;
+    }
+}
+
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_stats(
+               __global uint16  * __restrict input0     , 
+               __global uint16  * __restrict output0    ,               
+               __global uint16  * __restrict input1     , 
+               __global uint16  * __restrict output1    ,
+               __global uint16  * __restrict input2     , 
+               __global uint16  * __restrict output2    ,
+               __global uint16  * __restrict input3     , 
+               __global uint16  * __restrict output3    ,
+               __global ulong   * __restrict stats      ,
+               ulong num_blocks ,
+               uint  burst_shift,
+               uint  pair_shift ,
+               uint  port_mode  ,
+               uint  pattern    ,
+               ulong seed       ,
+               ulong num_iters  ,
+               ulong param0     ,
+               ulong param1
+               )
+{
+
+    ulong       beatindex        ;
+    ulong       blockindex       ;
+    ulong       block            ;
+    ulong       rand_addr        ;
+    ulong       beat_mask        ;
+    uint        pairs            ;
+    ulong       req              ;
+    ulong       start            ;
+    ulong       end              ;
+    ulong       beats            ;
+    ulong       folded           ;
+    ulong       pair_beats0      ;
+    ulong       pair_beats1      ;
+    ulong       pair_beats2      ;
+    ulong       pair_beats3      ;
+
+    uint16      temp0            ;
+    uint16      temp1            ;  
+    uint16      temp2            ;
+    uint16      temp3            ;
+
+    beats       = 0 ;
+    folded      = 0 ;
+    pair_beats0 = 0 ;
+    pair_beats1 = 0 ;
+    pair_beats2 = 0 ;
+    pair_beats3 = 0 ;
+
+    req = AP_CLOCK_SAMPLE ;
+    write_pipe_block(bw_clock_req, &req) ;
+    read_pipe_block(bw_clock_time, &start) ;
+
+    beat_mask = (1UL << burst_shift) - 1 ;
+    __attribute__((xcl_pipeline_loop))
+    for (beatindex=0; beatindex<(num_iters << burst_shift); beatindex++)
+    {
+          blockindex = beatindex >> burst_shift ;
+          block      = ap_block_index(pattern, seed, blockindex, num_blocks, param0, param1) ;
+          pairs      = ap_pair_mask(port_mode, pair_shift, block) ;
+          rand_addr  = (ap_pair_unit(port_mode, pair_shift, block) << burst_shift)
+                       + (beatindex & beat_mask) ;
+
+          beats++ ;
+          if ((beatindex & beat_mask) == 0)
+              folded += ap_block_folded(pattern, blockindex, num_blocks) ;
+          if (pairs & 1) {
+              temp0 = input0[rand_addr]       ;
+              output0[rand_addr] = temp0      ;
+              pair_beats0++                   ;
+          }
+          if (pairs & 2) {
+              temp1 = input1[rand_addr]       ;
+              output1[rand_addr] = temp1      ;
+              pair_beats1++                   ;
+          }
+          if (pairs & 4) {
+              temp2 = input2[rand_addr]       ;
+              output2[rand_addr] = temp2      ;
+              pair_beats2++                   ;
+          }
+          if (pairs & 8) {
+              temp3 = input3[rand_addr]       ;
+              output3[rand_addr] = temp3      ;
+              pair_beats3++                   ;
+          }
+    }
+
+    write_pipe_block(bw_clock_req, &req) ;
+    read_pipe_block(bw_clock_time, &end) ;
+    req = AP_CLOCK_STOP ;
+    write_pipe_block(bw_clock_req, &req) ;
+
+    stats[AP_STATS_CYCLES]         = end - start ;
+    stats[AP_STATS_BEATS]          = beats ;
+    stats[AP_STATS_IN_RANGE]       = num_iters - folded ;
+    stats[AP_STATS_FALLBACK]       = folded ;
+    stats[AP_STATS_PAIR_BYTES + 0] = pair_beats0 * AP_BLOCK_BYTES ;
+    stats[AP_STATS_PAIR_BYTES + 1] = pair_beats1 * AP_BLOCK_BYTES ;
+    stats[AP_STATS_PAIR_BYTES + 2] = pair_beats2 * AP_BLOCK_BYTES ;
+    stats[AP_STATS_PAIR_BYTES + 3] = pair_beats3 * AP_BLOCK_BYTES ;
+}
+#endif
+
+
+
+
+/*
+ Dataflow variant of bandwidth, three kernels run concurrently and connected
+ by pipes. bandwidth_addr generates the beat addresses of the access pattern,
+ bandwidth_load reads them from input0 and bandwidth_store writes the data
+ to output0. The store stage returns a credit per completed beat and the
+ address stage stops issuing while max_outstanding beats are in flight, so
+ the host can vary the memory level parallelism at run time up to the pipe
+ depth. The address stage collects the last credits before it returns, which
+ leaves every pipe empty for the next launch.
+*/
+pipe ulong  df_load_addr  __attribute__((xcl_reqd_pipe_depth(AP_DATAFLOW_DEPTH)));
+pipe ulong  df_store_addr __attribute__((xcl_reqd_pipe_depth(AP_DATAFLOW_DEPTH)));
+pipe uint16 df_data       __attribute__((xcl_reqd_pipe_depth(AP_DATAFLOW_DEPTH)));
+pipe uint   df_credit     __attribute__((xcl_reqd_pipe_depth(AP_DATAFLOW_DEPTH)));
+
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_addr(
+               ulong num_blocks ,
+               uint  burst_shift,
+               uint  pattern    ,
+               ulong seed       ,
+               ulong num_iters  ,
+               ulong param0     ,
+               ulong param1     ,
+               uint  max_outstanding
+               )
+{
+
+    ulong       beatindex        ;
+    ulong       blockindex       ;
+    ulong       block            ;
+    ulong       rand_addr        ;
+    ulong       beat_mask        ;
+    uint        inflight         ;
+    uint        credit           ;
+
+    if (max_outstanding < 1)
+        max_outstanding = 1 ;
+    if (max_outstanding > AP_DATAFLOW_DEPTH)
+        max_outstanding = AP_DATAFLOW_DEPTH ;
+
+    inflight  = 0 ;
+    beat_mask = (1UL << burst_shift) - 1 ;
+    __attribute__((xcl_pipeline_loop))
+    for (beatindex=0; beatindex<(num_iters << burst_shift); beatindex++)
+    {
+          blockindex = beatindex >> burst_shift ;
+          block      = ap_block_index(pattern, seed, blockindex, num_blocks, param0, param1) ;
+          rand_addr  = (block << burst_shift) + (beatindex & beat_mask) ;
+
+          if (inflight == max_outstanding) {
+              read_pipe_block(df_credit, &credit) ;
+              inflight-- ;
+          }
+          write_pipe_block(df_load_addr, &rand_addr) ;
+          inflight++ ;
+    }
+    for (; inflight>0; inflight--)
+          read_pipe_block(df_credit, &credit) ;
+}
+
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_load(
+               __global uint16  * __restrict input0     , 
+               ulong num_beats
+               )
+{
+
+    ulong       beatindex        ;
+    ulong       rand_addr        ;
+
+    uint16      temp0            ;
+
+    __attribute__((xcl_pipeline_loop))
+    for (beatindex=0; beatindex<num_beats; beatindex++)
+    {
+          read_pipe_block(df_load_addr, &rand_addr) ;
+          temp0 = input0[rand_addr]               ;
+          write_pipe_block(df_data, &temp0)       ;
+          write_pipe_block(df_store_addr, &rand_addr) ;
+    }
+}
+
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_store(
+               __global uint16  * __restrict output0    , 
+               ulong num_beats
+               )
+{
+
+    ulong       beatindex        ;
+    ulong       rand_addr        ;
+    uint        credit           ;
+
+    uint16      temp0            ;
+
+    credit = 1 ;
     __attribute__((xcl_pipeline_loop))
-    for (blockindex=0; blockindex<num_blocks_2; blockindex++)
+    for (beatindex=0; beatindex<num_beats; beatindex++)
     {
-    	  rand_addr_reg = (blockindex*101 + 12345)%32768          ;
+          read_pipe_block(df_store_addr, &rand_addr) ;
+          read_pipe_block(df_data, &temp0)         ;
+          output0[rand_addr] = temp0               ;
+          write_pipe_block(df_credit, &credit)     ;
+    }
+}
+
+
+
 
-    	  if((rand_addr_reg<num_blocks)&&(rand_addr_reg>0))
-    	  {
-    		  rand_addr = rand_addr_reg          ;
-    	   }
-    	  else
-    	  {
-    		  rand_addr = 0                      ;
-    	  }
+/*
+ Multi unit variant of bandwidth. The host builds the xclbin with several
+ compute units of it and starts one task per unit with unit_base set, or
+ starts num_units work items of one unit with unit_base 0. Every unit copies
+ through its own pair and slice or seed (see access_pattern.h), so the units
+ are independent requesters and need no synchronisation.
+*/
+__kernel 
+void bandwidth_unit(
+               __global uint16  * __restrict input0     , 
+               __global uint16  * __restrict output0    ,               
+               __global uint16  * __restrict input1     , 
+               __global uint16  * __restrict output1    ,
+               __global uint16  * __restrict input2     , 
+               __global uint16  * __restrict output2    ,
+               __global uint16  * __restrict input3     , 
+               __global uint16  * __restrict output3    ,
+               ulong num_blocks ,
+               uint  burst_shift,
+               uint  pair_shift ,
+               uint  partition  ,
+               uint  pattern    ,
+               ulong seed       ,
+               ulong num_iters  ,
+               ulong param0     ,
+               ulong param1     ,
+               uint  unit_base  ,
+               uint  num_units
+               )
+{
+
+    ulong       beatindex        ;
+    ulong       blockindex       ;
+    ulong       block            ;
+    ulong       rand_addr        ;
+    ulong       beat_mask        ;
+    ulong       slice_start      ;
+    ulong       slice_blocks     ;
+    ulong       stream_seed      ;
+    uint        unit             ;
+    uint        pair             ;
 
-          temp0 = input0[rand_addr]           ;
-          output0[rand_addr] = temp0          ;
+    uint16      temp0            ;
+    uint16      temp1            ;  
+    uint16      temp2            ;
+    uint16      temp3            ;
+
+    unit = unit_base + get_global_id(0) ;
+    pair = ap_unit_pair(pair_shift, unit) ;
+    if (partition == AP_PARTITION_SEED) {
+        slice_start  = 0 ;
+        slice_blocks = num_blocks ;
+        stream_seed  = ap_unit_seed(seed, unit) ;
+    } else {
+        slice_start  = ap_unit_slice_start(num_blocks, pair_shift, unit, num_units) ;
+        slice_blocks = ap_unit_slice_blocks(num_blocks, pair_shift, unit, num_units) ;
+        stream_seed  = seed ;
+    }
 
-          #ifdef USE_4DDR
+    beat_mask = (1UL << burst_shift) - 1 ;
+    __attribute__((xcl_pipeline_loop))
+    for (beatindex=0; beatindex<(num_iters << burst_shift); beatindex++)
+    {
+          blockindex = beatindex >> burst_shift ;
+          block      = slice_start + ap_block_index(pattern, stream_seed, blockindex, slice_blocks, param0, param1) ;
+          rand_addr  = (block << burst_shift) + (beatindex & beat_mask) ;
+
+          if (pair == 0) {
+              temp0 = input0[rand_addr]       ;
+              output0[rand_addr] = temp0      ;
+          }
+          if (pair == 1) {
               temp1 = input1[rand_addr]       ;
               output1[rand_addr] = temp1      ;
-          #endif        
+          }
+          if (pair == 2) {
+              temp2 = input2[rand_addr]       ;
+              output2[rand_addr] = temp2      ;
+          }
+          if (pair == 3) {
+              temp3 = input3[rand_addr]       ;
+              output3[rand_addr] = temp3      ;
+          }
     }
 }
 
 
+
+
+/*
+ Narrow access variant of bandwidth for accesses below 64 bytes. One access
+ copies (1 << word_shift) consecutive uint, one uint per loop iteration.
+*/
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_narrow(
+               __global uint    * __restrict input0     , 
+               __global uint    * __restrict output0    ,               
+               __global uint    * __restrict input1     , 
+               __global uint    * __restrict output1    ,
+               __global uint    * __restrict input2     , 
+               __global uint    * __restrict output2    ,
+               __global uint    * __restrict input3     , 
+               __global uint    * __restrict output3    ,
+               ulong num_units  ,
+               uint  word_shift ,
+               uint  pair_shift ,
+               uint  port_mode  ,
+               uint  pattern    ,
+               ulong seed       ,
+               ulong num_iters  ,
+               ulong param0     ,
+               ulong param1
+               )
+{
+
+    ulong       wordindex        ;
+    ulong       unitindex        ;
+    ulong       unit             ;
+    ulong       rand_addr        ;
+    ulong       word_mask        ;
+    uint        pairs            ;
+
+    uint        temp0            ;
+    uint        temp1            ;  
+    uint        temp2            ;
+    uint        temp3            ;
+     
+    word_mask = (1UL << word_shift) - 1 ;
+    __attribute__((xcl_pipeline_loop))
+    for (wordindex=0; wordindex<(num_iters << word_shift); wordindex++)
+    {
+          unitindex = wordindex >> word_shift ;
+          unit      = ap_block_index(pattern, seed, unitindex, num_units, param0, param1) ;
+          pairs     = ap_pair_mask(port_mode, pair_shift, unit) ;
+          rand_addr = (ap_pair_unit(port_mode, pair_shift, unit) << word_shift)
+                      + (wordindex & word_mask) ;
+
+          if (pairs & 1) {
+              temp0 = input0[rand_addr]       ;
+              output0[rand_addr] = temp0      ;
+          }
+          if (pairs & 2) {
+              temp1 = input1[rand_addr]       ;
+              output1[rand_addr] = temp1      ;
+          }
+          if (pairs & 4) {
+              temp2 = input2[rand_addr]       ;
+              output2[rand_addr] = temp2      ;
+          }
+          if (pairs & 8) {
+              temp3 = input3[rand_addr]       ;
+              output3[rand_addr] = temp3      ;
+          }
+    }
+}
+
+
+/*
+ Trace replay variant of bandwidth. The block of every access comes from the
+ index buffer filled by the host from a trace file, the entry flags select a
+ copy, a read folded into the checksum or a write of the block index (see
+ access_pattern.h). The host streams the trace in windows of num_entries and
+ reads the checksum of each window from result.
+*/
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_trace(
+               __global uint16  * __restrict input0     , 
+               __global uint16  * __restrict output0    ,               
+               __global uint16  * __restrict input1     , 
+               __global uint16  * __restrict output1    ,
+               __global uint16  * __restrict input2     , 
+               __global uint16  * __restrict output2    ,
+               __global uint16  * __restrict input3     , 
+               __global uint16  * __restrict output3    ,
+               __global ulong   * __restrict index      ,
+               __global uint16  * __restrict result     ,
+               ulong num_entries,
+               ulong num_blocks ,
+               uint  pair_shift ,
+               uint  port_mode
+               )
+{
+
+    ulong       entryindex       ;
+    ulong       entry            ;
+    ulong       block            ;
+    ulong       rand_addr        ;
+    uint        pairs            ;
+    uint        op               ;
+
+    uint16      temp0            ;
+    uint16      temp1            ;  
+    uint16      temp2            ;
+    uint16      temp3            ;
+    uint16      fill             ;
+    uint16      sum              ;
+
+    sum = (uint16)(0) ;
+    __attribute__((xcl_pipeline_loop))
+    for (entryindex=0; entryindex<num_entries; entryindex++)
+    {
+          entry     = index[entryindex] ;
+          op        = ap_trace_op(entry) ;
+          block     = ap_trace_block(entry, num_blocks) ;
+          pairs     = ap_pair_mask(port_mode, pair_shift, block) ;
+          rand_addr = ap_pair_unit(port_mode, pair_shift, block) ;
+          fill      = (uint16)((uint)block) ;
+
+          if (pairs & 1) {
+              temp0 = (op == AP_TRACE_WRITE) ? fill : input0[rand_addr] ;
+              if (op == AP_TRACE_READ)
+                  sum += temp0                ;
+              else
+                  output0[rand_addr] = temp0  ;
+          }
+          if (pairs & 2) {
+              temp1 = (op == AP_TRACE_WRITE) ? fill : input1[rand_addr] ;
+              if (op == AP_TRACE_READ)
+                  sum += temp1                ;
+              else
+                  output1[rand_addr] = temp1  ;
+          }
+          if (pairs & 4) {
+              temp2 = (op == AP_TRACE_WRITE) ? fill : input2[rand_addr] ;
+              if (op == AP_TRACE_READ)
+                  sum += temp2                ;
+              else
+                  output2[rand_addr] = temp2  ;
+          }
+          if (pairs & 8) {
+              temp3 = (op == AP_TRACE_WRITE) ? fill : input3[rand_addr] ;
+              if (op == AP_TRACE_READ)
+                  sum += temp3                ;
+              else
+                  output3[rand_addr] = temp3  ;
+          }
+    }
+    result[0] = sum              ;
+}
+
+
+
+/*
+ Batched lookup kernel. Entry i of index (same format as the trace entries,
+ the operation bits are ignored) names a block, which is read from the first
+ pair holding it and written to results[i]. The host may hand the batch in
+ any order and put the results back in request order itself.
+*/
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void bandwidth_lookup(
+               __global uint16  * __restrict input0     , 
+               __global uint16  * __restrict output0    ,               
+               __global uint16  * __restrict input1     , 
+               __global uint16  * __restrict output1    ,
+               __global uint16  * __restrict input2     , 
+               __global uint16  * __restrict output2    ,
+               __global uint16  * __restrict input3     , 
+               __global uint16  * __restrict output3    ,
+               __global ulong   * __restrict index      ,
+               __global uint16  * __restrict results    ,
+               ulong num_entries,
+               ulong num_blocks ,
+               uint  pair_shift ,
+               uint  port_mode
+               )
+{
+
+    ulong       entryindex       ;
+    ulong       block            ;
+    ulong       rand_addr        ;
+    uint        pairs            ;
+
+    uint16      value            ;
+
+    __attribute__((xcl_pipeline_loop))
+    for (entryindex=0; entryindex<num_entries; entryindex++)
+    {
+          block     = ap_trace_block(index[entryindex], num_blocks) ;
+          pairs     = ap_pair_mask(port_mode, pair_shift, block) ;
+          rand_addr = ap_pair_unit(port_mode, pair_shift, block) ;
+
+          if (pairs & 1)
+              value = input0[rand_addr] ;
+          else if (pairs & 2)
+              value = input1[rand_addr] ;
+          else if (pairs & 4)
+              value = input2[rand_addr] ;
+          else
+              value = input3[rand_addr] ;
+          results[entryindex] = value   ;
+    }
+}
+
+
+/*
+ HPCC RandomAccess (GUPS) kernel. Every update advances the polynomial stream
+ of access_pattern.h and xors the value into the table word it selects, an in
+ place read-modify-write of global memory. Updates in flight in the pipeline
+ may hit the same word, the host check tolerates the few that get lost.
+*/
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void gups(
+          __global ulong   * __restrict table      ,
+          ulong table_mask ,
+          ulong ran        ,
+          ulong num_updates
+          )
+{
+
+    ulong       update           ;
+    ulong       addr             ;
+
+    __attribute__((xcl_pipeline_loop))
+    for (update=0; update<num_updates; update++)
+    {
+          ran   = ap_gups_next(ran)           ;
+          addr  = ran & table_mask            ;
+          table[addr] ^= ran                  ;
+    }
+}
+
+
+/*
+ Pointer chasing kernel for the latency mode. The host links every 64 byte
+ block into one random cycle, the first ulong of a block holds the index of
+ the next one, so each load depends on the previous one.
+*/
+__kernel 
+__attribute__ ((reqd_work_group_size(1,1,1)))
+void latency(
+             __global ulong8  * __restrict chain      ,
+             __global ulong   * __restrict result     ,
+             ulong start      ,
+             ulong num_hops
+             )
+{
+
+    ulong       hop              ;
+    ulong       block            ;
+
+    ulong8      temp             ;
+
+    block = start                ;
+    for (hop=0; hop<num_hops; hop++)
+    {
+          temp  = chain[block]                ;
+          block = temp.s0                     ;
+    }
+    result[0] = block            ;
+}
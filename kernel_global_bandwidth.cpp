@@ -49,432 +49,1477 @@ ALL TIMES.
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <getopt.h>
 #include <CL/opencl.h>
 #include <CL/cl_ext.h>
 
+#include "bench.h"
+#include "cpu_backend.h"
+#include "fpga_backend.h"
+#include "latency.h"
+#include "sweep.h"
+#include "fill.h"
+#include "verify.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "gups.h"
+#include "dataflow.h"
+#include "session.h"
+#include "multi_device.h"
+#include "transfer.h"
+#include "host_alloc.h"
+#include "contention.h"
+#include "steady.h"
+#include "lookup.h"
+#include "dram_order.h"
+
 /////////////////////////////////////////////////////////////////////////////////
-//load_file_to_memory
-//Allocated memory for and load file from disk memory
-//Return value 
-// 0   Success
-//-1   Failure to open file
-//-2   Failure to allocate memory
-
-
-//#define USE_4DDR
-
-
-int load_file_to_memory(const char *filename, char **result,size_t *inputsize)
-{ 
-    int size = 0;
-    FILE *f = fopen(filename, "rb");
-    if (f == NULL) { 
-        *result = NULL;
-        return -1; // -1 means file opening fail 
-    } 
-    fseek(f, 0, SEEK_END);
-    size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    *result = (char *)malloc(size+1);
-    if (size != fread(*result, sizeof(char), size, f)) 
-        { 
-            free(*result);
-            return -2; // -2 means file reading fail 
-        } 
-    fclose(f);
-    (*result)[size] = 0;
-    if(inputsize!=NULL) (*inputsize)=size;
-    return 0;
+//fpga_create_buffer
+//Create a read/write buffer of size bytes, in DDR bank 0 on multi-DDR cards
+cl_mem fpga_create_buffer(struct fpga_env *env, size_t size, cl_int *err)
+{
+    return fpga_create_bank_buffer(env, size, 0, err);
+}
+
+//Create a read/write buffer of size bytes in DDR bank bank on multi-DDR
+//cards, single DDR cards ignore bank
+static cl_mem fpga_new_bank_buffer(struct fpga_env *env, size_t size, unsigned int bank, cl_int *err)
+{
+    static const unsigned int bank_flags[MAX_BANKS] = {
+        XCL_MEM_DDR_BANK0, XCL_MEM_DDR_BANK1, XCL_MEM_DDR_BANK2, XCL_MEM_DDR_BANK3
+    };
+
+    if (env->max_alloc > 0 && size > env->max_alloc) {
+        printf("Error: %zu byte buffer exceeds the %llu byte device allocation limit\n",
+               size, (unsigned long long)env->max_alloc);
+        *err = CL_INVALID_BUFFER_SIZE;
+        return NULL;
+    }
+    if (env->num_banks <= 1)
+        return clCreateBuffer(env->context, CL_MEM_READ_WRITE, size, NULL, err);
+
+    cl_mem_ext_ptr_t buffer_ext;
+    buffer_ext.flags = bank_flags[bank % MAX_BANKS];
+    buffer_ext.obj = NULL;
+    buffer_ext.param = 0;
+    return clCreateBuffer(env->context,
+                          CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX,
+                          size,
+                          &buffer_ext,
+                          err);
+}
+
+//Take a free buffer of the size and bank from the session pool, or create
+//one. When the device is full the free pooled buffers are dropped and the
+//creation retried once.
+cl_mem fpga_take_bank_buffer(struct fpga_env *env, size_t size, unsigned int bank,
+                             int *filled, cl_int *err)
+{
+    cl_mem mem;
+
+    *filled = 0;
+    if (env->session == NULL)
+        return fpga_new_bank_buffer(env, size, bank, err);
+    mem = session_take_buffer(env->session, size, bank, filled);
+    if (mem != NULL) {
+        *err = CL_SUCCESS;
+        return mem;
+    }
+    mem = fpga_new_bank_buffer(env, size, bank, err);
+    if (*err != CL_SUCCESS) {
+        session_trim_buffers(env->session);
+        mem = fpga_new_bank_buffer(env, size, bank, err);
+    }
+    if (*err == CL_SUCCESS)
+        session_add_buffer(env->session, mem, size, bank);
+    return mem;
+}
+
+cl_mem fpga_create_bank_buffer(struct fpga_env *env, size_t size, unsigned int bank, cl_int *err)
+{
+    int filled;
+    return fpga_take_bank_buffer(env, size, bank, &filled, err);
+}
+
+void fpga_mark_filled(struct fpga_env *env, cl_mem mem)
+{
+    if (env->session != NULL)
+        session_mark_filled(env->session, mem);
+}
+
+void fpga_release_buffer(struct fpga_env *env, cl_mem mem)
+{
+    if (mem == NULL)
+        return;
+    if (env == NULL || env->session == NULL || session_give_buffer(env->session, mem) != 0)
+        clReleaseMemObject(mem);
+}
+
+cl_kernel fpga_create_kernel(struct fpga_env *env, const char *name, cl_int *err)
+{
+    if (env->session != NULL)
+        return session_kernel(env->session, name, err);
+    return clCreateKernel(env->program, name, err);
+}
+
+void fpga_release_kernel(struct fpga_env *env, cl_kernel kernel)
+{
+    if (kernel == NULL)
+        return;
+    if (env == NULL || env->session == NULL || session_give_kernel(env->session, kernel) != 0)
+        clReleaseKernel(kernel);
+}
+
+void fpga_note_kernel(struct fpga_env *env, double seconds)
+{
+    if (env->session != NULL)
+        session_note_kernel(env->session, seconds);
+}
+
+double event_seconds(cl_event event)
+{
+    uint64_t nstimestart, nstimeend;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(uint64_t), ((void *)(&nstimestart)), NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,   sizeof(uint64_t), ((void *)(&nstimeend)),   NULL);
+    return ((double)(nstimeend-nstimestart)) / ((double) 1000000000);
+}
+
+double events_span(const cl_event *events, unsigned int count)
+{
+    uint64_t start = 0, end = 0;
+
+    for (unsigned int i=0; i<count; i++) {
+        uint64_t nstimestart, nstimeend;
+        clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(uint64_t), ((void *)(&nstimestart)), NULL);
+        clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END,   sizeof(uint64_t), ((void *)(&nstimeend)),   NULL);
+        if (i == 0 || nstimestart < start)
+            start = nstimestart;
+        if (i == 0 || nstimeend > end)
+            end = nstimeend;
+    }
+    return ((double)(end-start)) / ((double) 1000000000);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////
+//print_usage
+
+void print_usage(const char *exe)
+{
+    printf("Usage: %s [options] <xclbin_file>\n", exe);
+    printf("  -b, --backend <name>     fpga|cpu, cpu runs on the host and needs no xclbin (default fpga)\n");
+    printf("  -M, --mode <name>        bandwidth|latency|sweep|pipeline|trace|gups|dataflow|units|devices|transfer|hostmem|contention|steady|lookup (default bandwidth)\n");
+    printf("  -t, --threads <n>        cpu backend worker threads (default all cpus)\n");
+    printf("      --buffer-size <n>    bytes per buffer, K/M/G suffix allowed (default 1G, 1M in emulation)\n");
+    printf("  -w, --access-bytes <n>   bytes per access, power of two, 4..63 narrow, 64 and up bursts (default 64)\n");
+    printf("      --banks <n>          DDR banks of the card, 1, 2 or 4 (default 1)\n");
+    printf("      --placement <name>   same|split|interleave buffers over the banks (default split)\n");
+    printf("      --tile-size <n>      largest device buffer, bigger buffers are tiled (default the device limit)\n");
+    printf("      --cache              run bandwidth through the on-chip cache of an xclbin built with BW_CACHE_LINES\n");
+    printf("      --stats              run bandwidth through the cycle counted kernel of an xclbin built with BW_STATS\n");
+    printf("      --huge-pages <kind>  4k|thp|2m|1g pages of the host buffers (default 4k)\n");
+    printf("      --numa-node <n>      any|device|<node> the host buffers are bound to (default any)\n");
+    printf("      --runs <n>           runs of the mode over one device session, fpga only (default 1)\n");
+    printf("      --no-verify          skip the result check\n");
+    printf("      --verify-report <n>  mismatches listed by the result check (default 10)\n");
+    printf("  -p, --pattern <name>     legacy|uniform|stride|sequential|hotset|blocked (default uniform)\n");
+    printf("  -s, --seed <n>           seed of the address stream (default 1)\n");
+    printf("  -n, --iterations <n>     number of block accesses (default 10000)\n");
+    printf("      --stride <blocks>    stride pattern step (default 1)\n");
+    printf("      --hot-blocks <n>     hotset pattern hot set size (default 1024)\n");
+    printf("      --hot-percent <p>    hotset pattern share of accesses to the hot set (default 90)\n");
+    printf("      --run-blocks <n>     blocked pattern run length (default 16)\n");
+    printf("latency mode chases -n hops through a random cycle over the buffer\n");
+    printf("      --samples <n>        device launches the hops are split into, 1000 for p99.9 (default 100)\n");
+    printf("      --histogram          print the latency histogram buckets\n");
+    printf("sweep mode runs bandwidth over every buffer size and access width\n");
+    printf("      --sizes <list>       MIN:MAX doubling or comma list, K/M/G allowed (default 4K:buffer size)\n");
+    printf("      --widths <list>      MIN:MAX doubling or comma list of access bytes (default -w)\n");
+    printf("      --warmup <n>         unmeasured launches per point (default 1)\n");
+    printf("      --reps <n>           measured launches per point (default 5)\n");
+    printf("      --format <name>      csv|json (default csv)\n");
+    printf("  -o, --output <file>      write sweep rows to file instead of stdout\n");
+    printf("pipeline mode streams a --buffer-size dataset through the device in chunks (fpga only)\n");
+    printf("      --chunk-size <n>     bytes per chunk, K/M/G suffix allowed (default 1/16 of the dataset)\n");
+    printf("      --pipeline-depth <n> device buffer slots chunks rotate through, 2..%d (default 2)\n", PIPE_MAX_DEPTH);
+    printf("trace mode replays a binary file of 64-bit block indices with read/write flags (fpga only)\n");
+    printf("      --trace <file>       trace to replay\n");
+    printf("      --trace-window <n>   entries streamed to the device per kernel run (default 1M)\n");
+    printf("gups mode runs HPCC RandomAccess xor updates over a --buffer-size table of 64-bit words\n");
+    printf("      --updates <n>        updates, K/M/G suffix allowed (default 4 per table word)\n");
+    printf("      --gups-tolerance <p> percent of table words the check allows to be wrong (default 1)\n");
+    printf("dataflow mode runs the access stream through decoupled address, load and store kernels (fpga only)\n");
+    printf("      --outstanding <list> MIN:MAX doubling or comma list of requests in flight, 1..%d (default 1:%d)\n",
+           AP_DATAFLOW_DEPTH, AP_DATAFLOW_DEPTH);
+    printf("units mode scales the access stream over concurrent bandwidth_unit requesters (fpga only)\n");
+    printf("      --units <list>       MIN:MAX doubling or comma list of unit counts (default 1:8)\n");
+    printf("      --unit-launch <name> cu|workitem, one task per compute unit or work items of one (default cu)\n");
+    printf("      --partition <name>   slice|seed, disjoint slices or independent seeds per unit (default slice)\n");
+    printf("devices mode runs bandwidth on several accelerators at once, one session and host thread each (fpga only)\n");
+    printf("      --devices <list>     all or comma list of indices among the matching devices (default all)\n");
+    printf("transfer mode times --reps round trips of --buffer-size bytes between host and device (fpga only)\n");
+    printf("      --transfer <list>    comma list of map|rw|hostptr|allochost (default all)\n");
+    printf("hostmem mode compares bandwidth on 4k and --huge-pages host buffers (cpu only)\n");
+    printf("contention mode runs --chunk-size host transfers both ways during --reps bandwidth launches (fpga only)\n");
+    printf("      --dma-bank <n>       DDR bank of the transfer buffers (default 0)\n");
+    printf("steady mode keeps chained bandwidth launches queued for a wall clock budget (fpga only)\n");
+    printf("      --duration <sec>     wall clock budget (default 10)\n");
+    printf("      --in-flight <n>      launches queued at once (default 4)\n");
+    printf("      --batch <n>          launches enqueued together, at most --in-flight (default 2)\n");
+    printf("lookup mode fetches the blocks of --trace, or of the pattern, in --trace-window batches (fpga only)\n");
+    printf("      --reorder            also run each batch sorted by DRAM bank and row\n");
+    printf("      --dram-map <name>    rbc|brc|xor address model of the reordering (default rbc)\n");
+    printf("      --dram-page <n>      DRAM page bytes, power of two (default 8K)\n");
+    printf("      --dram-banks <n>     DRAM banks per pair, power of two (default 16)\n");
 }
 
+/////////////////////////////////////////////////////////////////////////////////
+//parse_size
+//Parse a byte count with an optional K, M or G suffix
+size_t parse_size(const char *arg)
+{
+    char *end;
+    size_t size = strtoull(arg, &end, 0);
+    switch (*end) {
+    case 'G': case 'g': size <<= 10;
+    case 'M': case 'm': size <<= 10;
+    case 'K': case 'k': size <<= 10;
+    }
+    return size;
+}
 
 /////////////////////////////////////////////////////////////////////////////////
-//opencl_setup
-//Create context for Xilinx platform, Accelerator device
-//Create single command queue for accelerator device
-//Create program object with clCreateProgramWithBinary using given xclbin file name
+//parse_size_list
+//Parse MIN:MAX into the powers of two steps from MIN to MAX, or a comma
+//separated list of sizes
 //Return value
 // 0    Success
-//-1    Error
-//-2    Failed to load XCLBIN file from disk
-//-3    Failed to clCreateProgramWithBinary
-int opencl_setup(const char *xclbinfilename, cl_platform_id *platform_id, 
-                 cl_device_id *devices, cl_device_id *device_id, cl_context  *context, 
-                 cl_command_queue *command_queue, cl_program *program, 
-                 char *cl_platform_name, const char *target_device_name) {
-
-    char cl_platform_vendor[1001];
-    char cl_device_name[1001];
-    cl_int err;
-    cl_uint num_devices;
-    unsigned int device_found = 0;
+//-1    Empty, malformed or too long list
+int parse_size_list(const char *arg, size_t *list, unsigned int *count)
+{
+    const char *colon = strchr(arg, ':');
+
+    *count = 0;
+    if (colon != NULL) {
+        size_t lo = parse_size(arg);
+        size_t hi = parse_size(colon + 1);
+        for (size_t v=lo; v>0 && v<=hi; v*=2) {
+            if (*count == MAX_SWEEP_POINTS)
+                return -1;
+            list[(*count)++] = v;
+        }
+    } else {
+        for (const char *p=arg; p!=NULL && *p; ) {
+            if (*count == MAX_SWEEP_POINTS)
+                return -1;
+            list[(*count)++] = parse_size(p);
+            p = strchr(p, ',');
+            if (p != NULL)
+                p++;
+        }
+    }
+    return (*count > 0) ? 0 : -1;
+}
 
-    // Get first platform
-    err = clGetPlatformIDs(1,platform_id,NULL);
-    if (err != CL_SUCCESS) {
-        printf("ERROR: Failed to find an OpenCL platform!\n");
-        printf("ERROR: Test failed\n");
+int valid_access_bytes(size_t bytes)
+{
+    return (bytes >= 4) && ((bytes & (bytes - 1)) == 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//parse_options
+//Fill opts from argv, pattern specific settings end up in ap.param0/param1
+//Return value
+// 0    Success
+//-1    Bad command line
+int parse_options(int argc, char **argv, struct bench_options *opts)
+{
+    enum { OPT_STRIDE = 256, OPT_HOT_BLOCKS, OPT_HOT_PERCENT, OPT_RUN_BLOCKS,
+           OPT_BUFFER_SIZE, OPT_SAMPLES, OPT_HISTOGRAM, OPT_SIZES, OPT_WIDTHS,
+           OPT_WARMUP, OPT_REPS, OPT_FORMAT, OPT_NO_VERIFY, OPT_VERIFY_REPORT,
+           OPT_CHUNK_SIZE, OPT_PIPELINE_DEPTH, OPT_BANKS, OPT_PLACEMENT,
+           OPT_TRACE, OPT_TRACE_WINDOW, OPT_UPDATES, OPT_GUPS_TOLERANCE, OPT_CACHE,
+           OPT_OUTSTANDING, OPT_UNITS, OPT_UNIT_LAUNCH, OPT_PARTITION, OPT_RUNS,
+           OPT_DEVICES, OPT_STATS, OPT_TRANSFER, OPT_HUGE_PAGES, OPT_NUMA_NODE,
+           OPT_TILE_SIZE, OPT_DMA_BANK, OPT_DURATION, OPT_IN_FLIGHT, OPT_BATCH,
+           OPT_REORDER, OPT_DRAM_MAP, OPT_DRAM_PAGE, OPT_DRAM_BANKS };
+    static struct option long_options[] = {
+        {"backend",     required_argument, 0, 'b'},
+        {"mode",        required_argument, 0, 'M'},
+        {"threads",     required_argument, 0, 't'},
+        {"buffer-size", required_argument, 0, OPT_BUFFER_SIZE},
+        {"access-bytes",required_argument, 0, 'w'},
+        {"banks",       required_argument, 0, OPT_BANKS},
+        {"placement",   required_argument, 0, OPT_PLACEMENT},
+        {"tile-size",   required_argument, 0, OPT_TILE_SIZE},
+        {"cache",       no_argument,       0, OPT_CACHE},
+        {"stats",       no_argument,       0, OPT_STATS},
+        {"runs",        required_argument, 0, OPT_RUNS},
+        {"huge-pages",  required_argument, 0, OPT_HUGE_PAGES},
+        {"numa-node",   required_argument, 0, OPT_NUMA_NODE},
+        {"outstanding", required_argument, 0, OPT_OUTSTANDING},
+        {"units",       required_argument, 0, OPT_UNITS},
+        {"unit-launch", required_argument, 0, OPT_UNIT_LAUNCH},
+        {"partition",   required_argument, 0, OPT_PARTITION},
+        {"devices",     required_argument, 0, OPT_DEVICES},
+        {"transfer",    required_argument, 0, OPT_TRANSFER},
+        {"dma-bank",    required_argument, 0, OPT_DMA_BANK},
+        {"duration",    required_argument, 0, OPT_DURATION},
+        {"in-flight",   required_argument, 0, OPT_IN_FLIGHT},
+        {"batch",       required_argument, 0, OPT_BATCH},
+        {"reorder",     no_argument,       0, OPT_REORDER},
+        {"dram-map",    required_argument, 0, OPT_DRAM_MAP},
+        {"dram-page",   required_argument, 0, OPT_DRAM_PAGE},
+        {"dram-banks",  required_argument, 0, OPT_DRAM_BANKS},
+        {"no-verify",   no_argument,       0, OPT_NO_VERIFY},
+        {"verify-report",required_argument,0, OPT_VERIFY_REPORT},
+        {"pattern",     required_argument, 0, 'p'},
+        {"seed",        required_argument, 0, 's'},
+        {"iterations",  required_argument, 0, 'n'},
+        {"stride",      required_argument, 0, OPT_STRIDE},
+        {"hot-blocks",  required_argument, 0, OPT_HOT_BLOCKS},
+        {"hot-percent", required_argument, 0, OPT_HOT_PERCENT},
+        {"run-blocks",  required_argument, 0, OPT_RUN_BLOCKS},
+        {"samples",     required_argument, 0, OPT_SAMPLES},
+        {"histogram",   no_argument,       0, OPT_HISTOGRAM},
+        {"sizes",       required_argument, 0, OPT_SIZES},
+        {"widths",      required_argument, 0, OPT_WIDTHS},
+        {"warmup",      required_argument, 0, OPT_WARMUP},
+        {"reps",        required_argument, 0, OPT_REPS},
+        {"format",      required_argument, 0, OPT_FORMAT},
+        {"output",      required_argument, 0, 'o'},
+        {"chunk-size",  required_argument, 0, OPT_CHUNK_SIZE},
+        {"pipeline-depth",required_argument,0,OPT_PIPELINE_DEPTH},
+        {"trace",       required_argument, 0, OPT_TRACE},
+        {"trace-window",required_argument, 0, OPT_TRACE_WINDOW},
+        {"updates",     required_argument, 0, OPT_UPDATES},
+        {"gups-tolerance",required_argument,0,OPT_GUPS_TOLERANCE},
+        {0, 0, 0, 0}
+    };
+    ap_ulong stride = 1;
+    ap_ulong hot_blocks = 1024;
+    ap_ulong hot_percent = 90;
+    ap_ulong run_blocks = 16;
+    int pattern;
+    int c;
+
+    opts->xclbin = NULL;
+    opts->backend = BACKEND_FPGA;
+    opts->mode = MODE_BANDWIDTH;
+    opts->threads = 0;
+    opts->buffer_size = 1024*1024*1024;    //1GB
+
+    //Reducing the data size for emulation mode
+    if (getenv("XCL_EMULATION_MODE") != NULL)
+        opts->buffer_size = 1024 * 1024 ;  // 1MB
+    opts->access_bytes = AP_BLOCK_BYTES;
+
+    opts->ap.pattern = AP_PATTERN_UNIFORM;
+    opts->ap.seed = 1;
+    opts->ap.iterations = 10000;
+    opts->ap.param0 = 0;
+    opts->ap.param1 = 0;
+    opts->banks = 1;
+    opts->placement = PLACE_SPLIT;
+    opts->tile_size = 0;
+    opts->cache = 0;
+    opts->stats = 0;
+    opts->runs = 1;
+    opts->host_pages = HOST_PAGES_4K;
+    opts->host_node = HOST_NODE_ANY;
+    opts->verify = 1;
+    opts->verify_report = 10;
+    opts->samples = 100;
+    opts->histogram = 0;
+    opts->num_sweep_sizes = 0;
+    opts->num_sweep_widths = 0;
+    opts->warmup = 1;
+    opts->reps = 5;
+    opts->format = SWEEP_CSV;
+    opts->output = NULL;
+    opts->chunk_size = 0;
+    opts->pipeline_depth = 2;
+    opts->trace = NULL;
+    opts->trace_window = 1024 * 1024;
+    opts->gups_updates = 0;
+    opts->gups_tolerance = 1.0;
+    opts->num_outstanding = 0;
+    opts->num_units = 0;
+    opts->unit_launch = UNITS_CU;
+    opts->partition = AP_PARTITION_SLICE;
+    opts->num_devices = 0;
+    opts->num_transfers = 0;
+    opts->dma_bank = 0;
+    opts->duration = 10.0;
+    opts->in_flight = 4;
+    opts->batch = 2;
+    opts->reorder = 0;
+    opts->dram_map = DRAM_MAP_RBC;
+    opts->dram_page = 8192;
+    opts->dram_banks = 16;
+
+    while ((c = getopt_long(argc, argv, "b:M:t:w:p:s:n:o:", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'b':
+            if (strcmp(optarg, "fpga") == 0) {
+                opts->backend = BACKEND_FPGA;
+            } else if (strcmp(optarg, "cpu") == 0) {
+                opts->backend = BACKEND_CPU;
+            } else {
+                printf("Error: unknown backend %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'M':
+            if (strcmp(optarg, "bandwidth") == 0) {
+                opts->mode = MODE_BANDWIDTH;
+            } else if (strcmp(optarg, "latency") == 0) {
+                opts->mode = MODE_LATENCY;
+            } else if (strcmp(optarg, "sweep") == 0) {
+                opts->mode = MODE_SWEEP;
+            } else if (strcmp(optarg, "pipeline") == 0) {
+                opts->mode = MODE_PIPELINE;
+            } else if (strcmp(optarg, "trace") == 0) {
+                opts->mode = MODE_TRACE;
+            } else if (strcmp(optarg, "gups") == 0) {
+                opts->mode = MODE_GUPS;
+            } else if (strcmp(optarg, "dataflow") == 0) {
+                opts->mode = MODE_DATAFLOW;
+            } else if (strcmp(optarg, "units") == 0) {
+                opts->mode = MODE_UNITS;
+            } else if (strcmp(optarg, "devices") == 0) {
+                opts->mode = MODE_DEVICES;
+            } else if (strcmp(optarg, "transfer") == 0) {
+                opts->mode = MODE_TRANSFER;
+            } else if (strcmp(optarg, "hostmem") == 0) {
+                opts->mode = MODE_HOSTMEM;
+            } else if (strcmp(optarg, "contention") == 0) {
+                opts->mode = MODE_CONTENTION;
+            } else if (strcmp(optarg, "steady") == 0) {
+                opts->mode = MODE_STEADY;
+            } else if (strcmp(optarg, "lookup") == 0) {
+                opts->mode = MODE_LOOKUP;
+            } else {
+                printf("Error: unknown mode %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 't':
+            opts->threads = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_BUFFER_SIZE:
+            opts->buffer_size = parse_size(optarg);
+            break;
+        case 'w':
+            opts->access_bytes = strtoul(optarg, NULL, 0);
+            if (!valid_access_bytes(opts->access_bytes)) {
+                printf("Error: access bytes must be a power of two of at least 4\n");
+                return -1;
+            }
+            break;
+        case 'p':
+            pattern = ap_pattern_from_name(optarg);
+            if (pattern < 0) {
+                printf("Error: unknown access pattern %s\n", optarg);
+                return -1;
+            }
+            opts->ap.pattern = pattern;
+            break;
+        case 's':
+            opts->ap.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'n':
+            opts->ap.iterations = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_STRIDE:
+            stride = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_HOT_BLOCKS:
+            hot_blocks = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_HOT_PERCENT:
+            hot_percent = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_RUN_BLOCKS:
+            run_blocks = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_TRACE:
+            opts->trace = optarg;
+            break;
+        case OPT_TRACE_WINDOW:
+            opts->trace_window = parse_size(optarg);
+            break;
+        case OPT_UPDATES:
+            opts->gups_updates = parse_size(optarg);
+            break;
+        case OPT_OUTSTANDING:
+            if (parse_size_list(optarg, opts->outstanding, &opts->num_outstanding) != 0) {
+                printf("Error: bad --outstanding list %s\n", optarg);
+                return -1;
+            }
+            for (unsigned int i=0; i<opts->num_outstanding; i++) {
+                if (opts->outstanding[i] < 1 || opts->outstanding[i] > AP_DATAFLOW_DEPTH) {
+                    printf("Error: requests in flight must be 1..%d\n", AP_DATAFLOW_DEPTH);
+                    return -1;
+                }
+            }
+            break;
+        case OPT_UNITS:
+            if (parse_size_list(optarg, opts->units, &opts->num_units) != 0) {
+                printf("Error: bad --units list %s\n", optarg);
+                return -1;
+            }
+            for (unsigned int i=0; i<opts->num_units; i++) {
+                if (opts->units[i] < 1 || opts->units[i] > 1024) {
+                    printf("Error: unit counts must be 1..1024\n");
+                    return -1;
+                }
+            }
+            break;
+        case OPT_UNIT_LAUNCH:
+            if (strcmp(optarg, "cu") == 0) {
+                opts->unit_launch = UNITS_CU;
+            } else if (strcmp(optarg, "workitem") == 0) {
+                opts->unit_launch = UNITS_WORKITEM;
+            } else {
+                printf("Error: unknown unit launch %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_PARTITION:
+            if (strcmp(optarg, "slice") == 0) {
+                opts->partition = AP_PARTITION_SLICE;
+            } else if (strcmp(optarg, "seed") == 0) {
+                opts->partition = AP_PARTITION_SEED;
+            } else {
+                printf("Error: unknown partition %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_DEVICES:
+            opts->num_devices = 0;
+            if (strcmp(optarg, "all") == 0)
+                break;
+            for (const char *p=optarg; p!=NULL && *p; ) {
+                if (opts->num_devices == MAX_DEVICES) {
+                    printf("Error: at most %d devices\n", MAX_DEVICES);
+                    return -1;
+                }
+                opts->devices[opts->num_devices++] = strtoul(p, NULL, 0);
+                p = strchr(p, ',');
+                if (p != NULL)
+                    p++;
+            }
+            break;
+        case OPT_TRANSFER:
+            opts->num_transfers = 0;
+            for (char *p=strtok(optarg, ","); p!=NULL; p=strtok(NULL, ",")) {
+                int strategy = transfer_parse(p);
+                if (strategy < 0 || opts->num_transfers == NUM_TRANSFERS) {
+                    printf("Error: bad --transfer strategy %s\n", p);
+                    return -1;
+                }
+                opts->transfers[opts->num_transfers++] = strategy;
+            }
+            break;
+        case OPT_GUPS_TOLERANCE:
+            opts->gups_tolerance = strtod(optarg, NULL);
+            break;
+        case OPT_BANKS:
+            opts->banks = strtoul(optarg, NULL, 0);
+            if (opts->banks != 1 && opts->banks != 2 && opts->banks != 4) {
+                printf("Error: banks must be 1, 2 or 4\n");
+                return -1;
+            }
+            break;
+        case OPT_PLACEMENT:
+            if (strcmp(optarg, "same") == 0) {
+                opts->placement = PLACE_SAME;
+            } else if (strcmp(optarg, "split") == 0) {
+                opts->placement = PLACE_SPLIT;
+            } else if (strcmp(optarg, "interleave") == 0) {
+                opts->placement = PLACE_INTERLEAVE;
+            } else {
+                printf("Error: unknown placement %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_CACHE:
+            opts->cache = 1;
+            break;
+        case OPT_STATS:
+            opts->stats = 1;
+            break;
+        case OPT_HUGE_PAGES:
+            opts->host_pages = host_pages_parse(optarg);
+            if (opts->host_pages < 0) {
+                printf("Error: unknown huge page kind %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_NUMA_NODE:
+            if (strcmp(optarg, "any") == 0)
+                opts->host_node = HOST_NODE_ANY;
+            else if (strcmp(optarg, "device") == 0)
+                opts->host_node = HOST_NODE_DEVICE;
+            else
+                opts->host_node = strtol(optarg, NULL, 0);
+            if (opts->host_node < HOST_NODE_DEVICE || opts->host_node > 63) {
+                printf("Error: NUMA node must be any, device or 0..63\n");
+                return -1;
+            }
+            break;
+        case OPT_DMA_BANK:
+            opts->dma_bank = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_DURATION:
+            opts->duration = strtod(optarg, NULL);
+            if (opts->duration <= 0) {
+                printf("Error: duration must be above 0 seconds\n");
+                return -1;
+            }
+            break;
+        case OPT_IN_FLIGHT:
+            opts->in_flight = strtoul(optarg, NULL, 0);
+            if (opts->in_flight == 0) {
+                printf("Error: in flight launches must be at least 1\n");
+                return -1;
+            }
+            break;
+        case OPT_BATCH:
+            opts->batch = strtoul(optarg, NULL, 0);
+            if (opts->batch == 0) {
+                printf("Error: batch must be at least 1\n");
+                return -1;
+            }
+            break;
+        case OPT_REORDER:
+            opts->reorder = 1;
+            break;
+        case OPT_DRAM_MAP:
+            opts->dram_map = dram_map_parse(optarg);
+            if (opts->dram_map < 0) {
+                printf("Error: unknown DRAM map %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_DRAM_PAGE:
+            opts->dram_page = parse_size(optarg);
+            if (opts->dram_page < AP_BLOCK_BYTES || (opts->dram_page & (opts->dram_page - 1)) != 0) {
+                printf("Error: DRAM page must be a power of two of at least %u bytes\n", AP_BLOCK_BYTES);
+                return -1;
+            }
+            break;
+        case OPT_DRAM_BANKS:
+            opts->dram_banks = strtoul(optarg, NULL, 0);
+            if (opts->dram_banks == 0 || opts->dram_banks > DRAM_MAX_BANKS ||
+                (opts->dram_banks & (opts->dram_banks - 1)) != 0) {
+                printf("Error: DRAM banks must be a power of two up to %u\n", DRAM_MAX_BANKS);
+                return -1;
+            }
+            break;
+        case OPT_TILE_SIZE:
+            opts->tile_size = parse_size(optarg);
+            if (opts->tile_size < 4096) {
+                printf("Error: tile size must be at least 4K\n");
+                return -1;
+            }
+            break;
+        case OPT_RUNS:
+            opts->runs = strtoul(optarg, NULL, 0);
+            if (opts->runs == 0) {
+                printf("Error: runs must be at least 1\n");
+                return -1;
+            }
+            break;
+        case OPT_NO_VERIFY:
+            opts->verify = 0;
+            break;
+        case OPT_VERIFY_REPORT:
+            opts->verify_report = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_SAMPLES:
+            opts->samples = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_HISTOGRAM:
+            opts->histogram = 1;
+            break;
+        case OPT_SIZES:
+            if (parse_size_list(optarg, opts->sweep_sizes, &opts->num_sweep_sizes) != 0) {
+                printf("Error: bad --sizes list %s\n", optarg);
+                return -1;
+            }
+            break;
+        case OPT_WIDTHS:
+            if (parse_size_list(optarg, opts->sweep_widths, &opts->num_sweep_widths) != 0) {
+                printf("Error: bad --widths list %s\n", optarg);
+                return -1;
+            }
+            for (unsigned int w=0; w<opts->num_sweep_widths; w++) {
+                if (!valid_access_bytes(opts->sweep_widths[w])) {
+                    printf("Error: access bytes must be a power of two of at least 4\n");
+                    return -1;
+                }
+            }
+            break;
+        case OPT_WARMUP:
+            opts->warmup = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_REPS:
+            opts->reps = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_FORMAT:
+            if (strcmp(optarg, "csv") == 0) {
+                opts->format = SWEEP_CSV;
+            } else if (strcmp(optarg, "json") == 0) {
+                opts->format = SWEEP_JSON;
+            } else {
+                printf("Error: unknown sweep format %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'o':
+            opts->output = optarg;
+            break;
+        case OPT_CHUNK_SIZE:
+            opts->chunk_size = parse_size(optarg);
+            break;
+        case OPT_PIPELINE_DEPTH:
+            opts->pipeline_depth = strtoul(optarg, NULL, 0);
+            if (opts->pipeline_depth < 2 || opts->pipeline_depth > PIPE_MAX_DEPTH) {
+                printf("Error: pipeline depth must be 2..%d\n", PIPE_MAX_DEPTH);
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (optind == argc-1)
+        opts->xclbin = argv[optind];
+    else if (optind != argc || opts->backend == BACKEND_FPGA)
+        return -1;
+
+    if ((opts->mode == MODE_PIPELINE || opts->mode == MODE_TRACE) && opts->backend != BACKEND_FPGA) {
+        printf("Error: pipeline and trace modes stream over PCIe and need the fpga backend\n");
         return -1;
     }
-    err = clGetPlatformInfo(*platform_id,CL_PLATFORM_VENDOR,1000,(void *)cl_platform_vendor,NULL);
-    if (err != CL_SUCCESS) {
-        printf("ERROR: clGetPlatformInfo(CL_PLATFORM_VENDOR) failed!\n");
-        printf("ERROR: Test failed\n");
+    if (opts->cache && (opts->backend != BACKEND_FPGA || opts->mode != MODE_BANDWIDTH ||
+                        opts->access_bytes < AP_BLOCK_BYTES)) {
+        printf("Error: --cache needs the fpga backend, bandwidth mode and accesses of 64 bytes or more\n");
         return -1;
     }
-    printf("CL_PLATFORM_VENDOR %s\n",cl_platform_vendor);
-    err = clGetPlatformInfo(*platform_id,CL_PLATFORM_NAME,1000,(void *)cl_platform_name,NULL);
-    if (err != CL_SUCCESS) {
-            printf("ERROR: clGetPlatformInfo(CL_PLATFORM_NAME) failed!\n");
-            printf("ERROR: Test failed\n");
-            return -1;
+    if (opts->stats && (opts->backend != BACKEND_FPGA || opts->mode != MODE_BANDWIDTH ||
+                        opts->access_bytes < AP_BLOCK_BYTES || opts->cache)) {
+        printf("Error: --stats needs the fpga backend, bandwidth mode, accesses of 64 bytes or more and no --cache\n");
+        return -1;
     }
-    printf("CL_PLATFORM_NAME %s\n",cl_platform_name);
-
-    // Get Accelerator compute device
-    int accelerator = 1;
-    err = clGetDeviceIDs(*platform_id, CL_DEVICE_TYPE_ACCELERATOR, 16, devices, &num_devices);
-    if (err != CL_SUCCESS) {
-        printf("ERROR: Failed to create a device group!\n");
-        printf("ERROR: Test failed\n");
+    if (opts->mode == MODE_DATAFLOW && (opts->backend != BACKEND_FPGA || opts->access_bytes < AP_BLOCK_BYTES)) {
+        printf("Error: dataflow mode needs the fpga backend and accesses of 64 bytes or more\n");
         return -1;
     }
-
-    //iterate all devices to select the target device. 
-    for (int i=0; i<num_devices; i++) {
-        err = clGetDeviceInfo(devices[i], CL_DEVICE_NAME, 1024, cl_device_name, 0);
-        if (err != CL_SUCCESS) {
-            printf("Error: Failed to get device name for device %d!\n", i);
-            printf("Test failed\n");
-            return EXIT_FAILURE;
-        }
-        //printf("CL_DEVICE_NAME %s\n", cl_device_name);
-        if(strcmp(cl_device_name, target_device_name) == 0) {
-            *device_id = devices[i];
-            device_found = 1;
-            printf("Selected %s as the target device\n", cl_device_name);
-        }
+    if (opts->mode == MODE_UNITS && (opts->backend != BACKEND_FPGA || opts->access_bytes < AP_BLOCK_BYTES)) {
+        printf("Error: units mode needs the fpga backend and accesses of 64 bytes or more\n");
+        return -1;
     }
-    
-    if (!device_found) {
-        printf("Target device %s not found. Exit.\n", target_device_name);
-        return EXIT_FAILURE;
+    if (opts->mode == MODE_DEVICES && opts->backend != BACKEND_FPGA) {
+        printf("Error: devices mode needs the fpga backend\n");
+        return -1;
     }
-
-    // Create a compute context containing accelerator device
-    (*context)= clCreateContext(0, 1, device_id, NULL, NULL, &err);
-    if (!(*context))
-        {
-            printf("ERROR: Failed to create a compute context!\n");
-            printf("ERROR: Test failed\n");
-            return -1;
+    if (opts->mode == MODE_HOSTMEM && opts->backend != BACKEND_CPU) {
+        printf("Error: hostmem mode runs on the host, use -b cpu\n");
+        return -1;
+    }
+    if (opts->mode == MODE_LATENCY && opts->buffer_size < AP_BLOCK_BYTES) {
+        printf("Error: latency mode needs a buffer size of at least %u bytes\n", AP_BLOCK_BYTES);
+        return -1;
+    }
+    if (opts->mode == MODE_TRANSFER && (opts->backend != BACKEND_FPGA || opts->reps == 0)) {
+        printf("Error: transfer mode needs the fpga backend and --reps of 1 or more\n");
+        return -1;
+    }
+    if (opts->mode == MODE_CONTENTION && (opts->backend != BACKEND_FPGA || opts->reps == 0)) {
+        printf("Error: contention mode needs the fpga backend and --reps of 1 or more\n");
+        return -1;
+    }
+    if (opts->mode == MODE_STEADY && opts->backend != BACKEND_FPGA) {
+        printf("Error: steady mode needs the fpga backend\n");
+        return -1;
+    }
+    if (opts->mode == MODE_LOOKUP && opts->backend != BACKEND_FPGA) {
+        printf("Error: lookup mode needs the fpga backend\n");
+        return -1;
+    }
+    if (opts->batch > opts->in_flight) {
+        printf("Error: batch of %u launches does not fit %u in flight\n", opts->batch, opts->in_flight);
+        return -1;
+    }
+    if (opts->dma_bank >= opts->banks) {
+        printf("Error: DMA bank must be one of the %u banks\n", opts->banks);
+        return -1;
+    }
+    if (opts->num_transfers == 0) {
+        for (int t=0; t<NUM_TRANSFERS; t++)
+            opts->transfers[opts->num_transfers++] = t;
+    }
+    if (opts->num_units == 0) {
+        for (size_t v=1; v<=8; v*=2)
+            opts->units[opts->num_units++] = v;
+    }
+    if (opts->num_outstanding == 0) {
+        for (size_t v=1; v<=AP_DATAFLOW_DEPTH; v*=2)
+            opts->outstanding[opts->num_outstanding++] = v;
+    }
+    if (opts->mode == MODE_TRACE && opts->trace == NULL) {
+        printf("Error: trace mode needs --trace <file>\n");
+        return -1;
+    }
+    if (opts->buffer_size < opts->access_bytes) {
+        printf("Error: buffer size must hold at least one %u byte access\n", opts->access_bytes);
+        return -1;
+    }
+    //default sweep, the -w width at 4KB doubling up to the buffer size
+    if (opts->num_sweep_widths == 0)
+        opts->sweep_widths[opts->num_sweep_widths++] = opts->access_bytes;
+    if (opts->num_sweep_sizes == 0) {
+        for (size_t v=4096; v<=opts->buffer_size && opts->num_sweep_sizes<MAX_SWEEP_POINTS; v*=2)
+            opts->sweep_sizes[opts->num_sweep_sizes++] = v;
+        if (opts->num_sweep_sizes == 0)
+            opts->sweep_sizes[opts->num_sweep_sizes++] = opts->buffer_size;
+    }
+    //the random patterns and the latency chain draw units through ap_scale,
+    //counted here in the smaller of the access width and the 64 byte block
+    for (unsigned int w=0; w<((opts->mode == MODE_SWEEP) ? opts->num_sweep_widths : 1); w++) {
+        unsigned int width = (opts->mode == MODE_SWEEP) ? opts->sweep_widths[w] : opts->access_bytes;
+        size_t size = (opts->mode == MODE_SWEEP) ? 0 : opts->buffer_size;
+        if (opts->mode == MODE_SWEEP) {
+            for (unsigned int i=0; i<opts->num_sweep_sizes; i++) {
+                if (opts->sweep_sizes[i] > size)
+                    size = opts->sweep_sizes[i];
+            }
         }
-
-    // Create a command queue for accelerator device
-    (*command_queue) = clCreateCommandQueue(*context, *device_id, CL_QUEUE_PROFILING_ENABLE, &err);
-    if (!(*command_queue))
-        {
-            printf("ERROR: Failed to create a command commands!\n");
-            printf("ERROR: code %i\n",err);
-            printf("ERROR: Test failed\n");
+        if (width > AP_BLOCK_BYTES)
+            width = AP_BLOCK_BYTES;
+        if (size / width > AP_MAX_UNITS) {
+            printf("Error: %zu bytes of %u byte units exceed the %llu units an access pattern can address\n",
+                   size, width, (unsigned long long)AP_MAX_UNITS);
             return -1;
         }
+    }
 
-    // Load XCLBIN file binary from disk
-    int status;
-    unsigned char *kernelbinary;
-    printf("loading %s\n", xclbinfilename);
-    size_t xclbinlength;
-    err = load_file_to_memory(xclbinfilename, (char **) &kernelbinary,&xclbinlength);
-    if (err != 0) {
-        printf("ERROR: failed to load kernel from xclbin: %s\n", xclbinfilename);
-        printf("ERROR: Test failed\n");
-        return -2;
+    switch (opts->ap.pattern) {
+    case AP_PATTERN_STRIDE:
+        opts->ap.param0 = stride;
+        break;
+    case AP_PATTERN_HOTSET:
+        opts->ap.param0 = (hot_blocks > 0) ? hot_blocks : 1;
+        opts->ap.param1 = (hot_percent < 100) ? hot_percent : 100;
+        break;
+    case AP_PATTERN_BLOCKED:
+        opts->ap.param0 = (run_blocks > 0) ? run_blocks : 1;
+        break;
     }
+    return 0;
+}
 
-    // Create the program from XCLBIN file, configuring accelerator device
-    (*program) = clCreateProgramWithBinary(*context, 1, device_id, &xclbinlength, (const unsigned char **) &kernelbinary, &status, &err);
-    if ((!(*program)) || (err!=CL_SUCCESS)) {
-        printf("ERROR: Failed to create compute program from binary %d!\n", err);
-        printf("ERROR: Test failed\n");
-        return -3;
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_layout_init
+//Map the port pairs onto the opts->banks DDR banks of the card as asked by
+//opts->placement
+
+const char *fpga_placement_name(int placement)
+{
+    switch (placement) {
+    case PLACE_SAME:        return "same";
+    case PLACE_SPLIT:       return "split";
+    case PLACE_INTERLEAVE:  return "interleave";
     }
+    return "unknown";
+}
 
-    // Build the program executable (no-op)
-    err = clBuildProgram(*program, 0, NULL, NULL, NULL, NULL);
-    if (err != CL_SUCCESS) {
-            size_t len;
-            char buffer[2048];
-            printf("ERROR: Failed to build program executable!\n");
-            clGetProgramBuildInfo(*program, *device_id, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
-            printf("%s\n", buffer);
-            printf("ERROR: Test failed\n");
-            return -1;
+void fpga_layout_init(const struct bench_options *opts, struct fpga_layout *layout)
+{
+    unsigned int banks = (opts->banks > 0) ? opts->banks : 1;
+
+    memset(layout, 0, sizeof(*layout));
+    layout->port_mode = AP_PORTS_REPLICATE;
+    switch (opts->placement) {
+    case PLACE_SAME:
+        layout->num_pairs = banks;
+        for (unsigned int p=0; p<banks; p++) {
+            layout->input_bank[p] = p;
+            layout->output_bank[p] = p;
+        }
+        break;
+    case PLACE_INTERLEAVE:
+        layout->num_pairs = banks;
+        layout->port_mode = AP_PORTS_INTERLEAVE;
+        for (unsigned int p=0; p<banks; p++) {
+            layout->input_bank[p] = p;
+            layout->output_bank[p] = (p + 1) % banks;
+        }
+        break;
+    default:
+        layout->num_pairs = (banks > 1) ? banks / 2 : 1;
+        for (unsigned int p=0; p<layout->num_pairs; p++) {
+            layout->input_bank[p] = (banks > 1) ? 2*p : 0;
+            layout->output_bank[p] = (banks > 1) ? 2*p + 1 : 0;
+        }
+        break;
     }
+    while ((1U << layout->pair_shift) < layout->num_pairs)
+        layout->pair_shift++;
+}
 
+int fpga_layout_tile(struct fpga_layout *layout, size_t size, uint64_t max_alloc)
+{
+    struct fpga_layout placed = *layout;
+    unsigned int tiles = layout->num_pairs;
+
+    if (max_alloc == 0 || fpga_layout_pair_bytes(layout, size) <= max_alloc)
+        return 0;
+    while (tiles <= AP_MAX_PAIRS && size / tiles > max_alloc)
+        tiles *= 2;
+    if (tiles > AP_MAX_PAIRS) {
+        printf("Error: %zu byte buffers need more than %d tiles of at most %llu bytes\n",
+               size, AP_MAX_PAIRS, (unsigned long long)max_alloc);
+        return -1;
+    }
+
+    layout->num_pairs = tiles;
+    layout->port_mode = AP_PORTS_INTERLEAVE;
+    layout->tiled = 1;
+    for (unsigned int t=0; t<tiles; t++) {
+        layout->input_bank[t] = placed.input_bank[t % placed.num_pairs];
+        layout->output_bank[t] = placed.output_bank[t % placed.num_pairs];
+    }
+    layout->pair_shift = 0;
+    while ((1U << layout->pair_shift) < layout->num_pairs)
+        layout->pair_shift++;
     return 0;
 }
 
+size_t fpga_layout_pair_bytes(const struct fpga_layout *layout, size_t size)
+{
+    if (layout->port_mode == AP_PORTS_INTERLEAVE)
+        return size / layout->num_pairs;
+    return size;
+}
+
+uint64_t fpga_layout_units(const struct fpga_layout *layout, size_t size, unsigned int unit_bytes)
+{
+    return (fpga_layout_pair_bytes(layout, size) / unit_bytes) *
+           ((layout->port_mode == AP_PORTS_INTERLEAVE) ? layout->num_pairs : 1);
+}
+
+cl_int fpga_set_pair_args(cl_kernel kernel, const struct fpga_layout *layout,
+                          const cl_mem *inputs, const cl_mem *outputs, int *arg_num)
+{
+    cl_int err = 0;
 
+    for (unsigned int p=0; p<AP_MAX_PAIRS; p++) {
+        unsigned int q = (p < layout->num_pairs) ? p : 0;
+        err |= clSetKernelArg(kernel, (*arg_num)++, sizeof(cl_mem), &inputs[q]);
+        err |= clSetKernelArg(kernel, (*arg_num)++, sizeof(cl_mem), &outputs[q]);
+    }
+    return err;
+}
 
 /////////////////////////////////////////////////////////////////////////////////
-//main
+//access_shape
+//Pick the kernel serving opts->access_bytes wide accesses and its loop shift,
+//accesses below 64 bytes use bandwidth_narrow over uint, wider ones are
+//bursts of uint16 in bandwidth
 
-int main(int argc, char** argv)
+void access_shape(const struct bench_options *opts, int *narrow, cl_uint *shift)
 {
+    unsigned int beats;
 
-#if defined(SDX_PLATFORM) && !defined(TARGET_DEVICE)
-  #define STR_VALUE(arg)      #arg
-  #define GET_STRING(name) STR_VALUE(name)
-  #define TARGET_DEVICE GET_STRING(SDX_PLATFORM)
-#endif
-    //TARGET_DEVICE macro needs to be passed from gcc command line
-    const char *target_device_name = TARGET_DEVICE;
+    *narrow = (opts->access_bytes < AP_BLOCK_BYTES);
+    beats = *narrow ? opts->access_bytes / 4 : opts->access_bytes / AP_BLOCK_BYTES;
+    *shift = 0;
+    while ((1U << *shift) < beats)
+        (*shift)++;
+}
 
-    int err, err1, err2, err3;
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_bytes
+//Bytes one launch reads from global memory, the same amount is written. A
+//replicated access moves access_bytes through each pair in use, an
+//interleaved one through a single pair.
 
-    size_t globalbuffersize = 1024*1024*1024;    //1GB
+uint64_t fpga_bandwidth_bytes(const struct fpga_bandwidth *bw, const struct bench_options *opts)
+{
+    uint64_t pairs = (bw->layout.port_mode == AP_PORTS_INTERLEAVE) ? 1 : bw->layout.num_pairs;
+    return opts->ap.iterations * opts->access_bytes * pairs;
+}
 
-    //Reducing the data size for emulation mode
-    char *xcl_mode = getenv("XCL_EMULATION_MODE");
-    if (xcl_mode != NULL){
-    	globalbuffersize = 1024 * 1024 ;  // 1MB
-    }
-
-    //opencl setup
-    cl_platform_id platform_id;
-    cl_device_id device_id;
-    cl_device_id devices[16];  // compute device id 
-    cl_context context;
-    cl_command_queue command_queue;
-    cl_program program;
-    char cl_platform_name[1001];
-
-    //variables for profiling
-    uint64_t nsduration;
-    uint64_t tenseconds = ((uint64_t) 10) * ((uint64_t) 1000000000);
-
-    if (argc != 2){
-        printf("Usage: %s <xclbin_file>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_print_banks
+//Interleaved placements replay the access stream on the host to count the
+//accesses landing on each pair
 
-    err = opencl_setup(argv[1], &platform_id, devices, &device_id, 
-                       &context, &command_queue, &program, cl_platform_name, 
-                       target_device_name);
-    if(err==-1){
-        printf("Error : general failure setting up opencl context\n");
-        return -1;
+void fpga_bandwidth_print_banks(const struct fpga_bandwidth *bw, const struct bench_options *opts,
+                                double seconds)
+{
+    const struct fpga_layout *layout = &bw->layout;
+    uint64_t accesses[AP_MAX_PAIRS];
+    uint64_t bank_read[MAX_BANKS] = {0};
+    uint64_t bank_written[MAX_BANKS] = {0};
+    double mb = ((double)1024) * ((double)1024);
+    double total_read = 0, total_written = 0;
+
+    for (unsigned int p=0; p<layout->num_pairs; p++)
+        accesses[p] = opts->ap.iterations;
+    if (layout->port_mode == AP_PORTS_INTERLEAVE) {
+        uint64_t num_units = fpga_layout_units(layout, bw->size, opts->access_bytes);
+        memset(accesses, 0, sizeof(accesses));
+        for (uint64_t i=0; i<opts->ap.iterations; i++)
+            accesses[ap_pattern_block(&opts->ap, i, num_units) & (layout->num_pairs - 1)]++;
     }
-    if(err==-2) {
-        printf("Error : failed to bandwidth.xclbin from disk\n");
-        return -1;
+    for (unsigned int p=0; p<layout->num_pairs; p++) {
+        bank_read[layout->input_bank[p]] += accesses[p] * opts->access_bytes;
+        bank_written[layout->output_bank[p]] += accesses[p] * opts->access_bytes;
     }
-    if(err==-3) {
-        printf("Error : failed to clCreateProgramWithBinary with contents of xclbin\n");
+
+    for (unsigned int b=0; b<MAX_BANKS; b++) {
+        if (bank_read[b] == 0 && bank_written[b] == 0)
+            continue;
+        printf("Bank %u: read %.1f MB, wrote %.1f MB, %f MB/sec\n", b,
+               bank_read[b] / mb, bank_written[b] / mb,
+               (bank_read[b] + bank_written[b]) / mb / seconds);
+        total_read += bank_read[b];
+        total_written += bank_written[b];
     }
+    printf("All banks: read %.1f MB, wrote %.1f MB, %f MB/sec aggregate\n",
+           total_read / mb, total_written / mb, (total_read + total_written) / mb / seconds);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_print_cache
+//An uncached launch reads and writes every access in DDR, a cached one reads
+//the misses and writes the evicted and flushed lines
+
+void fpga_bandwidth_print_cache(const struct fpga_bandwidth *bw, const struct bench_options *opts,
+                                double seconds)
+{
+    const cl_ulong *c = bw->cache;
+    double mb = ((double)1024) * ((double)1024);
+    double lookups = c[AP_CACHE_HITS] + c[AP_CACHE_MISSES];
+    double ddr_read = c[AP_CACHE_MISSES] * (double)AP_BLOCK_BYTES;
+    double ddr_written = (c[AP_CACHE_EVICTIONS] + c[AP_CACHE_FLUSHED]) * (double)AP_BLOCK_BYTES;
+    double uncached = 2 * (double)fpga_bandwidth_bytes(bw, opts);
+
+    printf("Cache: %llu lines, %llu ways, %llu hits, %llu misses (%.2f%% hit rate), %llu evictions, %llu flushed\n",
+           (unsigned long long)c[AP_CACHE_LINES], (unsigned long long)c[AP_CACHE_WAYS],
+           (unsigned long long)c[AP_CACHE_HITS], (unsigned long long)c[AP_CACHE_MISSES],
+           (lookups > 0) ? 100.0 * c[AP_CACHE_HITS] / lookups : 0.0,
+           (unsigned long long)c[AP_CACHE_EVICTIONS], (unsigned long long)c[AP_CACHE_FLUSHED]);
+    printf("Cache DDR traffic: read %.1f MB, wrote %.1f MB, %.2f%% of uncached, %f MB/sec\n",
+           ddr_read / mb, ddr_written / mb,
+           (uncached > 0) ? 100.0 * (ddr_read + ddr_written) / uncached : 0.0,
+           (ddr_read + ddr_written) / mb / seconds);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_print_stats
+//Cycles are counted from the first to the last beat of the copy loop, every
+//beat past one per cycle is a stall of the pipelined loop
+
+void fpga_bandwidth_print_stats(const struct fpga_bandwidth *bw, const struct bench_options *opts,
+                                double seconds)
+{
+    const cl_ulong *s = bw->stats;
+    double mb = ((double)1024) * ((double)1024);
+    double cycles = (double)s[AP_STATS_CYCLES];
+    double stalls = (s[AP_STATS_CYCLES] > s[AP_STATS_BEATS]) ? cycles - s[AP_STATS_BEATS] : 0.0;
+    const char *emulation = getenv("XCL_EMULATION_MODE");
+
+    printf("Loop: %llu cycles for %llu beats, %.2f cycles per access, %.2f per beat, %.0f stall cycles (%.2f%%)\n",
+           (unsigned long long)s[AP_STATS_CYCLES], (unsigned long long)s[AP_STATS_BEATS],
+           (opts->ap.iterations > 0) ? cycles / opts->ap.iterations : 0.0,
+           (s[AP_STATS_BEATS] > 0) ? cycles / s[AP_STATS_BEATS] : 0.0,
+           stalls, (cycles > 0) ? 100.0 * stalls / cycles : 0.0);
+    printf("Loop: %f M cycles per second of kernel event time%s%s%s\n", cycles / seconds / 1e6,
+           emulation ? ", emulated under " : "", emulation ? emulation : "",
+           emulation ? " so cycles are loop iterations of the clock kernel" : "");
+    printf("Loop accesses: %llu in range, %llu folded to block 0\n",
+           (unsigned long long)s[AP_STATS_IN_RANGE], (unsigned long long)s[AP_STATS_FALLBACK]);
+    for (unsigned int p=0; p<bw->layout.num_pairs; p++)
+        printf("Loop pair %u: read %.1f MB, wrote %.1f MB\n", p,
+               s[AP_STATS_PAIR_BYTES + p] / mb, s[AP_STATS_PAIR_BYTES + p] / mb);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_setup
+//Create the bandwidth kernel and the input/output buffers of every port pair
+//in the banks of the layout, and write the i%256 input pattern to the device.
+//The pattern is generated straight into the mapped input buffers by
+//opts->threads threads.
+//Return value
+// 0    Success
+//-1    Error
+
+int fpga_bandwidth_setup(struct fpga_env *env, const struct bench_options *opts,
+                         size_t globalbuffersize, struct fpga_bandwidth *bw)
+{
+    cl_command_queue command_queue = env->command_queue;
+    cl_int err, err1;
+    char name[32];
+
+    memset(bw, 0, sizeof(*bw));
+    bw->env = env;
+    bw->size = globalbuffersize;
+    fpga_layout_init(opts, &bw->layout);
+    if (fpga_layout_tile(&bw->layout, globalbuffersize, env->max_alloc) != 0)
+        return -1;
+    bw->pair_size = fpga_layout_pair_bytes(&bw->layout, globalbuffersize);
+    double tsetup = now_seconds();
 
     //access the ACCELERATOR kernel
     cl_int clstatus;
-    cl_kernel kernel = clCreateKernel(program, "bandwidth", &clstatus);
-    if (!kernel || clstatus != CL_SUCCESS) {
+    bw->kernel = fpga_create_kernel(env, "bandwidth", &clstatus);
+    if (!bw->kernel || clstatus != CL_SUCCESS) {
         printf("Error: Failed to create compute kernel!\n");
         printf("Error: Test failed\n");
         return -1;
     }
 
-    //input buffer
-    unsigned char *input_host = ((unsigned char *)malloc(globalbuffersize));
-    if(input_host==NULL) {
-        printf("Error: Failed to allocate host side copy of OpenCL source buffer of size %i\n",globalbuffersize);
-        return -1;
-    }
-    unsigned int i;
-    for(i=0; i<globalbuffersize; i++) 
-        input_host[i]=i%256;
-
-    cl_mem input_buffer0, output_buffer0;
-#if defined(USE_2DDR) || defined(USE_4DDR) 
-    cl_mem_ext_ptr_t input_buffer0_ext, output_buffer0_ext;
-    input_buffer0_ext.flags = XCL_MEM_DDR_BANK0;
-    input_buffer0_ext.obj = NULL;
-    input_buffer0_ext.param = 0;
-    input_buffer0 = clCreateBuffer(context, 
-                                  CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, 
-                                  globalbuffersize, 
-                                  &input_buffer0_ext, 
-                                  &err);
-
-    output_buffer0_ext.flags = XCL_MEM_DDR_BANK1;
-    output_buffer0_ext.obj = NULL;
-    output_buffer0_ext.param = 0;
-    output_buffer0 = clCreateBuffer(context, 
-                                   CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, 
-                                   globalbuffersize, 
-                                   &output_buffer0_ext, 
-                                   &err1);
-
-#if defined(USE_4DDR)
-    cl_mem input_buffer1, output_buffer1;
-    cl_mem_ext_ptr_t input_buffer1_ext, output_buffer1_ext;
-    input_buffer1_ext.flags = XCL_MEM_DDR_BANK2;
-    input_buffer1_ext.obj = NULL;
-    input_buffer1_ext.param = 0;
-
-    input_buffer1 = clCreateBuffer(context, 
-                                  CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, 
-                                  globalbuffersize, 
-                                  &input_buffer1_ext, 
-                                  &err2);
-
-    output_buffer1_ext.flags = XCL_MEM_DDR_BANK3;
-    output_buffer1_ext.obj = NULL;
-    output_buffer1_ext.param = 0;
-    output_buffer1 = clCreateBuffer(context, 
-                                   CL_MEM_READ_WRITE | CL_MEM_EXT_PTR_XILINX, 
-                                   globalbuffersize, 
-                                   &output_buffer1_ext, 
-                                   &err3);
-#endif
+    int filled[AP_MAX_PAIRS];
+    for (unsigned int p=0; p<bw->layout.num_pairs; p++) {
+        bw->input[p] = fpga_take_bank_buffer(env, bw->pair_size, bw->layout.input_bank[p], &filled[p], &err);
+        bw->output[p] = fpga_create_bank_buffer(env, bw->pair_size, bw->layout.output_bank[p], &err1);
 
-#else
-    input_buffer0 = clCreateBuffer(context, 
-                                  CL_MEM_READ_WRITE, 
-                                  globalbuffersize, 
-                                  NULL, 
-                                  &err);
-
-    output_buffer0 = clCreateBuffer(context, 
-                                   CL_MEM_READ_WRITE, 
-                                   globalbuffersize, 
-                                   NULL, 
-                                   &err1);
-#endif
+        if(err != CL_SUCCESS) {
+            printf("Error: Failed to allocate input_buffer%u of size %zu\n", p, bw->pair_size);
+            return -1;
+        }
 
-    if(err != CL_SUCCESS) {
-        printf("Error: Failed to allocate input_buffer0 of size %i\n", globalbuffersize);
-        return -1;
+        if (err1 != CL_SUCCESS) {
+            printf("Error: Failed to allocate output_buffer%u of size %zu\n", p, bw->pair_size);
+            return -1;
+        }
     }
 
-    if (err1 != CL_SUCCESS) {
-        printf("Error: Failed to allocate output_buffer0 of size %i\n", globalbuffersize);
-        return -1;
+    for (unsigned int p=0; p<bw->layout.num_pairs; p++) {
+        //a pooled input left by an earlier run still holds the pattern
+        if (filled[p])
+            continue;
+
+        //Write input buffer
+        //Map input buffer for PCIe write
+        cl_event mapevent;
+        unsigned char *map_input_buffer;
+        map_input_buffer = (unsigned char *) clEnqueueMapBuffer(command_queue, 
+                                                               bw->input[p], 
+                                                               CL_FALSE, 
+                                                               CL_MAP_WRITE_INVALIDATE_REGION,
+                                                               0, 
+                                                               bw->pair_size, 
+                                                               0, 
+                                                               NULL, 
+                                                               &mapevent, 
+                                                               &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to clEnqueueMapBuffer OpenCL buffer\n");
+            printf("Error: Test failed\n");
+            return -1;
+        }
+        clFinish(command_queue);
+
+        //prepare data to be written to the device
+        bw->fill_seconds += fill_pattern(map_input_buffer, bw->pair_size, 0, opts->threads);
+
+        cl_event unmapevent;
+        err = clEnqueueUnmapMemObject(command_queue, 
+                                      bw->input[p], 
+                                      map_input_buffer, 
+                                      0, 
+                                      NULL,
+                                      &unmapevent);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to copy input dataset to OpenCL buffer\n");
+            printf("Error: Test failed\n");
+            return -1;
+        }
+        snprintf(name, sizeof(name), "map input%u", p);
+        profile_record(&bw->profile, name, PHASE_OTHER, 0, mapevent);
+        snprintf(name, sizeof(name), "unmap input%u", p);
+        profile_record(&bw->profile, name, PHASE_HOST_TO_DEVICE, bw->pair_size, unmapevent);
+        clReleaseEvent(mapevent);
+        clReleaseEvent(unmapevent);
+        fpga_mark_filled(env, bw->input[p]);
     }
+    clFinish(command_queue);
+    bw->setup_seconds = now_seconds() - tsetup;
+
+    return 0;
+}
 
-#ifdef USE_4DDR
-    if(err2 != CL_SUCCESS) {
-        printf("Error: Failed to allocate input_buffer1 of size %i\n", globalbuffersize);
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_launch_cached
+//Run the access stream through bandwidth_cached over pair 0 and read its
+//counters back into bw->cache. The kernel only exists in binaries built with
+//BW_CACHE_LINES defined.
+//Return value
+// 0    Success, *seconds holds the kernel execution time
+//-1    Error
+
+static int fpga_bandwidth_launch_cached(struct fpga_env *env, struct fpga_bandwidth *bw,
+                                        const struct bench_options *opts, cl_uint shift,
+                                        cl_ulong num_blocks, double *seconds)
+{
+    const struct access_pattern *ap = &opts->ap;
+    cl_kernel kernel;
+    cl_int err;
+
+    if (bw->layout.num_pairs != 1) {
+        printf("Error: the cache sits in front of one port pair, %u pairs are in use\n",
+               bw->layout.num_pairs);
         return -1;
     }
+    if (!bw->kernel_cached) {
+        bw->kernel_cached = fpga_create_kernel(env, "bandwidth_cached", &err);
+        if (!bw->kernel_cached || err != CL_SUCCESS) {
+            printf("Error: Failed to create bandwidth_cached kernel, build the xclbin with KERNEL_DEFS=-DBW_CACHE_LINES=<n>\n");
+            return -1;
+        }
+        bw->cache_stats = fpga_create_bank_buffer(env, sizeof(bw->cache), bw->layout.output_bank[0], &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to allocate cache stats buffer\n");
+            return -1;
+        }
+    }
+    kernel = bw->kernel_cached;
 
-    if (err3 != CL_SUCCESS) {
-        printf("Error: Failed to allocate output_buffer1 of size %i\n", globalbuffersize);
+    int arg_num = 0;
+    err  = 0;
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_mem),   &bw->input[0]);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_mem),   &bw->output[0]);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_mem),   &bw->cache_stats);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &num_blocks);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &shift);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &ap->pattern);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->seed);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->iterations);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param0);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param1);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to set kernel arguments! %d\n", err);
+        printf("ERROR: Test failed\n");
         return -1;
     }
-#endif
 
-    //
-    cl_ulong num_blocks = globalbuffersize/64;
-#ifdef USE_4DDR
-    double dbytes = globalbuffersize*2.0;
-#else
-    double dbytes = globalbuffersize;
-    //double dbytes = 10000;
-#endif
-    double dmbytes = dbytes / (((double)1024) * ((double)1024));
-    printf("Starting kernel to read/write %.0lf MB bytes from/to global memory... \n", dmbytes);
-
-    //Write input buffer
-    //Map input buffer for PCIe write
-    unsigned char *map_input_buffer0;
-    map_input_buffer0 = (unsigned char *) clEnqueueMapBuffer(command_queue, 
-                                                            input_buffer0, 
-                                                            CL_FALSE, 
-                                                            CL_MAP_WRITE_INVALIDATE_REGION,
-                                                            0, 
-                                                            globalbuffersize, 
-                                                            0, 
-                                                            NULL, 
-                                                            NULL, 
-                                                            &err);
+    size_t global[1] = {1};
+    size_t local[1] = {1};
+    cl_event ndrangeevent;
+    err = clEnqueueNDRangeKernel(env->command_queue, kernel, 1, NULL, global, local,
+                                 0, NULL, &ndrangeevent);
     if (err != CL_SUCCESS) {
-        printf("Error: Failed to clEnqueueMapBuffer OpenCL buffer\n");
-        printf("Error: Test failed\n");
+        printf("ERROR: Failed to execute kernel %d\n", err);
+        printf("ERROR: Test failed\n");
         return -1;
     }
-    clFinish(command_queue);
+    err = clEnqueueReadBuffer(env->command_queue, bw->cache_stats, CL_TRUE, 0, sizeof(bw->cache),
+                              bw->cache, 1, &ndrangeevent, NULL);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to read cache stats %d\n", err);
+        clReleaseEvent(ndrangeevent);
+        return -1;
+    }
+
+    *seconds = event_seconds(ndrangeevent);
+    fpga_note_kernel(env, *seconds);
+    profile_record(&bw->profile, "bandwidth_cached", PHASE_KERNEL,
+                   (bw->cache[AP_CACHE_MISSES] + bw->cache[AP_CACHE_EVICTIONS] +
+                    bw->cache[AP_CACHE_FLUSHED]) * AP_BLOCK_BYTES, ndrangeevent);
+    clReleaseEvent(ndrangeevent);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_launch_stats
+//Run the access stream through bandwidth_stats with bandwidth_clock started
+//first on a queue of its own, and read the loop counters back into
+//bw->stats. Both kernels only exist in binaries built with BW_STATS defined.
+//Return value
+// 0    Success, *seconds holds the bandwidth_stats execution time
+//-1    Error
+
+static int fpga_bandwidth_launch_stats(struct fpga_env *env, struct fpga_bandwidth *bw,
+                                       const struct bench_options *opts, cl_uint shift,
+                                       cl_ulong num_blocks, double *seconds)
+{
+    const struct access_pattern *ap = &opts->ap;
+    cl_kernel kernel;
+    cl_int err;
+
+    if (!bw->kernel_stats) {
+        bw->kernel_stats = fpga_create_kernel(env, "bandwidth_stats", &err);
+        if (err == CL_SUCCESS && bw->kernel_stats)
+            bw->kernel_clock = fpga_create_kernel(env, "bandwidth_clock", &err);
+        if (!bw->kernel_stats || !bw->kernel_clock || err != CL_SUCCESS) {
+            printf("Error: Failed to create bandwidth_stats kernels, build the xclbin with KERNEL_DEFS=-DBW_STATS\n");
+            return -1;
+        }
+        bw->clock_queue = clCreateCommandQueue(env->context, env->device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+        if (!bw->clock_queue || err != CL_SUCCESS) {
+            printf("Error: Failed to create clock command queue %d\n", err);
+            return -1;
+        }
+        bw->loop_stats = fpga_create_bank_buffer(env, sizeof(bw->stats), bw->layout.output_bank[0], &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to allocate loop stats buffer\n");
+            return -1;
+        }
+    }
+    kernel = bw->kernel_stats;
 
-    //prepare data to be written to the device
-    for(i=0; i<globalbuffersize; i++) 
-        map_input_buffer0[i] = input_host[i];
-
-    cl_event event1;
-    err = clEnqueueUnmapMemObject(command_queue, 
-                                  input_buffer0, 
-                                  map_input_buffer0, 
-                                  0, 
-                                  NULL,
-                                  &event1);
+    int arg_num = 0;
+    err  = 0;
+    err  = fpga_set_pair_args(kernel, &bw->layout, bw->input, bw->output, &arg_num);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_mem),   &bw->loop_stats);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &num_blocks);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &shift);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &bw->layout.pair_shift);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &bw->layout.port_mode);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &ap->pattern);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->seed);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->iterations);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param0);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param1);
     if (err != CL_SUCCESS) {
-        printf("Error: Failed to copy input dataset to OpenCL buffer\n");
-        printf("Error: Test failed\n");
+        printf("ERROR: Failed to set kernel arguments! %d\n", err);
+        printf("ERROR: Test failed\n");
         return -1;
     }
 
-#ifdef USE_4DDR
-    //Map input buffer for PCIe write
-    unsigned char *map_input_buffer1;
-    map_input_buffer1 = (unsigned char *) clEnqueueMapBuffer(command_queue, 
-                                                            input_buffer1, 
-                                                            CL_FALSE, 
-                                                            CL_MAP_WRITE_INVALIDATE_REGION,
-                                                            0, 
-                                                            globalbuffersize, 
-                                                            0, 
-                                                            NULL, 
-                                                            NULL, 
-                                                            &err);
+    //a budget far beyond the copy, the clock still ends if the copy never runs
+    cl_ulong copy_beats = ap->iterations << shift;
+    cl_ulong max_cycles = (copy_beats < ~0ULL / (2 * AP_CLOCK_BEAT_CYCLES))
+                          ? copy_beats * AP_CLOCK_BEAT_CYCLES : ~0ULL / 2;
+    if (max_cycles < AP_CLOCK_MIN_CYCLES)
+        max_cycles = AP_CLOCK_MIN_CYCLES;
+    err = clSetKernelArg(bw->kernel_clock, 0, sizeof(cl_ulong), &max_cycles);
     if (err != CL_SUCCESS) {
-        printf("Error: Failed to clEnqueueMapBuffer OpenCL buffer\n");
-        printf("Error: Test failed\n");
+        printf("ERROR: Failed to set bandwidth_clock arguments! %d\n", err);
         return -1;
     }
-    clFinish(command_queue);
 
-    //prepare data to be written to the device
-    for(i=0; i<globalbuffersize; i++) 
-        map_input_buffer1[i] = input_host[i];
-
-    cl_event event2;
-    err = clEnqueueUnmapMemObject(command_queue, 
-                                  input_buffer1, 
-                                  map_input_buffer1, 
-                                  0, 
-                                  NULL,
-                                  &event2);
+    size_t global[1] = {1};
+    size_t local[1] = {1};
+    cl_event clockevent, ndrangeevent;
+    err = clEnqueueNDRangeKernel(bw->clock_queue, bw->kernel_clock, 1, NULL, global, local,
+                                 0, NULL, &clockevent);
     if (err != CL_SUCCESS) {
-        printf("Error: Failed to copy input dataset to OpenCL buffer\n");
-        printf("Error: Test failed\n");
+        printf("ERROR: Failed to execute bandwidth_clock %d\n", err);
+        return -1;
+    }
+    clFlush(bw->clock_queue);
+    err = clEnqueueNDRangeKernel(env->command_queue, kernel, 1, NULL, global, local,
+                                 0, NULL, &ndrangeevent);
+    if (err != CL_SUCCESS) {
+        //nothing will stop the clock, wait for it to run out its budget
+        printf("ERROR: Failed to execute kernel %d, waiting for bandwidth_clock to time out\n", err);
+        clFinish(bw->clock_queue);
+        clReleaseEvent(clockevent);
+        return -1;
+    }
+    err = clEnqueueReadBuffer(env->command_queue, bw->loop_stats, CL_TRUE, 0, sizeof(bw->stats),
+                              bw->stats, 1, &ndrangeevent, NULL);
+    clFinish(bw->clock_queue);
+    clReleaseEvent(clockevent);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to read loop stats %d\n", err);
+        clReleaseEvent(ndrangeevent);
         return -1;
     }
-#endif
 
-    //execute kernel
+    *seconds = event_seconds(ndrangeevent);
+    fpga_note_kernel(env, *seconds);
+    profile_record(&bw->profile, "bandwidth_stats", PHASE_KERNEL,
+                   2 * fpga_bandwidth_bytes(bw, opts), ndrangeevent);
+    clReleaseEvent(ndrangeevent);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_kernel
+//Pick the kernel of opts->access_bytes and set the arguments of the access
+//stream over the buffers of bw, the launch is left to the caller
+
+cl_kernel fpga_bandwidth_kernel(struct fpga_env *env, struct fpga_bandwidth *bw,
+                                const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    cl_kernel kernel;
+    cl_int err;
+    int narrow;
+    cl_uint shift;
+
+    access_shape(opts, &narrow, &shift);
+    if (narrow && !bw->kernel_narrow) {
+        bw->kernel_narrow = fpga_create_kernel(env, "bandwidth_narrow", &err);
+        if (!bw->kernel_narrow || err != CL_SUCCESS) {
+            printf("Error: Failed to create bandwidth_narrow kernel!\n");
+            return NULL;
+        }
+    }
+    kernel = narrow ? bw->kernel_narrow : bw->kernel;
+    cl_ulong num_blocks = fpga_layout_units(&bw->layout, bw->size, opts->access_bytes);
+
     int arg_num = 0;
     err  = 0;
-    err  = clSetKernelArg(kernel, arg_num++, sizeof(cl_mem), &input_buffer0);
-    err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_mem), &output_buffer0);
-#ifdef USE_4DDR
-    err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_mem), &input_buffer1);
-    err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_mem), &output_buffer1);
-#endif
+    err  = fpga_set_pair_args(kernel, &bw->layout, bw->input, bw->output, &arg_num);
     err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &num_blocks);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &shift);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &bw->layout.pair_shift);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &bw->layout.port_mode);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &ap->pattern);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->seed);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->iterations);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param0);
+    err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param1);
 
     if (err != CL_SUCCESS) {
         printf("ERROR: Failed to set kernel arguments! %d\n", err);
         printf("ERROR: Test failed\n");
-        return EXIT_FAILURE;
+        return NULL;
+    }
+    return kernel;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_launch
+//Run the access stream of opts once over the buffers of bw
+//Return value
+// 0    Success, *seconds holds the kernel execution time
+//-1    Error
+
+int fpga_bandwidth_launch(struct fpga_env *env, struct fpga_bandwidth *bw,
+                          const struct bench_options *opts, double *seconds)
+{
+    cl_kernel kernel;
+    cl_int err;
+    int narrow;
+    cl_uint shift;
+
+    access_shape(opts, &narrow, &shift);
+    cl_ulong num_blocks = fpga_layout_units(&bw->layout, bw->size, opts->access_bytes);
+    if (num_blocks == 0) {
+        printf("Error: %zu byte buffer holds no %u byte access per bank\n", bw->size, opts->access_bytes);
+        return -1;
     }
+    if (opts->cache)
+        return fpga_bandwidth_launch_cached(env, bw, opts, shift, num_blocks, seconds);
+    if (opts->stats)
+        return fpga_bandwidth_launch_stats(env, bw, opts, shift, num_blocks, seconds);
+
+    //execute kernel
+    kernel = fpga_bandwidth_kernel(env, bw, opts);
+    if (kernel == NULL)
+        return -1;
 
     size_t global[1];
     size_t local[1];
@@ -482,113 +1527,550 @@ int main(int argc, char** argv)
     local[0]=1;
 
     cl_event ndrangeevent;
-    err = clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, global, local, 
+    err = clEnqueueNDRangeKernel(env->command_queue, kernel, 1, NULL, global, local, 
                                  0, NULL, &ndrangeevent);
     if (err != CL_SUCCESS) {
         printf("ERROR: Failed to execute kernel %d\n", err);
         printf("ERROR: Test failed\n");
-        return EXIT_FAILURE;
+        return -1;
     }
     
-    clFinish(command_queue);
+    clFinish(env->command_queue);
+
+    *seconds = event_seconds(ndrangeevent);
+    fpga_note_kernel(env, *seconds);
+    profile_record(&bw->profile, narrow ? "bandwidth_narrow" : "bandwidth", PHASE_KERNEL,
+                   2 * fpga_bandwidth_bytes(bw, opts), ndrangeevent);
+    clReleaseEvent(ndrangeevent);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_check
+//Read the output buffers back and check the blocks touched by opts.
+//Replicated pairs are checked one by one, interleaved pairs together as the
+//stripes of one logical buffer.
+//Return value
+// 0    Success
+//-1    Error
+//-2    Mismatch found
+
+int fpga_bandwidth_check(struct fpga_env *env, struct fpga_bandwidth *bw,
+                         const struct bench_options *opts)
+{
+    cl_command_queue command_queue = env->command_queue;
+    const struct fpga_layout *layout = &bw->layout;
+    cl_ulong num_units = fpga_layout_units(layout, bw->size, opts->access_bytes);
+    const unsigned char *map_output[AP_MAX_PAIRS];
+    struct verify_report report;
+    char name[32];
+    cl_int err;
+    int ret = 0;
 
     //copy results back from OpenCL buffer
-    unsigned char *map_output_buffer0;
-    map_output_buffer0 = (unsigned char *)clEnqueueMapBuffer(command_queue, 
-                                                            output_buffer0, 
-                                                            CL_FALSE, 
-                                                            CL_MAP_READ, 
-                                                            0, 
-                                                            globalbuffersize, 
-                                                            0, 
-                                                            NULL, 
-                                                            &event1, 
-                                                            &err);
+    for (unsigned int p=0; p<layout->num_pairs; p++) {
+        cl_event mapevent;
+        map_output[p] = (const unsigned char *)clEnqueueMapBuffer(command_queue, 
+                                                                 bw->output[p], 
+                                                                 CL_FALSE, 
+                                                                 CL_MAP_READ, 
+                                                                 0, 
+                                                                 bw->pair_size, 
+                                                                 0, 
+                                                                 NULL, 
+                                                                 &mapevent, 
+                                                                 &err);
 
-    if (err != CL_SUCCESS) {
-        printf("ERROR: Failed to read output size buffer %d\n", err);
-        printf("ERROR: Test failed\n");
-        return EXIT_FAILURE;
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to read output size buffer %d\n", err);
+            printf("ERROR: Test failed\n");
+            return -1;
+        }
+        snprintf(name, sizeof(name), "map output%u", p);
+        profile_record(&bw->profile, name, PHASE_DEVICE_TO_HOST, bw->pair_size, mapevent);
+        clReleaseEvent(mapevent);
     }
     clFinish(command_queue);
 
-    //check
-    /*
-     for (i=0; i<globalbuffersize; i++) {
-        if (map_output_buffer0[i] != input_host[i]) {
-            printf("ERROR : kernel failed to copy entry %i input0=%i output0=%i\n",
-                   i, input_host[i], map_output_buffer0[i]);
-            return EXIT_FAILURE;
-       }
-    }
-    */
-#ifdef USE_4DDR
-    unsigned char *map_output_buffer1;
-    map_output_buffer1 = (unsigned char *)clEnqueueMapBuffer(command_queue, 
-                                                            output_buffer1, 
-                                                            CL_FALSE, 
-                                                            CL_MAP_READ, 
-                                                            0, 
-                                                            globalbuffersize, 
-                                                            0, 
-                                                            NULL, 
-                                                            &event1, 
-                                                            &err);
+    //check the blocks touched by the access stream
+    if (opts->verify) {
+        unsigned int checks = (layout->port_mode == AP_PORTS_INTERLEAVE) ? 1 : layout->num_pairs;
+        unsigned int stripes = (layout->port_mode == AP_PORTS_INTERLEAVE) ? layout->num_pairs : 1;
+        for (unsigned int p=0; p<checks; p++) {
+            err = verify_touched(&map_output[p], &layout->output_bank[p], stripes,
+                                 &opts->ap, num_units, opts->access_bytes,
+                                 opts->threads, opts->verify_report, &report);
+            if (stripes > 1)
+                snprintf(name, sizeof(name), "output");
+            else
+                snprintf(name, sizeof(name), "output%u", p);
+            if (opts->mode != MODE_SWEEP || err != 0)
+                verify_print(name, &report);
+            if (err != 0 && ret != -1)
+                ret = (err == -2) ? -1 : -2;
+        }
+    }
 
-    if (err != CL_SUCCESS) {
-        printf("ERROR: Failed to read output size buffer %d\n", err);
-        printf("ERROR: Test failed\n");
-        return EXIT_FAILURE;
+    for (unsigned int p=0; p<layout->num_pairs; p++) {
+        cl_event unmapevent;
+        clEnqueueUnmapMemObject(command_queue, bw->output[p], (void *)map_output[p], 0, NULL, &unmapevent);
+        snprintf(name, sizeof(name), "unmap output%u", p);
+        profile_record(&bw->profile, name, PHASE_OTHER, 0, unmapevent);
+        clReleaseEvent(unmapevent);
     }
     clFinish(command_queue);
-    
-    //check
-    for (i=0; i<globalbuffersize; i++) {
-        if (map_output_buffer1[i] != input_host[i]) {
-            printf("ERROR : kernel failed to copy entry %i input1=%i output1=%i\n",
-                   i, input_host[i], map_output_buffer1[i]);
-            return EXIT_FAILURE;
+
+    return ret;
+}
+
+void fpga_bandwidth_release(struct fpga_bandwidth *bw)
+{
+    for (unsigned int p=0; p<AP_MAX_PAIRS; p++) {
+        fpga_release_buffer(bw->env, bw->input[p]);
+        fpga_release_buffer(bw->env, bw->output[p]);
+    }
+    fpga_release_kernel(bw->env, bw->kernel);
+    fpga_release_kernel(bw->env, bw->kernel_narrow);
+    fpga_release_kernel(bw->env, bw->kernel_cached);
+    fpga_release_buffer(bw->env, bw->cache_stats);
+    fpga_release_kernel(bw->env, bw->kernel_stats);
+    fpga_release_kernel(bw->env, bw->kernel_clock);
+    fpga_release_buffer(bw->env, bw->loop_stats);
+    if (bw->clock_queue)
+        clReleaseCommandQueue(bw->clock_queue);
+    memset(bw, 0, sizeof(*bw));
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_bandwidth_clear_outputs
+//Zero the output buffers of every pair, so a check after the next launch
+//cannot pass on blocks an earlier launch wrote
+//Return value
+// 0    Success
+//-1    Error
+
+int fpga_bandwidth_clear_outputs(struct fpga_env *env, struct fpga_bandwidth *bw)
+{
+    cl_int err;
+
+    for (unsigned int p=0; p<bw->layout.num_pairs; p++) {
+        void *map_output = clEnqueueMapBuffer(env->command_queue, bw->output[p], CL_TRUE,
+                                              CL_MAP_WRITE_INVALIDATE_REGION, 0, bw->pair_size,
+                                              0, NULL, NULL, &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to clEnqueueMapBuffer output%u\n", p);
+            return -1;
         }
-     }
-#endif
+        memset(map_output, 0, bw->pair_size);
+        clEnqueueUnmapMemObject(env->command_queue, bw->output[p], map_output, 0, NULL, NULL);
+    }
+    clFinish(env->command_queue);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_units_launch
+//Start k units of bandwidth_unit over the buffers of bw, one task per compute
+//unit on the out of order queue, or one NDRange of k work items
+//Return value
+// 0    Success, unit_seconds[u] holds the kernel time of unit u (of the whole
+//      NDRange for work items), *seconds the span from the first start to the
+//      last end
+//-1    Error
+
+static int fpga_units_launch(cl_command_queue queue, cl_kernel kernel, struct fpga_bandwidth *bw,
+                             const struct bench_options *opts, cl_uint k,
+                             double *unit_seconds, double *seconds)
+{
+    const struct access_pattern *ap = &opts->ap;
+    cl_ulong num_blocks = bw->pair_size / opts->access_bytes;
+    cl_uint partition = opts->partition;
+    cl_uint launches = (opts->unit_launch == UNITS_CU) ? k : 1;
+    cl_event *events;
+    cl_int err;
+    int narrow;
+    cl_uint shift;
+
+    access_shape(opts, &narrow, &shift);
+    events = (cl_event *)calloc(launches, sizeof(cl_event));
+    if (events == NULL)
+        return -1;
+
+    for (cl_uint l=0; l<launches; l++) {
+        cl_uint unit_base = (opts->unit_launch == UNITS_CU) ? l : 0;
+        int arg_num = 0;
+        err  = fpga_set_pair_args(kernel, &bw->layout, bw->input, bw->output, &arg_num);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &num_blocks);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &shift);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &bw->layout.pair_shift);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &partition);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &ap->pattern);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->seed);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->iterations);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param0);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_ulong), &ap->param1);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &unit_base);
+        err |= clSetKernelArg(kernel, arg_num++,  sizeof(cl_uint),  &k);
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to set kernel arguments! %d\n", err);
+            launches = l;
+            break;
+        }
+
+        size_t global[1];
+        size_t local[1];
+        global[0] = (opts->unit_launch == UNITS_CU) ? 1 : k;
+        local[0] = 1;
+        err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, global, local, 0, NULL, &events[l]);
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to execute kernel %d\n", err);
+            launches = l;
+            break;
+        }
+    }
+    clFinish(queue);
+
+    if (err == CL_SUCCESS) {
+        *seconds = events_span(events, launches);
+        fpga_note_kernel(bw->env, *seconds);
+        for (cl_uint u=0; u<k; u++)
+            unit_seconds[u] = event_seconds(events[(opts->unit_launch == UNITS_CU) ? u : 0]);
+    }
+    for (cl_uint l=0; l<launches; l++)
+        clReleaseEvent(events[l]);
+    free(events);
+    return (err == CL_SUCCESS) ? 0 : -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_units_check
+//Check the blocks every one of the k units touched in the slice or with the
+//seed it was given
+//Return value
+// 0    Success
+//-1    Error
+//-2    Mismatch found
+
+static int fpga_units_check(struct fpga_env *env, struct fpga_bandwidth *bw,
+                            const struct bench_options *opts, cl_uint k)
+{
+    const struct fpga_layout *layout = &bw->layout;
+    cl_ulong num_blocks = bw->pair_size / opts->access_bytes;
+    unsigned char *map_output[AP_MAX_PAIRS];
+    struct verify_report report;
+    uint64_t checked = 0, mismatches = 0;
+    double seconds = 0;
+    char name[32];
+    cl_int err;
+    int ret = 0;
+
+    for (unsigned int p=0; p<layout->num_pairs; p++) {
+        map_output[p] = (unsigned char *)clEnqueueMapBuffer(env->command_queue, bw->output[p], CL_TRUE,
+                                                            CL_MAP_READ, 0, bw->pair_size,
+                                                            0, NULL, NULL, &err);
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to read output size buffer %d\n", err);
+            for (unsigned int q=0; q<p; q++)
+                clEnqueueUnmapMemObject(env->command_queue, bw->output[q], map_output[q], 0, NULL, NULL);
+            clFinish(env->command_queue);
+            return -1;
+        }
+    }
+
+    for (cl_uint u=0; u<k && ret != -1; u++) {
+        unsigned int pair = ap_unit_pair(layout->pair_shift, u);
+        struct access_pattern unit_ap = opts->ap;
+        cl_ulong start = 0, blocks = num_blocks;
+        if (opts->partition == AP_PARTITION_SEED) {
+            unit_ap.seed = ap_unit_seed(opts->ap.seed, u);
+        } else {
+            start = ap_unit_slice_start(num_blocks, layout->pair_shift, u, k);
+            blocks = ap_unit_slice_blocks(num_blocks, layout->pair_shift, u, k);
+        }
+        const unsigned char *output = map_output[pair] + start * opts->access_bytes;
+        err = verify_touched(&output, &layout->output_bank[pair], 1, &unit_ap, blocks,
+                             opts->access_bytes, opts->threads, opts->verify_report, &report);
+        checked += report.checked;
+        mismatches += report.mismatches;
+        seconds += report.seconds;
+        if (err != 0) {
+            snprintf(name, sizeof(name), "unit %u output", u);
+            verify_print(name, &report);
+            ret = (err == -2) ? -1 : -2;
+        }
+    }
+    printf("Verify %u units: %llu distinct units checked in %f sec, %llu mismatches\n", k,
+           (unsigned long long)checked, seconds, (unsigned long long)mismatches);
+
+    for (unsigned int p=0; p<layout->num_pairs; p++)
+        clEnqueueUnmapMemObject(env->command_queue, bw->output[p], map_output[p], 0, NULL, NULL);
+    clFinish(env->command_queue);
+    return ret;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_units
+//Run the access stream with every unit count of opts->units, each unit doing
+//opts->ap.iterations accesses, and report the per unit and aggregate rates
+//and the scaling efficiency against the first count of the list
+
+int fpga_run_units(struct fpga_env *env, const struct bench_options *opts)
+{
+    struct fpga_bandwidth bw;
+    cl_command_queue queue = NULL;
+    cl_kernel kernel = NULL;
+    double *unit_seconds = NULL;
+    double mb = ((double)1024) * ((double)1024);
+    double ref_rate = 0;
+    size_t max_units = 0;
+    cl_int err;
+    int ret = -1;
+
+    if (fpga_bandwidth_setup(env, opts, opts->buffer_size, &bw) != 0)
+        goto cleanup;
+    for (unsigned int i=0; i<opts->num_units; i++)
+        max_units = (opts->units[i] > max_units) ? opts->units[i] : max_units;
+    unit_seconds = (double *)calloc(max_units, sizeof(double));
+    if (unit_seconds == NULL)
+        goto cleanup;
+
+    //compute units only run concurrently from an out of order queue
+    queue = clCreateCommandQueue(env->context, env->device_id,
+                                 CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+    if (!queue || err != CL_SUCCESS) {
+        printf("Error: Failed to create out of order command queue %d\n", err);
+        goto cleanup;
+    }
+    kernel = fpga_create_kernel(env, "bandwidth_unit", &err);
+    if (!kernel || err != CL_SUCCESS) {
+        printf("Error: Failed to create bandwidth_unit kernel!\n");
+        goto cleanup;
+    }
+
+    printf("Units: %s, %s partition, %llu accesses of %u bytes per unit, pattern %s, seed %llu\n",
+           (opts->unit_launch == UNITS_CU) ? "one task per compute unit" : "work items of one compute unit",
+           (opts->partition == AP_PARTITION_SEED) ? "seed" : "slice",
+           (unsigned long long)opts->ap.iterations, opts->access_bytes,
+           ap_pattern_name(opts->ap.pattern), (unsigned long long)opts->ap.seed);
+
+    ret = 0;
+    for (unsigned int i=0; i<opts->num_units && ret == 0; i++) {
+        cl_uint k = (cl_uint)opts->units[i];
+        cl_ulong num_blocks = bw.pair_size / opts->access_bytes;
+        double seconds;
+
+        if (opts->partition == AP_PARTITION_SLICE &&
+            ap_unit_slice_blocks(num_blocks, bw.layout.pair_shift, 0, k) == 0) {
+            printf("Error: %u units leave no slice of 4 blocks per unit\n", k);
+            ret = -1;
+            break;
+        }
+        for (unsigned int w=0; w<opts->warmup && ret == 0; w++)
+            ret = fpga_units_launch(queue, kernel, &bw, opts, k, unit_seconds, &seconds);
+        if (ret == 0 && opts->verify)
+            ret = fpga_bandwidth_clear_outputs(env, &bw);
+        if (ret == 0)
+            ret = fpga_units_launch(queue, kernel, &bw, opts, k, unit_seconds, &seconds);
+        if (ret != 0)
+            break;
+
+        double unit_mb = 2 * opts->ap.iterations * (double)opts->access_bytes / mb;
+        if (opts->unit_launch == UNITS_CU) {
+            for (cl_uint u=0; u<k; u++) {
+                unsigned int pair = ap_unit_pair(bw.layout.pair_shift, u);
+                printf("Unit %u: pair %u (bank %u -> bank %u), %f sec, %f MB/sec\n", u, pair,
+                       bw.layout.input_bank[pair], bw.layout.output_bank[pair],
+                       unit_seconds[u], unit_mb / unit_seconds[u]);
+            }
+        }
+        double rate = k * unit_mb / seconds;
+        if (i == 0)
+            ref_rate = rate / k;
+        printf("Units %u: %f sec, %f MB/sec aggregate, %f MB/sec per unit, %f accesses/sec, %.1f%% scaling efficiency\n",
+               k, seconds, rate, rate / k, k * opts->ap.iterations / seconds,
+               100.0 * (rate / k) / ref_rate);
+        if (opts->verify)
+            ret = fpga_units_check(env, &bw, opts, k);
+    }
+
+cleanup:
+    fpga_release_kernel(env, kernel);
+    if (queue)
+        clReleaseCommandQueue(queue);
+    free(unit_seconds);
+    fpga_bandwidth_release(&bw);
+    return ret;
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_bandwidth
+//The single bandwidth run of the default mode
+//Return value
+// 0    Success
+//-1    Error
+
+static int fpga_run_bandwidth(struct fpga_env *env, const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    size_t globalbuffersize = opts->buffer_size;
+    struct fpga_bandwidth bw;
+    int ret = -1;
+
+    if (fpga_bandwidth_setup(env, opts, globalbuffersize, &bw) != 0) {
+        fpga_bandwidth_release(&bw);
+        return -1;
+    }
+    printf("Bank placement %s over %u banks, %u port pairs %s\n",
+           fpga_placement_name(opts->placement), opts->banks, bw.layout.num_pairs,
+           bw.layout.tiled ? "tiled" :
+           (bw.layout.port_mode == AP_PORTS_INTERLEAVE) ? "interleaved" : "replicated");
+    if (bw.layout.tiled)
+        printf("Tiling %.1f MB over %u buffers of %.1f MB per direction, device limit %.1f MB\n",
+               globalbuffersize / (((double)1024) * ((double)1024)), bw.layout.num_pairs,
+               bw.pair_size / (((double)1024) * ((double)1024)),
+               env->max_alloc / (((double)1024) * ((double)1024)));
+    double dmfill = bw.layout.num_pairs * bw.pair_size / (((double)1024) * ((double)1024));
+    printf("Setup: %f sec, filled %.1f MB of mapped input in %f sec (%f MB/sec)\n",
+           bw.setup_seconds, dmfill, bw.fill_seconds, dmfill / bw.fill_seconds);
+
+    //
+    cl_ulong num_blocks = fpga_layout_units(&bw.layout, globalbuffersize, opts->access_bytes);
+    double dmbytes = fpga_bandwidth_bytes(&bw, opts) / (((double)1024) * ((double)1024));
+    printf("Access pattern %s, seed %llu, %llu accesses of %u bytes over %llu blocks\n",
+           ap_pattern_name(ap->pattern), (unsigned long long)ap->seed,
+           (unsigned long long)ap->iterations, opts->access_bytes, (unsigned long long)num_blocks);
+    printf("Starting kernel to read/write %.1lf MB bytes from/to global memory... \n", dmbytes);
+
+    //pooled output buffers still hold the previous run's copy of the stream
+    if (opts->verify && fpga_bandwidth_clear_outputs(env, &bw) != 0)
+        goto cleanup;
+
+    double dsduration;
+    if (fpga_bandwidth_launch(env, &bw, opts, &dsduration) != 0)
+        goto cleanup;
+
+    if (fpga_bandwidth_check(env, &bw, opts) != 0)
+        goto cleanup;
 
 
     //--------------------------------------------------------------------------
     //profiling information
     //--------------------------------------------------------------------------
-    uint64_t nstimestart, nstimeend;
-    clGetEventProfilingInfo(ndrangeevent, CL_PROFILING_COMMAND_START, sizeof(uint64_t), ((void *)(&nstimestart)), NULL);
-    clGetEventProfilingInfo(ndrangeevent, CL_PROFILING_COMMAND_END,    sizeof(uint64_t), ((void *)(&nstimeend)),    NULL);
-    nsduration = nstimeend-nstimestart;
+    //bytes are attributed from the accesses actually made, not the buffer size
+    struct bench_result result;
+    result.seconds = dsduration;
+    result.accesses = ap->iterations;
+    result.bytes_read = fpga_bandwidth_bytes(&bw, opts);
+    result.bytes_written = fpga_bandwidth_bytes(&bw, opts);
+    print_throughput("global memory", &result);
+    if (opts->cache)
+        fpga_bandwidth_print_cache(&bw, opts, dsduration);
+    else
+        fpga_bandwidth_print_banks(&bw, opts, dsduration);
+    if (opts->stats)
+        fpga_bandwidth_print_stats(&bw, opts, dsduration);
+    profile_print(&bw.profile);
+    ret = 0;
+
+cleanup:
+    fpga_bandwidth_release(&bw);
+    return ret;
+}
 
-    double dnsduration = ((double)nsduration);
-    double dsduration = dnsduration / ((double) 1000000000);
+static int fpga_run_mode(struct fpga_env *env, const struct bench_options *opts)
+{
+    switch (opts->mode) {
+    case MODE_LATENCY:
+        return fpga_run_latency(env, opts);
+    case MODE_SWEEP:
+        return sweep_run(opts, env);
+    case MODE_PIPELINE:
+        return fpga_run_pipeline(env, opts);
+    case MODE_TRACE:
+        return fpga_run_trace(env, opts);
+    case MODE_GUPS:
+        return fpga_run_gups(env, opts);
+    case MODE_DATAFLOW:
+        return fpga_run_dataflow(env, opts);
+    case MODE_UNITS:
+        return fpga_run_units(env, opts);
+    case MODE_TRANSFER:
+        return fpga_run_transfer(env, opts);
+    case MODE_CONTENTION:
+        return fpga_run_contention(env, opts);
+    case MODE_STEADY:
+        return fpga_run_steady(env, opts);
+    case MODE_LOOKUP:
+        return fpga_run_lookup(env, opts);
+    default:
+        return fpga_run_bandwidth(env, opts);
+    }
+}
 
 
+/////////////////////////////////////////////////////////////////////////////////
+//main
+
+int main(int argc, char** argv)
+{
 
-    //double bpersec = (dbytes*2.0/dsduration);
-    double bpersec = (10000*2.0/dsduration);             ////2017.06.29 by Gao Li
-    double mbpersec = bpersec / ((double) 1024*1024 );
+#if defined(SDX_PLATFORM) && !defined(TARGET_DEVICE)
+  #define STR_VALUE(arg)      #arg
+  #define GET_STRING(name) STR_VALUE(name)
+  #define TARGET_DEVICE GET_STRING(SDX_PLATFORM)
+#endif
+    //TARGET_DEVICE macro needs to be passed from gcc command line
+    const char *target_device_name = TARGET_DEVICE;
 
-    printf("Kernel read %.0lf MB bytes from and wrote %.01f MB to global memory.\n", dmbytes, dmbytes);
-    printf("Execution time = %f (sec) \n", dsduration);
-    printf("Concurrent Read and Write Throughput = %f (MB/sec) \n", mbpersec);
+    int err;
+
+    struct bench_options opts;
+    if (parse_options(argc, argv, &opts) != 0){
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (opts.backend == BACKEND_CPU) {
+        if (opts.mode == MODE_LATENCY)
+            err = cpu_run_latency(&opts);
+        else if (opts.mode == MODE_SWEEP)
+            err = sweep_run(&opts, NULL);
+        else if (opts.mode == MODE_GUPS)
+            err = cpu_run_gups(&opts);
+        else if (opts.mode == MODE_HOSTMEM)
+            err = cpu_run_hostmem(&opts);
+        else
+            err = cpu_run_bandwidth(&opts);
+        host_pool_drain();
+        return (err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    //a session per device, opened by the mode itself
+    if (opts.mode == MODE_DEVICES) {
+        err = fpga_run_devices(&opts, target_device_name);
+        return (err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    //opencl setup, once for all runs
+    struct fpga_session session;
+    if (session_open(opts.xclbin, target_device_name, -1, &opts, &session) != 0)
+        return -1;
+
+    err = 0;
+    for (unsigned int run=0; run<opts.runs && err == 0; run++) {
+        session_run_begin(&session);
+        err = fpga_run_mode(&session.env, &opts);
+        session_run_end(&session);
+    }
+    session_print(&session);
+    host_pool_drain();
 
     //--------------------------------------------------------------------------
     //add clena up code
     //--------------------------------------------------------------------------
-    clReleaseMemObject(input_buffer0);
-    clReleaseMemObject(output_buffer0);
-#ifdef USE_4DDR
-    clReleaseMemObject(input_buffer1);
-    clReleaseMemObject(output_buffer1);
-#endif
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(command_queue);
-    clReleaseContext(context);
+    session_close(&session);
 
-    return EXIT_SUCCESS;
+    return (err == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 
 }
-
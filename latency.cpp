@@ -0,0 +1,400 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : latency.cpp
+Purpose             : Pointer chasing latency mode on the host and the device
+Revision History    : 2017.07.18
+******************************************************************************
+*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "latency.h"
+#include "cpu_backend.h"
+#include "host_alloc.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//latency histogram
+
+static unsigned int lat_bucket(uint64_t v)
+{
+    if (v < LAT_SUB_BUCKETS)
+        return v;
+    unsigned int shift = (63 - __builtin_clzll(v)) - LAT_SUB_BITS;
+    return LAT_SUB_BUCKETS + shift*LAT_SUB_BUCKETS + ((v >> shift) - LAT_SUB_BUCKETS);
+}
+
+static double lat_bucket_low(unsigned int b)
+{
+    if (b < LAT_SUB_BUCKETS)
+        return b;
+    unsigned int shift = (b - LAT_SUB_BUCKETS) / LAT_SUB_BUCKETS;
+    uint64_t top = LAT_SUB_BUCKETS + (b - LAT_SUB_BUCKETS) % LAT_SUB_BUCKETS;
+    return (double)(top << shift);
+}
+
+static double lat_bucket_high(unsigned int b)
+{
+    if (b < LAT_SUB_BUCKETS)
+        return b + 1;
+    unsigned int shift = (b - LAT_SUB_BUCKETS) / LAT_SUB_BUCKETS;
+    uint64_t top = LAT_SUB_BUCKETS + (b - LAT_SUB_BUCKETS) % LAT_SUB_BUCKETS;
+    return (double)((top + 1) << shift);
+}
+
+void lat_hist_reset(struct latency_histogram *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void lat_hist_record(struct latency_histogram *h, double ns)
+{
+    if (ns < 0)
+        ns = 0;
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+    h->buckets[lat_bucket((uint64_t)(ns + 0.5))]++;
+}
+
+double lat_hist_mean(const struct latency_histogram *h)
+{
+    return (h->count > 0) ? h->sum_ns / h->count : 0;
+}
+
+//midpoint of the bucket holding the sample of rank ceil(percent% * count)
+double lat_hist_percentile(const struct latency_histogram *h, double percent)
+{
+    uint64_t rank = (uint64_t)(percent / 100.0 * h->count + 0.999999);
+    uint64_t seen = 0;
+
+    if (rank == 0)
+        rank = 1;
+    for (unsigned int b=0; b<LAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            double mid = (lat_bucket_low(b) + lat_bucket_high(b)) / 2;
+            return (mid < h->max_ns) ? mid : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+void lat_hist_print_summary(const char *what, const struct latency_histogram *h)
+{
+    printf("%s latency samples = %llu\n", what, (unsigned long long)h->count);
+    printf("Mean latency = %f (ns/access) \n", lat_hist_mean(h));
+    printf("p50/p99/p99.9 latency = %.1f / %.1f / %.1f (ns/access) \n",
+           lat_hist_percentile(h, 50), lat_hist_percentile(h, 99), lat_hist_percentile(h, 99.9));
+}
+
+void lat_hist_print_buckets(const struct latency_histogram *h)
+{
+    for (unsigned int b=0; b<LAT_BUCKETS; b++) {
+        if (h->buckets[b] == 0)
+            continue;
+        printf("  [%10.0f, %10.0f) ns : %llu\n", lat_bucket_low(b), lat_bucket_high(b),
+               (unsigned long long)h->buckets[b]);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//build_chain
+//Fisher-Yates shuffle driven by the shared generator, so a given seed always
+//produces the same cycle on every host
+
+void build_chain(unsigned char *buf, uint64_t *order, uint64_t num_blocks, uint64_t seed)
+{
+    for (uint64_t k=0; k<num_blocks; k++)
+        order[k] = k;
+    for (uint64_t k=num_blocks-1; k>0; k--) {
+        uint64_t j = ap_scale(ap_random(seed, k), k+1);
+        uint64_t t = order[k];
+        order[k] = order[j];
+        order[j] = t;
+    }
+    for (uint64_t k=0; k<num_blocks; k++) {
+        uint64_t next = order[(k+1 == num_blocks) ? 0 : k+1];
+        memcpy(buf + order[k]*AP_BLOCK_BYTES, &next, sizeof(next));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//host pointer chase
+
+static inline uint64_t lat_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t lat_next(const unsigned char *buf, uint64_t block)
+{
+    return *(volatile const uint64_t *)(buf + block*AP_BLOCK_BYTES);
+}
+
+//smallest back to back difference of two timer reads
+static double lat_timer_overhead(void)
+{
+    uint64_t best = ~0ULL;
+    for (int i=0; i<10000; i++) {
+        uint64_t t0 = lat_now_ns();
+        uint64_t t1 = lat_now_ns();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return (double)best;
+}
+
+int cpu_run_latency(const struct bench_options *opts)
+{
+    uint64_t num_blocks = opts->buffer_size / AP_BLOCK_BYTES;
+    uint64_t hops = opts->ap.iterations;
+    uint64_t warmup = (hops < num_blocks) ? hops : num_blocks;
+    unsigned char *buf;
+    uint64_t *order;
+    struct latency_histogram hist;
+
+    if (num_blocks == 0) {
+        printf("Error: chain buffer of size %zu holds no %u byte block\n", opts->buffer_size, AP_BLOCK_BYTES);
+        return -1;
+    }
+    buf = (unsigned char *)host_alloc(opts->buffer_size, opts->host_pages, opts->host_node);
+    if (buf == NULL) {
+        printf("Error: Failed to allocate host chain buffer of size %zu\n", opts->buffer_size);
+        return -1;
+    }
+    order = (uint64_t *)malloc(num_blocks * sizeof(uint64_t));
+    if (order == NULL) {
+        printf("Error: Failed to allocate chain order of %llu blocks\n", (unsigned long long)num_blocks);
+        host_free(buf);
+        return -1;
+    }
+    memset(buf, 0, opts->buffer_size);
+    build_chain(buf, order, num_blocks, opts->ap.seed);
+
+    //the chase runs pinned, the caller's mask is put back afterwards so
+    //threads started later are not all born on this cpu
+    cpu_set_t saved;
+    int restore = (pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0);
+    cpu_pin_self(0);
+
+    printf("CPU backend: pointer chase of %llu hops over %llu blocks (%.1f MB working set)\n",
+           (unsigned long long)hops, (unsigned long long)num_blocks,
+           opts->buffer_size / (((double)1024) * ((double)1024)));
+
+    //warm up caches and TLB, then one untimed pass for an unbiased mean
+    uint64_t block = order[0];
+    for (uint64_t h=0; h<warmup; h++)
+        block = lat_next(buf, block);
+
+    double tstart = now_seconds();
+    for (uint64_t h=0; h<hops; h++)
+        block = lat_next(buf, block);
+    double seconds = now_seconds() - tstart;
+
+    //timed pass, one sample per access with the timer cost taken off
+    double overhead = lat_timer_overhead();
+    lat_hist_reset(&hist);
+    for (uint64_t h=0; h<hops; h++) {
+        uint64_t t0 = lat_now_ns();
+        block = lat_next(buf, block);
+        uint64_t t1 = lat_now_ns();
+        lat_hist_record(&hist, (double)(t1 - t0) - overhead);
+    }
+
+    if (restore)
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+
+    printf("Chase time = %f (sec), timer overhead %.1f ns subtracted per sample\n", seconds, overhead);
+    printf("Untimed mean latency = %f (ns/access) \n", seconds * 1e9 / hops);
+    lat_hist_print_summary("Host", &hist);
+    if (opts->histogram)
+        lat_hist_print_buckets(&hist);
+
+    int ret = 0;
+    if (block != order[(warmup + 2*hops) % num_blocks]) {
+        printf("ERROR : pointer chase ended on block %llu, expected %llu\n",
+               (unsigned long long)block, (unsigned long long)order[(warmup + 2*hops) % num_blocks]);
+        ret = -2;
+    }
+    free(order);
+    host_free(buf);
+    return ret;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//device pointer chase
+//The kernel has no clock of its own, so the chase is split into samples
+//launches and each launch is timed from its profiling events. The launch
+//overhead, measured with zero hop launches, is taken off every sample.
+
+//fewest batch means whose p99.9 is more than their maximum
+#define LAT_DEVICE_P999_SAMPLES 1000
+
+static int fpga_chase(struct fpga_env *env, cl_kernel kernel, cl_mem result,
+                      cl_ulong start, cl_ulong hops, cl_ulong *end, double *seconds)
+{
+    cl_int err;
+    cl_event event;
+    size_t global[1] = {1};
+    size_t local[1] = {1};
+
+    err  = clSetKernelArg(kernel, 2, sizeof(cl_ulong), &start);
+    err |= clSetKernelArg(kernel, 3, sizeof(cl_ulong), &hops);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to set latency kernel arguments! %d\n", err);
+        return -1;
+    }
+    err = clEnqueueNDRangeKernel(env->command_queue, kernel, 1, NULL, global, local, 0, NULL, &event);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to execute latency kernel %d\n", err);
+        return -1;
+    }
+    err = clEnqueueReadBuffer(env->command_queue, result, CL_TRUE, 0, sizeof(cl_ulong), end, 1, &event, NULL);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to read latency result %d\n", err);
+        clReleaseEvent(event);
+        return -1;
+    }
+    *seconds = event_seconds(event);
+    fpga_note_kernel(env, *seconds);
+    clReleaseEvent(event);
+    return 0;
+}
+
+int fpga_run_latency(struct fpga_env *env, const struct bench_options *opts)
+{
+    uint64_t num_blocks = opts->buffer_size / AP_BLOCK_BYTES;
+    unsigned int samples = (opts->samples > 0) ? opts->samples : 1;
+    cl_ulong hops = opts->ap.iterations / samples;
+    struct latency_histogram hist;
+    cl_int err;
+    int ret = -1;
+
+    if (hops == 0)
+        hops = 1;
+    if (num_blocks == 0) {
+        printf("Error: chain buffer of size %zu holds no %u byte block\n", opts->buffer_size, AP_BLOCK_BYTES);
+        return -1;
+    }
+
+    cl_kernel kernel = fpga_create_kernel(env, "latency", &err);
+    if (!kernel || err != CL_SUCCESS) {
+        printf("Error: Failed to create latency kernel!\n");
+        return -1;
+    }
+
+    uint64_t *order = (uint64_t *)malloc(num_blocks * sizeof(uint64_t));
+    cl_mem chain = fpga_create_buffer(env, opts->buffer_size, &err);
+    cl_int err1;
+    cl_mem result = fpga_create_buffer(env, sizeof(cl_ulong), &err1);
+    if (order == NULL || err != CL_SUCCESS || err1 != CL_SUCCESS) {
+        printf("Error: Failed to allocate chain buffer of size %zu\n", opts->buffer_size);
+        goto cleanup;
+    }
+
+    {
+        unsigned char *map_chain = (unsigned char *) clEnqueueMapBuffer(env->command_queue,
+                                                                        chain,
+                                                                        CL_TRUE,
+                                                                        CL_MAP_WRITE_INVALIDATE_REGION,
+                                                                        0,
+                                                                        opts->buffer_size,
+                                                                        0,
+                                                                        NULL,
+                                                                        NULL,
+                                                                        &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to clEnqueueMapBuffer chain buffer\n");
+            goto cleanup;
+        }
+        build_chain(map_chain, order, num_blocks, opts->ap.seed);
+        err = clEnqueueUnmapMemObject(env->command_queue, chain, map_chain, 0, NULL, NULL);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to copy chain to OpenCL buffer\n");
+            goto cleanup;
+        }
+        clFinish(env->command_queue);
+    }
+
+    err  = clSetKernelArg(kernel, 0, sizeof(cl_mem), &chain);
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &result);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to set latency kernel arguments! %d\n", err);
+        goto cleanup;
+    }
+
+    printf("Device pointer chase: %u samples of %llu hops over %llu blocks (%.1f MB working set)\n",
+           samples, (unsigned long long)hops, (unsigned long long)num_blocks,
+           opts->buffer_size / (((double)1024) * ((double)1024)));
+
+    {
+        cl_ulong block = order[0];
+        cl_ulong total_hops = 0;
+        double seconds, overhead = 0, chase_seconds = 0;
+
+        //launch overhead, best of a few empty launches
+        for (int i=0; i<8; i++) {
+            if (fpga_chase(env, kernel, result, block, 0, &block, &seconds) != 0)
+                goto cleanup;
+            if (i == 0 || seconds < overhead)
+                overhead = seconds;
+        }
+
+        //one warm up sample
+        if (fpga_chase(env, kernel, result, block, hops, &block, &seconds) != 0)
+            goto cleanup;
+        total_hops += hops;
+
+        lat_hist_reset(&hist);
+        for (unsigned int s=0; s<samples; s++) {
+            if (fpga_chase(env, kernel, result, block, hops, &block, &seconds) != 0)
+                goto cleanup;
+            total_hops += hops;
+            chase_seconds += seconds;
+            lat_hist_record(&hist, (seconds - overhead) * 1e9 / hops);
+        }
+
+        printf("Chase time = %f (sec), launch overhead %.1f us subtracted per sample\n",
+               chase_seconds, overhead * 1e6);
+        //each sample is the mean of hops accesses, the percentiles are of
+        //those batch means and not of single accesses
+        printf("Device latency samples = %llu batch means of %llu hops\n",
+               (unsigned long long)hist.count, (unsigned long long)hops);
+        printf("Mean latency = %f (ns/access) \n", lat_hist_mean(&hist));
+        printf("Batch mean p50/p99 latency = %.1f / %.1f (ns/access) \n",
+               lat_hist_percentile(&hist, 50), lat_hist_percentile(&hist, 99));
+        if (hist.count >= LAT_DEVICE_P999_SAMPLES)
+            printf("Batch mean p99.9 latency = %.1f (ns/access) \n", lat_hist_percentile(&hist, 99.9));
+        else
+            printf("Batch mean p99.9 latency needs --samples of at least %u\n", LAT_DEVICE_P999_SAMPLES);
+        if (opts->histogram)
+            lat_hist_print_buckets(&hist);
+
+        cl_ulong expected = order[total_hops % num_blocks];
+        if (block != expected) {
+            printf("ERROR : pointer chase ended on block %llu, expected %llu\n",
+                   (unsigned long long)block, (unsigned long long)expected);
+            ret = -2;
+            goto cleanup;
+        }
+    }
+    ret = 0;
+
+cleanup:
+    fpga_release_buffer(env, chain);
+    fpga_release_buffer(env, result);
+    fpga_release_kernel(env, kernel);
+    free(order);
+    return ret;
+}
@@ -0,0 +1,48 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : latency.h
+Purpose             : Pointer chasing latency mode and latency histograms
+Revision History    : 2017.07.18
+******************************************************************************
+*/
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+//log-linear buckets, 2^LAT_SUB_BITS buckets per power of two nanoseconds
+#define LAT_SUB_BITS            4
+#define LAT_SUB_BUCKETS         (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS             (LAT_SUB_BUCKETS + (64 - LAT_SUB_BITS) * LAT_SUB_BUCKETS)
+
+struct latency_histogram {
+    uint64_t    count;
+    double      sum_ns;
+    double      max_ns;
+    uint64_t    buckets[LAT_BUCKETS];
+};
+
+void lat_hist_reset(struct latency_histogram *h);
+void lat_hist_record(struct latency_histogram *h, double ns);
+double lat_hist_mean(const struct latency_histogram *h);
+double lat_hist_percentile(const struct latency_histogram *h, double percent);
+void lat_hist_print_summary(const char *what, const struct latency_histogram *h);
+void lat_hist_print_buckets(const struct latency_histogram *h);
+
+/////////////////////////////////////////////////////////////////////////////////
+//build_chain
+//Link the num_blocks blocks of buf into one random cycle, the first 8 bytes of
+//each block hold the index of the next block. order receives the cycle so the
+//block reached after h hops from order[0] is order[h % num_blocks].
+void build_chain(unsigned char *buf, uint64_t *order, uint64_t num_blocks, uint64_t seed);
+
+//Return value
+// 0    Success
+//-1    Allocation, OpenCL or kernel failure
+//-2    Chase ended on the wrong block
+int cpu_run_latency(const struct bench_options *opts);
+int fpga_run_latency(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
@@ -0,0 +1,323 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : lookup.cpp
+Purpose             : Batched block lookups through the bandwidth_lookup
+                      kernel, optionally reordered by DRAM bank and row
+Revision History    : 2017.09.11
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lookup.h"
+#include "dram_order.h"
+#include "fill.h"
+#include "host_alloc.h"
+#include "mapped_file.h"
+
+//what the batches of one request order add up to
+struct lookup_totals {
+    double      kernel_seconds;
+    uint64_t    row_hits;
+};
+
+struct lookup {
+    struct fpga_bandwidth   bw;
+    struct dram_model       model;
+    cl_kernel               kernel;
+    cl_mem                  index;
+    cl_mem                  results;
+    uint64_t                batch;
+    uint64_t                num_blocks;
+
+    //host side of a batch, generated entries and the reorder stage
+    uint64_t                *generated;
+    uint64_t                *sorted;
+    uint64_t                *perm;
+    uint64_t                *scratch;
+    unsigned char           *values;
+    unsigned char           *sorted_values;
+    unsigned char           *restored;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//lookup_batch
+//Write count entries to the device, run them through bandwidth_lookup and
+//read their results back into values. With clear the results buffer is
+//zeroed first, so a result the kernel never wrote can't pass as one an
+//earlier batch or run left behind
+//Return value
+// 0    Success, *seconds holds the kernel execution time
+//-1    Error
+
+static int lookup_batch(struct fpga_env *env, struct lookup *lk, const uint64_t *entries,
+                        cl_ulong count, unsigned char *values, int clear, double *seconds)
+{
+    cl_command_queue queue = env->command_queue;
+    cl_event kernel_event;
+    cl_int err;
+
+    if (clear) {
+        void *map_results = clEnqueueMapBuffer(queue, lk->results, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION,
+                                               0, count * AP_BLOCK_BYTES, 0, NULL, NULL, &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to clEnqueueMapBuffer lookup results %d\n", err);
+            return -1;
+        }
+        memset(map_results, 0, count * AP_BLOCK_BYTES);
+        clEnqueueUnmapMemObject(queue, lk->results, map_results, 0, NULL, NULL);
+    }
+
+    err = clEnqueueWriteBuffer(queue, lk->index, CL_TRUE, 0, count * sizeof(uint64_t), entries, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        printf("Error: Failed to write lookup batch %d\n", err);
+        return -1;
+    }
+
+    int arg_num = 0;
+    err  = fpga_set_pair_args(lk->kernel, &lk->bw.layout, lk->bw.input, lk->bw.output, &arg_num);
+    err |= clSetKernelArg(lk->kernel, arg_num++, sizeof(cl_mem),   &lk->index);
+    err |= clSetKernelArg(lk->kernel, arg_num++, sizeof(cl_mem),   &lk->results);
+    err |= clSetKernelArg(lk->kernel, arg_num++, sizeof(cl_ulong), &count);
+    err |= clSetKernelArg(lk->kernel, arg_num++, sizeof(cl_ulong), &lk->num_blocks);
+    err |= clSetKernelArg(lk->kernel, arg_num++, sizeof(cl_uint),  &lk->bw.layout.pair_shift);
+    err |= clSetKernelArg(lk->kernel, arg_num++, sizeof(cl_uint),  &lk->bw.layout.port_mode);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to set kernel arguments! %d\n", err);
+        return -1;
+    }
+
+    size_t global[1] = {1};
+    size_t local[1] = {1};
+    err = clEnqueueNDRangeKernel(queue, lk->kernel, 1, NULL, global, local, 0, NULL, &kernel_event);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to execute kernel %d\n", err);
+        return -1;
+    }
+    err = clEnqueueReadBuffer(queue, lk->results, CL_TRUE, 0, count * AP_BLOCK_BYTES, values,
+                              1, &kernel_event, NULL);
+    if (err != CL_SUCCESS) {
+        printf("Error: Failed to read lookup results %d\n", err);
+        clReleaseEvent(kernel_event);
+        return -1;
+    }
+    *seconds = event_seconds(kernel_event);
+    fpga_note_kernel(env, *seconds);
+    clReleaseEvent(kernel_event);
+    return 0;
+}
+
+//results of count entries in request order that differ from the input
+//pattern of their block, the first max_report are printed
+static uint64_t lookup_check(const struct lookup *lk, const uint64_t *entries, uint64_t first,
+                             uint64_t count, const unsigned char *values, unsigned int max_report)
+{
+    const struct fpga_layout *layout = &lk->bw.layout;
+    uint64_t mismatches = 0;
+
+    for (uint64_t i=0; i<count; i++) {
+        uint64_t block = ap_trace_block(entries[i], lk->num_blocks);
+        uint64_t unit = ap_pair_unit(layout->port_mode, layout->pair_shift, block);
+        if (memcmp(values + i * AP_BLOCK_BYTES, fill_template_at(unit * AP_BLOCK_BYTES), AP_BLOCK_BYTES) == 0)
+            continue;
+        if (mismatches < max_report)
+            printf("ERROR : lookup %llu of block %llu returned wrong data\n",
+                   (unsigned long long)(first + i), (unsigned long long)block);
+        mismatches++;
+    }
+    return mismatches;
+}
+
+static void lookup_release(struct fpga_env *env, struct lookup *lk)
+{
+    fpga_release_buffer(env, lk->index);
+    fpga_release_buffer(env, lk->results);
+    fpga_release_kernel(env, lk->kernel);
+    host_free(lk->generated);
+    host_free(lk->sorted);
+    host_free(lk->perm);
+    host_free(lk->scratch);
+    host_free(lk->values);
+    host_free(lk->sorted_values);
+    host_free(lk->restored);
+    fpga_bandwidth_release(&lk->bw);
+}
+
+static int lookup_setup(struct fpga_env *env, struct lookup *lk, const struct bench_options *opts,
+                        int generate)
+{
+    int pages = opts->host_pages, node = opts->host_node;
+    uint64_t batch = lk->batch;
+    cl_int err, err1;
+
+    if (fpga_bandwidth_setup(env, opts, opts->buffer_size, &lk->bw) != 0)
+        return -1;
+    lk->num_blocks = fpga_layout_units(&lk->bw.layout, lk->bw.size, AP_BLOCK_BYTES);
+    dram_model_init(&lk->model, opts->dram_map, opts->dram_page, opts->dram_banks, lk->num_blocks,
+                    lk->bw.layout.pair_shift, lk->bw.layout.port_mode);
+
+    lk->kernel = fpga_create_kernel(env, "bandwidth_lookup", &err);
+    if (!lk->kernel || err != CL_SUCCESS) {
+        printf("Error: Failed to create bandwidth_lookup kernel!\n");
+        return -1;
+    }
+    lk->index = fpga_create_buffer(env, batch * sizeof(uint64_t), &err);
+    lk->results = fpga_create_buffer(env, batch * AP_BLOCK_BYTES, &err1);
+    if (err != CL_SUCCESS || err1 != CL_SUCCESS) {
+        printf("Error: Failed to allocate lookup buffers of %llu entries\n", (unsigned long long)batch);
+        return -1;
+    }
+
+    lk->values = (unsigned char *)host_alloc(batch * AP_BLOCK_BYTES, pages, node);
+    if (generate)
+        lk->generated = (uint64_t *)host_alloc(batch * sizeof(uint64_t), pages, node);
+    if (opts->reorder) {
+        lk->sorted = (uint64_t *)host_alloc(batch * sizeof(uint64_t), pages, node);
+        lk->perm = (uint64_t *)host_alloc(batch * sizeof(uint64_t), pages, node);
+        lk->scratch = (uint64_t *)host_alloc(3 * batch * sizeof(uint64_t), pages, node);
+        lk->sorted_values = (unsigned char *)host_alloc(batch * AP_BLOCK_BYTES, pages, node);
+        lk->restored = (unsigned char *)host_alloc(batch * AP_BLOCK_BYTES, pages, node);
+    }
+    if (lk->values == NULL || (generate && lk->generated == NULL) ||
+        (opts->reorder && (lk->sorted == NULL || lk->perm == NULL || lk->scratch == NULL ||
+                           lk->sorted_values == NULL || lk->restored == NULL))) {
+        printf("Error: Failed to allocate host lookup buffers of %llu entries\n", (unsigned long long)batch);
+        return -1;
+    }
+    return 0;
+}
+
+int fpga_run_lookup(struct fpga_env *env, const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    struct mapped_file mf;
+    struct lookup lk;
+    struct lookup_totals in_order, reordered;
+    double sort_seconds = 0, restore_seconds = 0;
+    double mb = ((double)1024) * ((double)1024);
+    uint64_t num_entries, num_batches, mismatches = 0, unrestored = 0;
+    int ret = -1;
+
+    memset(&mf, 0, sizeof(mf));
+    mf.fd = -1;
+    memset(&lk, 0, sizeof(lk));
+    memset(&in_order, 0, sizeof(in_order));
+    memset(&reordered, 0, sizeof(reordered));
+
+    if (opts->trace != NULL) {
+        if (mapped_file_open(opts->trace, &mf) != 0) {
+            printf("Error: Failed to map trace %s\n", opts->trace);
+            return -1;
+        }
+        if (mf.size == 0 || mf.size % sizeof(uint64_t) != 0) {
+            printf("Error: trace %s must hold a whole number of 8 byte entries\n", opts->trace);
+            mapped_file_close(&mf);
+            return -1;
+        }
+        num_entries = mf.size / sizeof(uint64_t);
+    } else {
+        num_entries = ap->iterations;
+    }
+    lk.batch = (opts->trace_window > 0 && opts->trace_window < num_entries) ? opts->trace_window : num_entries;
+    num_batches = (num_entries + lk.batch - 1) / lk.batch;
+
+    if (lookup_setup(env, &lk, opts, opts->trace == NULL) != 0)
+        goto cleanup;
+
+    printf("Lookups: %llu from %s%s in %llu batches of %llu over %llu blocks, placement %s over %u banks\n",
+           (unsigned long long)num_entries, opts->trace ? "trace " : "pattern ",
+           opts->trace ? opts->trace : ap_pattern_name(ap->pattern),
+           (unsigned long long)num_batches, (unsigned long long)lk.batch,
+           (unsigned long long)lk.num_blocks, fpga_placement_name(opts->placement), opts->banks);
+    if (opts->reorder)
+        printf("DRAM model %s, %zu byte pages in %u banks: %u column, %u bank and %u row bits per pair\n",
+               dram_map_name(opts->dram_map), opts->dram_page, opts->dram_banks,
+               lk.model.column_bits, lk.model.bank_bits, lk.model.row_bits);
+
+    for (uint64_t b=0; b<num_batches; b++) {
+        uint64_t first = b * lk.batch;
+        uint64_t count = (num_entries - first < lk.batch) ? num_entries - first : lk.batch;
+        const uint64_t *entries;
+        double seconds, sorted_seconds, tstart;
+
+        if (opts->trace != NULL) {
+            entries = (const uint64_t *)mf.data + first;
+        } else {
+            for (uint64_t i=0; i<count; i++)
+                lk.generated[i] = ap_pattern_block(ap, first + i, lk.num_blocks);
+            entries = lk.generated;
+        }
+
+        if (lookup_batch(env, &lk, entries, count, lk.values, opts->verify, &seconds) != 0)
+            goto cleanup;
+        in_order.kernel_seconds += seconds;
+        if (opts->verify)
+            mismatches += lookup_check(&lk, entries, first, count, lk.values, opts->verify_report);
+        if (!opts->reorder) {
+            printf("Batch %llu: %llu lookups, %f sec, %f M lookups/sec\n",
+                   (unsigned long long)b, (unsigned long long)count, seconds, count / seconds / 1e6);
+            continue;
+        }
+
+        tstart = now_seconds();
+        dram_reorder(&lk.model, entries, count, lk.num_blocks, lk.sorted, lk.perm, lk.scratch);
+        sort_seconds += now_seconds() - tstart;
+
+        if (lookup_batch(env, &lk, lk.sorted, count, lk.sorted_values, opts->verify, &sorted_seconds) != 0)
+            goto cleanup;
+        reordered.kernel_seconds += sorted_seconds;
+
+        //the result of sorted entry i answers request perm[i]
+        tstart = now_seconds();
+        for (uint64_t i=0; i<count; i++)
+            memcpy(lk.restored + lk.perm[i] * AP_BLOCK_BYTES, lk.sorted_values + i * AP_BLOCK_BYTES, AP_BLOCK_BYTES);
+        restore_seconds += now_seconds() - tstart;
+        if (opts->verify && memcmp(lk.restored, lk.values, count * AP_BLOCK_BYTES) != 0) {
+            printf("ERROR : reordered results of batch %llu differ from the in order run once restored\n",
+                   (unsigned long long)b);
+            unrestored++;
+        }
+
+        in_order.row_hits += dram_row_hits(&lk.model, entries, count, lk.num_blocks);
+        reordered.row_hits += dram_row_hits(&lk.model, lk.sorted, count, lk.num_blocks);
+        printf("Batch %llu: %llu lookups, %f sec in order, %f sec reordered (%.2fx)\n",
+               (unsigned long long)b, (unsigned long long)count, seconds, sorted_seconds,
+               seconds / sorted_seconds);
+    }
+
+    {
+        double dmbytes = 2.0 * num_entries * AP_BLOCK_BYTES / mb;
+        double rate = num_entries / in_order.kernel_seconds / 1e6;
+        printf("In order: %f M lookups/sec, %f MB/sec%s", rate, dmbytes / in_order.kernel_seconds,
+               opts->reorder ? "" : "\n");
+        if (opts->reorder) {
+            double host_seconds = sort_seconds + restore_seconds;
+            double serial = reordered.kernel_seconds + host_seconds;
+            double overlapped = (reordered.kernel_seconds > host_seconds) ? reordered.kernel_seconds : host_seconds;
+            printf(", model row hits %.1f%%\n", 100.0 * in_order.row_hits / num_entries);
+            printf("Reordered: %f M lookups/sec, %f MB/sec, model row hits %.1f%%\n",
+                   num_entries / reordered.kernel_seconds / 1e6, dmbytes / reordered.kernel_seconds,
+                   100.0 * reordered.row_hits / num_entries);
+            printf("Host stage: %f sec sorting (%f M entries/sec), %f sec restoring the request order\n",
+                   sort_seconds, num_entries / sort_seconds / 1e6, restore_seconds);
+            printf("Net: %f M lookups/sec with the host stage in series (%.2fx in order), "
+                   "%f M lookups/sec overlapped with the kernel (%.2fx)\n",
+                   num_entries / serial / 1e6, in_order.kernel_seconds / serial,
+                   num_entries / overlapped / 1e6, in_order.kernel_seconds / overlapped);
+        }
+    }
+
+    if (opts->verify)
+        printf("Verify lookups: %llu results checked, %llu mismatches, %llu batches not restored\n",
+               (unsigned long long)num_entries, (unsigned long long)mismatches,
+               (unsigned long long)unrestored);
+    ret = (mismatches == 0 && unrestored == 0) ? 0 : -2;
+
+cleanup:
+    lookup_release(env, &lk);
+    if (opts->trace != NULL)
+        mapped_file_close(&mf);
+    return ret;
+}
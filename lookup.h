@@ -0,0 +1,33 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : lookup.h
+Purpose             : Batched block lookups through the bandwidth_lookup
+                      kernel, optionally reordered by DRAM bank and row
+Revision History    : 2017.09.11
+******************************************************************************
+*/
+#ifndef LOOKUP_H
+#define LOOKUP_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_lookup
+//Look up the blocks of opts->trace, or of the opts->ap access pattern without
+//one, in batches of opts->trace_window entries. Each batch is written to the
+//device, run through bandwidth_lookup and its results read back and checked
+//in request order. With opts->reorder the batch is then sorted on the host
+//by the bank and row of the opts->dram_map model, run again, and the results
+//put back in request order through the permutation and compared with the
+//first run. The kernel rates of both orders, the modelled row buffer hit
+//rates and the host sort and restore time are reported, together with the
+//net rate with the host stage in series with the kernel and overlapped.
+//Return value
+// 0    Success
+//-1    File, allocation or OpenCL failure
+//-2    Lookup result mismatch
+int fpga_run_lookup(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : mapped_file.cpp
+Purpose             : Read only memory mapping of input files, xclbins and
+                      traces alike, instead of copying them into memory
+Revision History    : 2017.08.14
+******************************************************************************
+*/
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+int mapped_file_open(const char *filename, struct mapped_file *mf)
+{
+    struct stat st;
+    void *data;
+
+    memset(mf, 0, sizeof(*mf));
+    mf->fd = open(filename, O_RDONLY);
+    if (mf->fd < 0)
+        return -1;
+    if (fstat(mf->fd, &st) != 0) {
+        close(mf->fd);
+        mf->fd = -1;
+        return -1;
+    }
+    mf->size = st.st_size;
+    if (mf->size == 0)
+        return 0;
+
+    data = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, mf->fd, 0);
+    if (data == MAP_FAILED) {
+        close(mf->fd);
+        mf->fd = -1;
+        return -2;
+    }
+    madvise(data, mf->size, MADV_SEQUENTIAL);
+    mf->data = (const unsigned char *)data;
+    return 0;
+}
+
+void mapped_file_close(struct mapped_file *mf)
+{
+    if (mf->data != NULL)
+        munmap((void *)mf->data, mf->size);
+    if (mf->fd >= 0)
+        close(mf->fd);
+    memset(mf, 0, sizeof(*mf));
+    mf->fd = -1;
+}
@@ -0,0 +1,32 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : mapped_file.h
+Purpose             : Read only memory mapping of input files, xclbins and
+                      traces alike, instead of copying them into memory
+Revision History    : 2017.08.14
+******************************************************************************
+*/
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+struct mapped_file {
+    const unsigned char *data;
+    size_t              size;
+    int                 fd;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//mapped_file_open
+//Map filename read only, pages are faulted in on first touch and the kernel is
+//told the mapping is read sequentially
+//Return value
+// 0    Success
+//-1    Failure to open or stat the file
+//-2    Failure to map the file
+int mapped_file_open(const char *filename, struct mapped_file *mf);
+void mapped_file_close(struct mapped_file *mf);
+
+#endif
@@ -0,0 +1,227 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : multi_device.cpp
+Purpose             : Bandwidth mode run on several accelerators at once, one
+                      session and host thread per device
+Revision History    : 2017.08.30
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "multi_device.h"
+#include "cpu_backend.h"
+#include "session.h"
+
+//what a device thread does once released
+#define DEV_SETUP               0
+#define DEV_LAUNCH              1
+
+struct device_worker {
+    pthread_t               thread;
+    unsigned int            index;
+    int                     op;
+    const struct bench_options *opts;
+    struct cpu_start        *start;
+    struct fpga_session     session;
+    struct fpga_bandwidth   bw;
+    int                     opened;
+    int                     status;
+    double                  solo_seconds;
+    double                  seconds;
+    double                  tstart;
+    double                  tend;
+};
+
+static void *device_worker_run(void *arg)
+{
+    struct device_worker *w = (struct device_worker *)arg;
+
+    cpu_wait_start(w->start);
+    if (__atomic_load_n(&w->start->abort, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    w->tstart = now_seconds();
+    if (w->op == DEV_SETUP)
+        w->status = fpga_bandwidth_setup(&w->session.env, w->opts, w->opts->buffer_size, &w->bw);
+    else
+        w->status = fpga_bandwidth_launch(&w->session.env, &w->bw, w->opts, &w->seconds);
+    w->tend = now_seconds();
+    return NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//devices_parallel
+//Run op on every device from its own thread, started together
+//Return value
+// 0    Success
+//-1    Thread failure or op failed on a device
+
+static int devices_parallel(int op, struct device_worker *workers, unsigned int num_workers)
+{
+    struct cpu_start start;
+    unsigned int started = 0;
+    int ret = 0;
+
+    memset(&start, 0, sizeof(start));
+    for (unsigned int d=0; d<num_workers; d++) {
+        struct device_worker *w = &workers[d];
+        w->op = op;
+        w->start = &start;
+        if (pthread_create(&w->thread, NULL, device_worker_run, w) != 0) {
+            printf("Error: Failed to start device thread %u\n", d);
+            ret = -1;
+            break;
+        }
+        started++;
+    }
+    cpu_release_start(&start, started, ret != 0);
+
+    for (unsigned int d=0; d<started; d++) {
+        pthread_join(workers[d].thread, NULL);
+        if (ret == 0 && workers[d].status != 0) {
+            printf("Error: device #%u failed\n", workers[d].index);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static void devices_print_setup(const struct device_worker *workers, unsigned int num_workers)
+{
+    double tstart = 0, tend = 0, dmtotal = 0;
+
+    for (unsigned int d=0; d<num_workers; d++) {
+        const struct device_worker *w = &workers[d];
+        double dmfill = w->bw.layout.num_pairs * w->bw.pair_size / (((double)1024) * ((double)1024));
+        printf("Device #%u setup: %.1f MB of input in %f sec (%f MB/sec)\n",
+               w->index, dmfill, w->bw.setup_seconds, dmfill / w->bw.setup_seconds);
+        if (d == 0 || w->tstart < tstart)
+            tstart = w->tstart;
+        if (d == 0 || w->tend > tend)
+            tend = w->tend;
+        dmtotal += dmfill;
+    }
+    printf("All devices setup: %.1f MB in %f sec (%f MB/sec)\n",
+           dmtotal, tend - tstart, dmtotal / (tend - tstart));
+}
+
+static void devices_print_run(unsigned int run, const struct device_worker *workers,
+                              unsigned int num_workers, const struct bench_options *opts)
+{
+    double tstart = 0, tend = 0, last_start = 0, first_end = 0;
+    double min_seconds = 0, max_seconds = 0, sum_rate = 0, dmtotal = 0;
+
+    for (unsigned int d=0; d<num_workers; d++) {
+        const struct device_worker *w = &workers[d];
+        if (d == 0 || w->tstart < tstart)
+            tstart = w->tstart;
+        if (d == 0 || w->tstart > last_start)
+            last_start = w->tstart;
+        if (d == 0 || w->tend < first_end)
+            first_end = w->tend;
+        if (d == 0 || w->tend > tend)
+            tend = w->tend;
+        if (d == 0 || w->seconds < min_seconds)
+            min_seconds = w->seconds;
+        if (d == 0 || w->seconds > max_seconds)
+            max_seconds = w->seconds;
+    }
+
+    printf("Run %u on %u devices:\n", run, num_workers);
+    for (unsigned int d=0; d<num_workers; d++) {
+        const struct device_worker *w = &workers[d];
+        double dmbytes = 2 * fpga_bandwidth_bytes(&w->bw, opts) / (((double)1024) * ((double)1024));
+        printf("  Device #%u: %f sec, %f MB/sec, %.2f of solo, started +%.3f ms, done +%.3f ms\n",
+               w->index, w->seconds, dmbytes / w->seconds, w->solo_seconds / w->seconds,
+               (w->tstart - tstart) * 1e3, (w->tend - tstart) * 1e3);
+        sum_rate += dmbytes / w->seconds;
+        dmtotal += dmbytes;
+    }
+    printf("  Aggregate: %f MB/sec over %f sec wall, %f MB/sec summed over the devices\n",
+           dmtotal / (tend - tstart), tend - tstart, sum_rate);
+    printf("  Skew: launches %.3f ms apart, completions %.3f ms apart, kernel times %.1f%% apart\n",
+           (last_start - tstart) * 1e3, (tend - first_end) * 1e3,
+           100.0 * (max_seconds - min_seconds) / max_seconds);
+}
+
+int fpga_run_devices(const struct bench_options *opts, const char *target_device_name)
+{
+    const struct access_pattern *ap = &opts->ap;
+    struct device_worker *workers;
+    unsigned int num_workers;
+    int ret = -1;
+
+    int found = session_count_devices(target_device_name);
+    num_workers = (opts->num_devices > 0) ? opts->num_devices : (unsigned int)found;
+    if (num_workers == 0) {
+        printf("Error: no %s device found\n", target_device_name);
+        return -1;
+    }
+    for (unsigned int d=0; d<opts->num_devices; d++) {
+        if (opts->devices[d] >= (unsigned int)found) {
+            printf("Error: device #%u requested, %d %s devices found\n",
+                   opts->devices[d], found, target_device_name);
+            return -1;
+        }
+    }
+
+    workers = (struct device_worker *)calloc(num_workers, sizeof(struct device_worker));
+    if (workers == NULL)
+        return -1;
+    for (unsigned int d=0; d<num_workers; d++) {
+        struct device_worker *w = &workers[d];
+        w->index = (opts->num_devices > 0) ? opts->devices[d] : d;
+        w->opts = opts;
+        if (session_open(opts->xclbin, target_device_name, w->index, opts, &w->session) != 0)
+            goto cleanup;
+        w->opened = 1;
+    }
+
+    if (devices_parallel(DEV_SETUP, workers, num_workers) != 0)
+        goto cleanup;
+    devices_print_setup(workers, num_workers);
+
+    printf("Access pattern %s, seed %llu, %llu accesses of %u bytes on each device\n",
+           ap_pattern_name(ap->pattern), (unsigned long long)ap->seed,
+           (unsigned long long)ap->iterations, opts->access_bytes);
+
+    //each device alone first, the baseline of the shared runs
+    for (unsigned int d=0; d<num_workers; d++) {
+        struct device_worker *w = &workers[d];
+        for (unsigned int r=0; r<opts->warmup; r++) {
+            if (fpga_bandwidth_launch(&w->session.env, &w->bw, opts, &w->solo_seconds) != 0)
+                goto cleanup;
+        }
+        if (fpga_bandwidth_launch(&w->session.env, &w->bw, opts, &w->solo_seconds) != 0)
+            goto cleanup;
+        printf("Device #%u alone: %f sec, %f MB/sec\n", w->index, w->solo_seconds,
+               2 * fpga_bandwidth_bytes(&w->bw, opts) / (((double)1024) * ((double)1024)) / w->solo_seconds);
+    }
+
+    for (unsigned int run=1; run<=opts->runs; run++) {
+        if (devices_parallel(DEV_LAUNCH, workers, num_workers) != 0)
+            goto cleanup;
+        devices_print_run(run, workers, num_workers, opts);
+    }
+
+    ret = 0;
+    for (unsigned int d=0; d<num_workers && ret == 0; d++) {
+        struct device_worker *w = &workers[d];
+        ret = fpga_bandwidth_check(&w->session.env, &w->bw, opts);
+    }
+
+cleanup:
+    for (unsigned int d=0; d<num_workers; d++) {
+        struct device_worker *w = &workers[d];
+        if (!w->opened)
+            continue;
+        fpga_bandwidth_release(&w->bw);
+        session_close(&w->session);
+    }
+    free(workers);
+    return ret;
+}
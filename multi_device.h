@@ -0,0 +1,30 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : multi_device.h
+Purpose             : Bandwidth mode run on several accelerators at once, one
+                      session and host thread per device
+Revision History    : 2017.08.30
+******************************************************************************
+*/
+#ifndef MULTI_DEVICE_H
+#define MULTI_DEVICE_H
+
+#include "bench.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_devices
+//Open a session on each device of opts->devices, all devices named
+//target_device_name when the list is empty, and set up the bandwidth buffers
+//of every device from its own thread at the same time. Each device then runs
+//the access stream alone as its baseline, and opts->runs times together with
+//the others, the threads held on a start line until all are in place. Every
+//run reports per device and aggregate throughput, the share of the solo rate
+//each device kept and the skew of the host side launch and completion times.
+//Return value
+// 0    Success
+//-1    No device, allocation, thread or OpenCL failure
+//-2    Output mismatch
+int fpga_run_devices(const struct bench_options *opts, const char *target_device_name);
+
+#endif
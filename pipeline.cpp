@@ -0,0 +1,369 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : pipeline.cpp
+Purpose             : Chunked streaming mode overlapping PCIe transfers with
+                      kernel execution
+Revision History    : 2017.08.09
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "fill.h"
+#include "verify.h"
+#include "host_alloc.h"
+
+//pipeline stages, one in-order queue each
+#define PIPE_WRITE              0
+#define PIPE_KERNEL             1
+#define PIPE_READ               2
+#define PIPE_STAGES             3
+
+/////////////////////////////////////////////////////////////////////////////////
+//pipeline
+//Chunk n of the dataset uses device slot n % depth. Each chunk is split evenly
+//over the input/output buffer pairs of the bank layout, every pair copying
+//its own part of the chunk.
+struct pipeline {
+    struct fpga_env     *env;
+    size_t              total;
+    size_t              chunk;
+    uint64_t            num_chunks;
+    unsigned int        depth;
+    struct fpga_layout  layout;
+    cl_command_queue    queue[PIPE_STAGES];
+    cl_kernel           kernel;
+    cl_mem              input[PIPE_MAX_DEPTH][AP_MAX_PAIRS];
+    cl_mem              output[PIPE_MAX_DEPTH][AP_MAX_PAIRS];
+    unsigned char       *host_input;
+    unsigned char       *host_output;
+
+    //per chunk completion events of the last run, one per pair and chunk
+    //for the transfers and one per chunk for the kernel
+    cl_event            *write_events;
+    cl_event            *kernel_events;
+    cl_event            *read_events;
+};
+
+static size_t chunk_bytes(const struct pipeline *pl, uint64_t n)
+{
+    size_t offset = n * pl->chunk;
+    return (pl->total - offset < pl->chunk) ? pl->total - offset : pl->chunk;
+}
+
+static void release_event_list(cl_event *events, uint64_t count)
+{
+    for (uint64_t i=0; i<count; i++) {
+        if (events[i]) {
+            clReleaseEvent(events[i]);
+            events[i] = NULL;
+        }
+    }
+}
+
+static void pipeline_release_events(struct pipeline *pl)
+{
+    release_event_list(pl->write_events, pl->num_chunks * pl->layout.num_pairs);
+    release_event_list(pl->kernel_events, pl->num_chunks);
+    release_event_list(pl->read_events, pl->num_chunks * pl->layout.num_pairs);
+}
+
+static void pipeline_release(struct pipeline *pl)
+{
+    if (pl->write_events) {
+        pipeline_release_events(pl);
+        free(pl->write_events);
+        free(pl->kernel_events);
+        free(pl->read_events);
+    }
+    for (unsigned int s=0; s<PIPE_MAX_DEPTH; s++) {
+        for (unsigned int p=0; p<AP_MAX_PAIRS; p++) {
+            fpga_release_buffer(pl->env, pl->input[s][p]);
+            fpga_release_buffer(pl->env, pl->output[s][p]);
+        }
+    }
+    for (unsigned int q=0; q<PIPE_STAGES; q++) {
+        if (pl->queue[q])
+            clReleaseCommandQueue(pl->queue[q]);
+    }
+    fpga_release_kernel(pl->env, pl->kernel);
+    host_free(pl->host_input);
+    host_free(pl->host_output);
+    memset(pl, 0, sizeof(*pl));
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//pipeline_setup
+//Size the chunks, create the queues, kernel and slot buffers and fill the host
+//dataset with the i%256 pattern
+//Return value
+// 0    Success
+//-1    Error
+
+static int pipeline_setup(struct fpga_env *env, const struct bench_options *opts,
+                          struct pipeline *pl)
+{
+    size_t granule;
+    cl_int err;
+
+    memset(pl, 0, sizeof(*pl));
+    pl->env = env;
+    fpga_layout_init(opts, &pl->layout);
+    pl->layout.port_mode = AP_PORTS_REPLICATE;
+    granule = AP_BLOCK_BYTES * pl->layout.num_pairs;
+    pl->total = opts->buffer_size / granule * granule;
+    pl->chunk = (opts->chunk_size > 0) ? opts->chunk_size : pl->total / 16;
+    pl->chunk = pl->chunk / granule * granule;
+    if (pl->chunk < granule)
+        pl->chunk = granule;
+    if (pl->chunk > pl->total)
+        pl->chunk = pl->total;
+    pl->num_chunks = (pl->total + pl->chunk - 1) / pl->chunk;
+    pl->depth = opts->pipeline_depth;
+
+    if (pl->total == 0) {
+        printf("Error: pipeline dataset must hold at least %zu bytes\n", granule);
+        return -1;
+    }
+
+    for (unsigned int q=0; q<PIPE_STAGES; q++) {
+        pl->queue[q] = clCreateCommandQueue(env->context, env->device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+        if (!pl->queue[q] || err != CL_SUCCESS) {
+            printf("Error: Failed to create pipeline command queue %d\n", err);
+            return -1;
+        }
+    }
+
+    pl->kernel = fpga_create_kernel(env, "bandwidth", &err);
+    if (!pl->kernel || err != CL_SUCCESS) {
+        printf("Error: Failed to create compute kernel!\n");
+        return -1;
+    }
+
+    for (unsigned int s=0; s<pl->depth; s++) {
+        for (unsigned int p=0; p<pl->layout.num_pairs; p++) {
+            size_t part = pl->chunk / pl->layout.num_pairs;
+            cl_int err1;
+            pl->input[s][p] = fpga_create_bank_buffer(env, part, pl->layout.input_bank[p], &err);
+            pl->output[s][p] = fpga_create_bank_buffer(env, part, pl->layout.output_bank[p], &err1);
+            if (err != CL_SUCCESS || err1 != CL_SUCCESS) {
+                printf("Error: Failed to allocate pipeline slot buffers of size %zu\n", part);
+                return -1;
+            }
+        }
+    }
+
+    pl->write_events = (cl_event *)calloc(pl->num_chunks * pl->layout.num_pairs, sizeof(cl_event));
+    pl->kernel_events = (cl_event *)calloc(pl->num_chunks, sizeof(cl_event));
+    pl->read_events = (cl_event *)calloc(pl->num_chunks * pl->layout.num_pairs, sizeof(cl_event));
+    pl->host_input = (unsigned char *)host_alloc(pl->total, opts->host_pages, opts->host_node);
+    pl->host_output = (unsigned char *)host_alloc(pl->total, opts->host_pages, opts->host_node);
+    if (!pl->write_events || !pl->kernel_events || !pl->read_events ||
+        !pl->host_input || !pl->host_output) {
+        printf("Error: Failed to allocate the %zu byte host dataset\n", pl->total);
+        return -1;
+    }
+    fill_pattern(pl->host_input, pl->total, 0, opts->threads);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//pipeline_chunk
+//Enqueue write, kernel and read of chunk n. The write waits for the kernel
+//that last read the slot, the kernel waits for its inputs and for the read
+//that last drained its output slot, the read waits for the kernel. serial
+//finishes every command before the next one is enqueued.
+//Return value
+// 0    Success
+//-1    Error
+
+static int pipeline_chunk(struct pipeline *pl, uint64_t n, cl_command_queue *queue, int serial)
+{
+    unsigned int slot = n % pl->depth;
+    size_t offset = n * pl->chunk;
+    unsigned int pairs = pl->layout.num_pairs;
+    size_t part = chunk_bytes(pl, n) / pairs;
+    cl_event *write_ev = &pl->write_events[n * pairs];
+    cl_event *read_ev = &pl->read_events[n * pairs];
+    cl_event wait[2 * AP_MAX_PAIRS];
+    cl_uint num_wait;
+    cl_int err;
+
+    //host to device
+    num_wait = 0;
+    if (n >= pl->depth)
+        wait[num_wait++] = pl->kernel_events[n - pl->depth];
+    for (unsigned int p=0; p<pairs; p++) {
+        err = clEnqueueWriteBuffer(queue[PIPE_WRITE], pl->input[slot][p], CL_FALSE, 0, part,
+                                   pl->host_input + offset + p * part,
+                                   num_wait, wait, &write_ev[p]);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to write chunk %llu to the device %d\n", (unsigned long long)n, err);
+            return -1;
+        }
+    }
+    if (serial)
+        clFinish(queue[PIPE_WRITE]);
+    else
+        clFlush(queue[PIPE_WRITE]);
+
+    //kernel, one sequential pass copying every block of the chunk
+    cl_ulong num_blocks = part / AP_BLOCK_BYTES;
+    cl_uint shift = 0;
+    cl_uint pattern = AP_PATTERN_SEQUENTIAL;
+    cl_ulong seed = 0;
+    cl_ulong param = 0;
+    int arg_num = 0;
+    err  = fpga_set_pair_args(pl->kernel, &pl->layout, pl->input[slot], pl->output[slot], &arg_num);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_ulong), &num_blocks);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_uint),  &shift);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_uint),  &pl->layout.pair_shift);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_uint),  &pl->layout.port_mode);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_uint),  &pattern);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_ulong), &seed);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_ulong), &num_blocks);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_ulong), &param);
+    err |= clSetKernelArg(pl->kernel, arg_num++, sizeof(cl_ulong), &param);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to set kernel arguments! %d\n", err);
+        return -1;
+    }
+
+    num_wait = 0;
+    for (unsigned int p=0; p<pairs; p++)
+        wait[num_wait++] = write_ev[p];
+    if (n >= pl->depth) {
+        for (unsigned int p=0; p<pairs; p++)
+            wait[num_wait++] = pl->read_events[(n - pl->depth) * pairs + p];
+    }
+    size_t global[1] = {1};
+    size_t local[1] = {1};
+    err = clEnqueueNDRangeKernel(queue[PIPE_KERNEL], pl->kernel, 1, NULL, global, local,
+                                 num_wait, wait, &pl->kernel_events[n]);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to execute kernel %d\n", err);
+        return -1;
+    }
+    if (serial)
+        clFinish(queue[PIPE_KERNEL]);
+    else
+        clFlush(queue[PIPE_KERNEL]);
+
+    //device to host
+    for (unsigned int p=0; p<pairs; p++) {
+        err = clEnqueueReadBuffer(queue[PIPE_READ], pl->output[slot][p], CL_FALSE, 0, part,
+                                  pl->host_output + offset + p * part,
+                                  1, &pl->kernel_events[n], &read_ev[p]);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to read chunk %llu from the device %d\n", (unsigned long long)n, err);
+            return -1;
+        }
+    }
+    if (serial)
+        clFinish(queue[PIPE_READ]);
+    else
+        clFlush(queue[PIPE_READ]);
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//pipeline_run
+//Stream the whole dataset once, on the three queues of queue, and check the
+//data read back
+//Return value
+// 0    Success, *seconds holds the end to end wall time
+//-1    Error
+//-2    Mismatch found
+
+static int pipeline_run(struct pipeline *pl, const struct bench_options *opts,
+                        cl_command_queue *queue, int serial, const char *name, double *seconds)
+{
+    struct access_pattern copy;
+    struct verify_report report;
+    int ret = 0;
+    int err;
+
+    pipeline_release_events(pl);
+    memset(pl->host_output, 0, pl->total);
+
+    double start = now_seconds();
+    for (uint64_t n=0; n<pl->num_chunks && ret == 0; n++)
+        ret = pipeline_chunk(pl, n, queue, serial);
+    for (unsigned int q=0; q<PIPE_STAGES; q++)
+        clFinish(queue[q]);
+    *seconds = now_seconds() - start;
+    for (uint64_t n=0; n<pl->num_chunks && ret == 0; n++)
+        fpga_note_kernel(pl->env, event_seconds(pl->kernel_events[n]));
+    if (ret != 0 || !opts->verify || name == NULL)
+        return ret;
+
+    //the kernel copied every block, so the output must be the whole dataset
+    copy.pattern = AP_PATTERN_SEQUENTIAL;
+    copy.seed = 0;
+    copy.iterations = pl->total / AP_BLOCK_BYTES;
+    copy.param0 = 0;
+    copy.param1 = 0;
+    const unsigned char *output = pl->host_output;
+    const unsigned int bank = 0;
+    err = verify_touched(&output, &bank, 1, &copy, pl->total / AP_BLOCK_BYTES, AP_BLOCK_BYTES,
+                         opts->threads, opts->verify_report, &report);
+    verify_print(name, &report);
+    if (err == -2)
+        return -1;
+    return (err == 0) ? 0 : -2;
+}
+
+static double stage_seconds(const cl_event *events, uint64_t count)
+{
+    double seconds = 0;
+    for (uint64_t i=0; i<count; i++)
+        seconds += event_seconds(events[i]);
+    return seconds;
+}
+
+int fpga_run_pipeline(struct fpga_env *env, const struct bench_options *opts)
+{
+    struct pipeline pl;
+    cl_command_queue serial_queue[PIPE_STAGES];
+    double serial_seconds, pipe_seconds;
+    double dmtotal;
+    int ret = -1;
+
+    if (pipeline_setup(env, opts, &pl) != 0)
+        goto cleanup;
+    for (unsigned int q=0; q<PIPE_STAGES; q++)
+        serial_queue[q] = env->command_queue;
+
+    dmtotal = pl.total / (((double)1024) * ((double)1024));
+    printf("Pipeline: %.1f MB dataset in %llu chunks of %.1f MB, %u device slots per buffer\n",
+           dmtotal, (unsigned long long)pl.num_chunks,
+           pl.chunk / (((double)1024) * ((double)1024)), pl.depth);
+
+    for (unsigned int w=0; w<opts->warmup; w++) {
+        if (pipeline_run(&pl, opts, pl.queue, 0, NULL, &pipe_seconds) != 0)
+            goto cleanup;
+    }
+
+    ret = pipeline_run(&pl, opts, serial_queue, 1, "serialized output", &serial_seconds);
+    if (ret != 0)
+        goto cleanup;
+    printf("Serialized: %.1f MB end to end in %f sec (%f MB/sec)\n",
+           dmtotal, serial_seconds, dmtotal / serial_seconds);
+
+    ret = pipeline_run(&pl, opts, pl.queue, 0, "pipelined output", &pipe_seconds);
+    if (ret != 0)
+        goto cleanup;
+    printf("Pipelined:  %.1f MB end to end in %f sec (%f MB/sec), %.2fx the serialized rate\n",
+           dmtotal, pipe_seconds, dmtotal / pipe_seconds, serial_seconds / pipe_seconds);
+    printf("Pipelined stage busy time: PCIe write %f sec, kernel %f sec, PCIe read %f sec\n",
+           stage_seconds(pl.write_events, pl.num_chunks * pl.layout.num_pairs),
+           stage_seconds(pl.kernel_events, pl.num_chunks),
+           stage_seconds(pl.read_events, pl.num_chunks * pl.layout.num_pairs));
+
+cleanup:
+    pipeline_release(&pl);
+    return ret;
+}
@@ -0,0 +1,34 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : pipeline.h
+Purpose             : Chunked streaming mode overlapping PCIe transfers with
+                      kernel execution
+Revision History    : 2017.08.09
+******************************************************************************
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+//most device buffer slots per input/output buffer
+#define PIPE_MAX_DEPTH          8
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_pipeline
+//Stream a host dataset of opts->buffer_size bytes through the bandwidth kernel
+//in chunks of opts->chunk_size. Every chunk is written to the device, copied
+//block by block by the kernel and read back. Chunks rotate through
+//opts->pipeline_depth device buffer slots, and the three stages run on their
+//own in-order queues chained by events, so the write of chunk N+1, the kernel
+//of chunk N and the read of chunk N-1 overlap. The same chunks are first run
+//serialized on one queue as the baseline.
+//Return value
+// 0    Success
+//-1    Allocation or OpenCL failure
+//-2    Data read back differs from the dataset
+int fpga_run_pipeline(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
@@ -0,0 +1,84 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : profile.cpp
+Purpose             : Event profiling of the map, unmap and kernel phases
+Revision History    : 2017.07.27
+******************************************************************************
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "profile.h"
+
+void profile_reset(struct profile_log *log)
+{
+    log->count = 0;
+    log->dropped = 0;
+}
+
+void profile_record(struct profile_log *log, const char *name, int kind,
+                    uint64_t bytes, cl_event event)
+{
+    struct profile_phase *p;
+
+    if (event == NULL)
+        return;
+    if (log->count == PROFILE_MAX_PHASES) {
+        log->dropped++;
+        return;
+    }
+    p = &log->phases[log->count++];
+    strncpy(p->name, name, sizeof(p->name) - 1);
+    p->name[sizeof(p->name) - 1] = 0;
+    p->kind = kind;
+    p->bytes = bytes;
+
+    clWaitForEvents(1, &event);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &p->queued, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &p->submit, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,  sizeof(cl_ulong), &p->start,  NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,    sizeof(cl_ulong), &p->end,    NULL);
+}
+
+void profile_print(const struct profile_log *log)
+{
+    static const char *kind_names[PHASE_KINDS] = {
+        "PCIe write (host to device)", "Kernel", "PCIe read (device to host)", "Other"
+    };
+    uint64_t bytes[PHASE_KINDS];
+    double seconds[PHASE_KINDS];
+    cl_ulong origin;
+
+    if (log->count == 0)
+        return;
+
+    origin = log->phases[0].queued;
+    for (unsigned int i=1; i<log->count; i++) {
+        if (log->phases[i].queued < origin)
+            origin = log->phases[i].queued;
+    }
+
+    memset(bytes, 0, sizeof(bytes));
+    memset(seconds, 0, sizeof(seconds));
+    printf("Phase                     MB     queued(us) ->submit(us)  ->start(us)    ->end(us)\n");
+    for (unsigned int i=0; i<log->count; i++) {
+        const struct profile_phase *p = &log->phases[i];
+        printf("%-20s %9.1f %12.1f %12.1f %12.1f %12.1f\n", p->name,
+               p->bytes / (((double)1024) * ((double)1024)),
+               (p->queued - origin) / 1000.0, (p->submit - p->queued) / 1000.0,
+               (p->start - p->submit) / 1000.0, (p->end - p->start) / 1000.0);
+        bytes[p->kind] += p->bytes;
+        seconds[p->kind] += (p->end - p->start) / ((double) 1000000000);
+    }
+    if (log->dropped > 0)
+        printf("(%u further phases not recorded)\n", log->dropped);
+
+    for (int k=0; k<PHASE_OTHER; k++) {
+        double dmbytes = bytes[k] / (((double)1024) * ((double)1024));
+        if (seconds[k] <= 0)
+            continue;
+        printf("%s: %.1f MB, duration %f sec, bandwidth %f MB/sec\n",
+               kind_names[k], dmbytes, seconds[k], dmbytes / seconds[k]);
+    }
+}
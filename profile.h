@@ -0,0 +1,52 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : profile.h
+Purpose             : Event profiling of the map, unmap and kernel phases of
+                      an FPGA run, with byte accounting per phase
+Revision History    : 2017.07.27
+******************************************************************************
+*/
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <CL/opencl.h>
+
+//what a profiled command moved
+#define PHASE_HOST_TO_DEVICE    0
+#define PHASE_KERNEL            1
+#define PHASE_DEVICE_TO_HOST    2
+#define PHASE_OTHER             3
+#define PHASE_KINDS             4
+
+#define PROFILE_MAX_PHASES      64
+
+struct profile_phase {
+    char        name[32];
+    int         kind;
+    uint64_t    bytes;
+    cl_ulong    queued;
+    cl_ulong    submit;
+    cl_ulong    start;
+    cl_ulong    end;
+};
+
+struct profile_log {
+    unsigned int            count;
+    unsigned int            dropped;
+    struct profile_phase    phases[PROFILE_MAX_PHASES];
+};
+
+void profile_reset(struct profile_log *log);
+
+//wait for event and keep its queued/submit/start/end timestamps, the caller
+//still owns and releases event
+void profile_record(struct profile_log *log, const char *name, int kind,
+                    uint64_t bytes, cl_event event);
+
+//print every phase relative to the first queued command, then the effective
+//host to device, kernel and device to host bandwidth
+void profile_print(const struct profile_log *log);
+
+#endif
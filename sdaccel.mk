@@ -46,17 +46,20 @@ $(error Environment variable XILINX_SDX is required and should point to SDAccel
 endif
 
 SDA_FLOW = cpu_emu
-HOST_SRCS = kernel_global_bandwidth.cpp
+HOST_SRCS = kernel_global_bandwidth.cpp bench.cpp cpu_backend.cpp latency.cpp sweep.cpp profile.cpp fill.cpp verify.cpp pipeline.cpp trace.cpp mapped_file.cpp gups.cpp dataflow.cpp session.cpp multi_device.cpp transfer.cpp host_alloc.cpp contention.cpp steady.cpp dram_order.cpp lookup.cpp
 HOST_EXE_DIR = ./
 HOST_EXE = host_global_bandwidth
 HOST_CFLAGS = -g -Wall -DFPGA_DEVICE 
-HOST_LFLAGS = 
+HOST_LFLAGS = -lpthread -lm
 
 KERNEL_SRCS = kernel.cl
 KERNEL_NAME = bandwidth
+#-DBW_CACHE_LINES=<n> [-DBW_CACHE_WAYS=<w>] adds the bandwidth_cached kernel
+#-DBW_STATS adds the instrumented bandwidth_stats and bandwidth_clock kernels, any SDA_FLOW
 KERNEL_DEFS = 
-KERNEL_INCS = 
+KERNEL_INCS = -I.
 CLCC_OPT_LEVEL=-O3
+#compute units of bandwidth_unit for the units mode, e.g. CLCC_OPT += --nk bandwidth_unit:8
 #set target device for XCLBIN
 XDEVICE=xilinx:adm-pcie-7v3:1ddr:3.0
 XDEVICE_REPO_PATH=
@@ -0,0 +1,363 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : session.cpp
+Purpose             : Device session owning the OpenCL handles, kernels and a
+                      pool of device buffers reused across benchmark runs
+Revision History    : 2017.08.28
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "session.h"
+#include "mapped_file.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//opencl_setup
+//Create context for Xilinx platform, Accelerator device
+//Create single command queue for accelerator device
+//Create program object with clCreateProgramWithBinary using given xclbin file
+//name, mapped for the call instead of copied into memory. device_index picks
+//the device_index-th device named target_device_name, -1 the last one.
+//Return value
+// 0    Success
+//-1    Error
+//-2    Failed to map XCLBIN file
+//-3    Failed to clCreateProgramWithBinary
+static int opencl_setup(const char *xclbinfilename, cl_platform_id *platform_id, 
+                        cl_device_id *devices, cl_device_id *device_id, cl_context  *context, 
+                        cl_command_queue *command_queue, cl_program *program, 
+                        char *cl_platform_name, const char *target_device_name,
+                        int device_index, size_t *xclbin_size) {
+
+    char cl_platform_vendor[1001];
+    char cl_device_name[1001];
+    cl_int err;
+    cl_uint num_devices;
+    unsigned int device_found = 0;
+    int matched = 0;
+
+    // Get first platform
+    err = clGetPlatformIDs(1,platform_id,NULL);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to find an OpenCL platform!\n");
+        printf("ERROR: Test failed\n");
+        return -1;
+    }
+    err = clGetPlatformInfo(*platform_id,CL_PLATFORM_VENDOR,sizeof(cl_platform_vendor),(void *)cl_platform_vendor,NULL);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: clGetPlatformInfo(CL_PLATFORM_VENDOR) failed!\n");
+        printf("ERROR: Test failed\n");
+        return -1;
+    }
+    printf("CL_PLATFORM_VENDOR %s\n",cl_platform_vendor);
+    err = clGetPlatformInfo(*platform_id,CL_PLATFORM_NAME,1000,(void *)cl_platform_name,NULL);
+    if (err != CL_SUCCESS) {
+            printf("ERROR: clGetPlatformInfo(CL_PLATFORM_NAME) failed!\n");
+            printf("ERROR: Test failed\n");
+            return -1;
+    }
+    printf("CL_PLATFORM_NAME %s\n",cl_platform_name);
+
+    // Get Accelerator compute device
+    err = clGetDeviceIDs(*platform_id, CL_DEVICE_TYPE_ACCELERATOR, 16, devices, &num_devices);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to create a device group!\n");
+        printf("ERROR: Test failed\n");
+        return -1;
+    }
+    if (num_devices > 16)
+        num_devices = 16;
+
+    //iterate all devices to select the target device. 
+    for (cl_uint i=0; i<num_devices; i++) {
+        err = clGetDeviceInfo(devices[i], CL_DEVICE_NAME, sizeof(cl_device_name), cl_device_name, 0);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to get device name for device %u!\n", i);
+            printf("Test failed\n");
+            return EXIT_FAILURE;
+        }
+        //printf("CL_DEVICE_NAME %s\n", cl_device_name);
+        if(strcmp(cl_device_name, target_device_name) == 0) {
+            if (device_index < 0 || matched == device_index) {
+                *device_id = devices[i];
+                device_found = 1;
+                printf("Selected %s #%d as the target device\n", cl_device_name, matched);
+            }
+            matched++;
+        }
+    }
+    
+    if (!device_found) {
+        printf("Target device %s not found. Exit.\n", target_device_name);
+        return EXIT_FAILURE;
+    }
+
+    // Create a compute context containing accelerator device
+    (*context)= clCreateContext(0, 1, device_id, NULL, NULL, &err);
+    if (!(*context))
+        {
+            printf("ERROR: Failed to create a compute context!\n");
+            printf("ERROR: Test failed\n");
+            return -1;
+        }
+
+    // Create a command queue for accelerator device
+    (*command_queue) = clCreateCommandQueue(*context, *device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (!(*command_queue))
+        {
+            printf("ERROR: Failed to create a command commands!\n");
+            printf("ERROR: code %d\n",err);
+            printf("ERROR: Test failed\n");
+            return -1;
+        }
+
+    // Map XCLBIN file binary, the runtime keeps its own copy
+    int status;
+    struct mapped_file xclbin;
+    printf("loading %s\n", xclbinfilename);
+    if (mapped_file_open(xclbinfilename, &xclbin) != 0) {
+        printf("ERROR: failed to load kernel from xclbin: %s\n", xclbinfilename);
+        printf("ERROR: Test failed\n");
+        return -2;
+    }
+    const unsigned char *kernelbinary = xclbin.data;
+    size_t xclbinlength = xclbin.size;
+    *xclbin_size = xclbinlength;
+
+    // Create the program from XCLBIN file, configuring accelerator device
+    (*program) = clCreateProgramWithBinary(*context, 1, device_id, &xclbinlength, &kernelbinary, &status, &err);
+    mapped_file_close(&xclbin);
+    if ((!(*program)) || (err!=CL_SUCCESS)) {
+        printf("ERROR: Failed to create compute program from binary %d!\n", err);
+        printf("ERROR: Test failed\n");
+        return -3;
+    }
+
+    // Build the program executable (no-op)
+    err = clBuildProgram(*program, 0, NULL, NULL, NULL, NULL);
+    if (err != CL_SUCCESS) {
+            size_t len;
+            char buffer[2048];
+            printf("ERROR: Failed to build program executable!\n");
+            clGetProgramBuildInfo(*program, *device_id, CL_PROGRAM_BUILD_LOG, sizeof(buffer), buffer, &len);
+            printf("%s\n", buffer);
+            printf("ERROR: Test failed\n");
+            return -1;
+    }
+
+    return 0;
+}
+
+int session_count_devices(const char *target_device_name)
+{
+    cl_platform_id platform_id;
+    cl_device_id devices[16];
+    char cl_device_name[1001];
+    cl_uint num_devices;
+    int matched = 0;
+
+    if (clGetPlatformIDs(1, &platform_id, NULL) != CL_SUCCESS ||
+        clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_ACCELERATOR, 16, devices, &num_devices) != CL_SUCCESS)
+        return 0;
+    if (num_devices > 16)
+        num_devices = 16;
+    for (cl_uint i=0; i<num_devices; i++) {
+        if (clGetDeviceInfo(devices[i], CL_DEVICE_NAME, sizeof(cl_device_name), cl_device_name, 0) == CL_SUCCESS &&
+            strcmp(cl_device_name, target_device_name) == 0)
+            matched++;
+    }
+    return matched;
+}
+
+int session_open(const char *xclbinfilename, const char *target_device_name,
+                 int device_index, const struct bench_options *opts, struct fpga_session *s)
+{
+    cl_device_id devices[16];  // compute device id 
+    char cl_platform_name[1001];
+    int err;
+
+    memset(s, 0, sizeof(*s));
+    s->open_start = now_seconds();
+    err = opencl_setup(xclbinfilename, &s->env.platform_id, devices, &s->env.device_id,
+                       &s->env.context, &s->env.command_queue, &s->env.program,
+                       cl_platform_name, target_device_name, device_index, &s->xclbin_size);
+    if(err==-1){
+        printf("Error : general failure setting up opencl context\n");
+        return -1;
+    }
+    if(err==-2) {
+        printf("Error : failed to bandwidth.xclbin from disk\n");
+        return -2;
+    }
+    if(err==-3) {
+        printf("Error : failed to clCreateProgramWithBinary with contents of xclbin\n");
+        return -3;
+    }
+    if (err != 0)
+        return -1;
+    s->env.num_banks = opts->banks;
+    if (clGetDeviceInfo(s->env.device_id, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(s->env.max_alloc),
+                        &s->env.max_alloc, NULL) != CL_SUCCESS)
+        s->env.max_alloc = 0;
+    if (opts->tile_size > 0 && (s->env.max_alloc == 0 || opts->tile_size < s->env.max_alloc))
+        s->env.max_alloc = opts->tile_size;
+    s->env.session = s;
+    s->open_seconds = now_seconds() - s->open_start;
+    return 0;
+}
+
+void session_close(struct fpga_session *s)
+{
+    for (unsigned int i=0; i<s->num_buffers; i++)
+        clReleaseMemObject(s->buffers[i].mem);
+    for (unsigned int i=0; i<s->num_kernels; i++)
+        clReleaseKernel(s->kernels[i].kernel);
+    if (s->env.program)
+        clReleaseProgram(s->env.program);
+    if (s->env.command_queue)
+        clReleaseCommandQueue(s->env.command_queue);
+    if (s->env.context)
+        clReleaseContext(s->env.context);
+    memset(s, 0, sizeof(*s));
+}
+
+void session_run_begin(struct fpga_session *s)
+{
+    s->run_start = now_seconds();
+    s->run_kernel_seconds = 0;
+}
+
+void session_run_end(struct fpga_session *s)
+{
+    double seconds = now_seconds() - s->run_start;
+
+    if (s->runs == 0) {
+        s->first_run_seconds = seconds;
+        s->first_run_kernel_seconds = s->run_kernel_seconds;
+    } else {
+        s->later_run_seconds += seconds;
+        s->later_run_kernel_seconds += s->run_kernel_seconds;
+    }
+    s->runs++;
+    printf("Run %u: %f sec, %f sec in kernels, %f sec overhead\n", s->runs, seconds,
+           s->run_kernel_seconds, seconds - s->run_kernel_seconds);
+}
+
+void session_print(const struct fpga_session *s)
+{
+    size_t pooled = 0;
+
+    for (unsigned int i=0; i<s->num_buffers; i++)
+        pooled += s->buffers[i].size;
+    printf("Session: opened in %f sec with a %.1f MB mapped xclbin, first kernel done %f sec after open\n",
+           s->open_seconds, s->xclbin_size / (((double)1024) * ((double)1024)), s->first_kernel);
+    if (s->runs > 0)
+        printf("Session: first run overhead %f sec of %f sec\n",
+               s->first_run_seconds - s->first_run_kernel_seconds, s->first_run_seconds);
+    if (s->runs > 1)
+        printf("Session: later runs overhead %f sec of %f sec on average over %u runs\n",
+               (s->later_run_seconds - s->later_run_kernel_seconds) / (s->runs - 1),
+               s->later_run_seconds / (s->runs - 1), s->runs - 1);
+    printf("Session: %u device buffers pooled (%.1f MB), %u created, %u reused\n",
+           s->num_buffers, pooled / (((double)1024) * ((double)1024)),
+           s->buffers_created, s->buffers_reused);
+}
+
+void session_note_kernel(struct fpga_session *s, double seconds)
+{
+    if (s->first_kernel == 0)
+        s->first_kernel = now_seconds() - s->open_start;
+    s->run_kernel_seconds += seconds;
+}
+
+cl_mem session_take_buffer(struct fpga_session *s, size_t size, unsigned int bank, int *filled)
+{
+    for (unsigned int i=0; i<s->num_buffers; i++) {
+        struct session_buffer *b = &s->buffers[i];
+        if (b->in_use || b->size != size || b->bank != bank)
+            continue;
+        b->in_use = 1;
+        *filled = b->filled;
+        b->filled = 0;
+        s->buffers_reused++;
+        return b->mem;
+    }
+    *filled = 0;
+    return NULL;
+}
+
+void session_add_buffer(struct fpga_session *s, cl_mem mem, size_t size, unsigned int bank)
+{
+    s->buffers_created++;
+    if (s->num_buffers == SESSION_MAX_BUFFERS)
+        return;
+    struct session_buffer *b = &s->buffers[s->num_buffers++];
+    b->mem = mem;
+    b->size = size;
+    b->bank = bank;
+    b->in_use = 1;
+    b->filled = 0;
+}
+
+int session_give_buffer(struct fpga_session *s, cl_mem mem)
+{
+    for (unsigned int i=0; i<s->num_buffers; i++) {
+        if (s->buffers[i].mem == mem) {
+            s->buffers[i].in_use = 0;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void session_mark_filled(struct fpga_session *s, cl_mem mem)
+{
+    for (unsigned int i=0; i<s->num_buffers; i++) {
+        if (s->buffers[i].mem == mem)
+            s->buffers[i].filled = 1;
+    }
+}
+
+void session_trim_buffers(struct fpga_session *s)
+{
+    unsigned int kept = 0;
+
+    for (unsigned int i=0; i<s->num_buffers; i++) {
+        if (s->buffers[i].in_use)
+            s->buffers[kept++] = s->buffers[i];
+        else
+            clReleaseMemObject(s->buffers[i].mem);
+    }
+    s->num_buffers = kept;
+}
+
+cl_kernel session_kernel(struct fpga_session *s, const char *name, cl_int *err)
+{
+    cl_kernel kernel;
+
+    for (unsigned int i=0; i<s->num_kernels; i++) {
+        if (strcmp(s->kernels[i].name, name) == 0) {
+            *err = CL_SUCCESS;
+            return s->kernels[i].kernel;
+        }
+    }
+    kernel = clCreateKernel(s->env.program, name, err);
+    if (!kernel || *err != CL_SUCCESS || s->num_kernels == SESSION_MAX_KERNELS)
+        return kernel;
+    struct session_kernel *k = &s->kernels[s->num_kernels++];
+    k->kernel = kernel;
+    snprintf(k->name, sizeof(k->name), "%s", name);
+    return kernel;
+}
+
+int session_give_kernel(struct fpga_session *s, cl_kernel kernel)
+{
+    for (unsigned int i=0; i<s->num_kernels; i++) {
+        if (s->kernels[i].kernel == kernel)
+            return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,108 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : session.h
+Purpose             : Device session owning the OpenCL handles, kernels and a
+                      pool of device buffers reused across benchmark runs
+Revision History    : 2017.08.28
+******************************************************************************
+*/
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+//most buffers and kernels a session keeps, more are created unpooled
+#define SESSION_MAX_BUFFERS     64
+#define SESSION_MAX_KERNELS     16
+
+struct session_buffer {
+    cl_mem          mem;
+    size_t          size;
+    unsigned int    bank;
+    int             in_use;
+    int             filled;
+};
+
+struct session_kernel {
+    cl_kernel       kernel;
+    char            name[32];
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_session
+//Everything opened once per process and shared by all runs: the env handed
+//to the run modes, the kernels they created by name and the device buffers
+//they released, keyed by size and bank. Times are seconds since open started.
+struct fpga_session {
+    struct fpga_env         env;
+    size_t                  xclbin_size;
+
+    struct session_buffer   buffers[SESSION_MAX_BUFFERS];
+    unsigned int            num_buffers;
+    unsigned int            buffers_created;
+    unsigned int            buffers_reused;
+    struct session_kernel   kernels[SESSION_MAX_KERNELS];
+    unsigned int            num_kernels;
+
+    double                  open_start;
+    double                  open_seconds;
+    double                  first_kernel;
+    unsigned int            runs;
+    double                  run_start;
+    double                  run_kernel_seconds;
+    double                  first_run_seconds;
+    double                  first_run_kernel_seconds;
+    double                  later_run_seconds;
+    double                  later_run_kernel_seconds;
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//session_open
+//Select the device_index-th device named target_device_name, or the last one
+//for -1, create the context and in-order profiling queue and create the
+//program from the xclbin, mapped instead of read into memory
+//Return value
+// 0    Success
+//-1    Error
+//-2    Failed to map XCLBIN file
+//-3    Failed to clCreateProgramWithBinary
+int session_open(const char *xclbinfilename, const char *target_device_name,
+                 int device_index, const struct bench_options *opts, struct fpga_session *s);
+
+//number of accelerators named target_device_name, 0 when there is no platform
+int session_count_devices(const char *target_device_name);
+void session_close(struct fpga_session *s);
+
+//bracket one benchmark run, session_run_end prints its wall and kernel time
+void session_run_begin(struct fpga_session *s);
+void session_run_end(struct fpga_session *s);
+
+//time to first kernel, per run overhead and buffer reuse of the session
+void session_print(const struct fpga_session *s);
+
+//record a finished kernel of seconds
+void session_note_kernel(struct fpga_session *s, double seconds);
+
+//a free pooled buffer of size in bank, marked in use, or NULL. *filled tells
+//whether it still holds the fill pattern, the mark is cleared on take.
+cl_mem session_take_buffer(struct fpga_session *s, size_t size, unsigned int bank, int *filled);
+//pool a new buffer in use, ignored when the pool is full
+void session_add_buffer(struct fpga_session *s, cl_mem mem, size_t size, unsigned int bank);
+//Return value
+// 0    mem is pooled and now free
+//-1    mem is not pooled
+int session_give_buffer(struct fpga_session *s, cl_mem mem);
+void session_mark_filled(struct fpga_session *s, cl_mem mem);
+//release the free pooled buffers, to make room on the device
+void session_trim_buffers(struct fpga_session *s);
+
+//kernel of the program by name, created on first use
+cl_kernel session_kernel(struct fpga_session *s, const char *name, cl_int *err);
+//Return value
+// 0    kernel is owned by the session
+//-1    kernel is not pooled
+int session_give_kernel(struct fpga_session *s, cl_kernel kernel);
+
+#endif
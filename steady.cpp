@@ -0,0 +1,159 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : steady.cpp
+Purpose             : Time bounded steady state mode keeping batches of
+                      chained bandwidth launches in flight
+Revision History    : 2017.09.08
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "steady.h"
+
+//what the completed launches of a steady state run add up to
+struct steady_stats {
+    uint64_t    launches;
+    cl_ulong    first_start;
+    cl_ulong    last_end;
+    double      kernel_seconds;
+    double      gap_seconds;
+    double      max_gap;
+    double      latency_seconds;
+};
+
+//account the profiling timestamps of a completed launch, return its kernel
+//time in seconds
+static double steady_account(struct steady_stats *st, cl_event event)
+{
+    cl_ulong queued, start, end;
+
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,  sizeof(start),  &start,  NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,    sizeof(end),    &end,    NULL);
+
+    if (st->launches == 0) {
+        st->first_start = start;
+    } else {
+        double gap = (start > st->last_end) ? (start - st->last_end) / 1e9 : 0;
+        st->gap_seconds += gap;
+        if (gap > st->max_gap)
+            st->max_gap = gap;
+    }
+    st->latency_seconds += (start > queued) ? (start - queued) / 1e9 : 0;
+    st->kernel_seconds += (end - start) / 1e9;
+    st->last_end = end;
+    st->launches++;
+    return (end - start) / 1e9;
+}
+
+int fpga_run_steady(struct fpga_env *env, const struct bench_options *opts)
+{
+    const struct access_pattern *ap = &opts->ap;
+    struct fpga_bandwidth bw;
+    struct steady_stats st;
+    cl_command_queue queue = NULL;
+    cl_kernel kernel;
+    cl_event *events = NULL;
+    double mb = ((double)1024) * ((double)1024);
+    double single_seconds, single_wall, dmlaunch, tstart, wall, span;
+    uint64_t launched = 0, completed = 0;
+    size_t global[1] = {1};
+    size_t local[1] = {1};
+    int stopping = 0, failed = 0;
+    int ret = -1;
+    cl_int err;
+
+    memset(&st, 0, sizeof(st));
+    if (fpga_bandwidth_setup(env, opts, opts->buffer_size, &bw) != 0)
+        goto cleanup;
+    printf("Access pattern %s, seed %llu, %llu accesses of %u bytes per launch\n",
+           ap_pattern_name(ap->pattern), (unsigned long long)ap->seed,
+           (unsigned long long)ap->iterations, opts->access_bytes);
+
+    //pooled output buffers still hold what an earlier run wrote
+    if (opts->verify && fpga_bandwidth_clear_outputs(env, &bw) != 0)
+        goto cleanup;
+
+    //the single launch every other mode reports
+    dmlaunch = 2 * fpga_bandwidth_bytes(&bw, opts) / mb;
+    single_wall = now_seconds();
+    if (fpga_bandwidth_launch(env, &bw, opts, &single_seconds) != 0)
+        goto cleanup;
+    single_wall = now_seconds() - single_wall;
+    printf("Single launch: %f sec kernel, %f sec wall, %f MB/sec of kernel time, %f MB/sec of wall\n",
+           single_seconds, single_wall, dmlaunch / single_seconds, dmlaunch / single_wall);
+
+    kernel = fpga_bandwidth_kernel(env, &bw, opts);
+    if (kernel == NULL)
+        goto cleanup;
+    queue = clCreateCommandQueue(env->context, env->device_id,
+                                 CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+    if (!queue || err != CL_SUCCESS) {
+        printf("Error: Failed to create steady state command queue %d\n", err);
+        goto cleanup;
+    }
+    events = (cl_event *)calloc(opts->in_flight, sizeof(cl_event));
+    if (events == NULL)
+        goto cleanup;
+
+    printf("Steady state for %.1f sec, %u launches in flight enqueued %u at a time\n",
+           opts->duration, opts->in_flight, opts->batch);
+    tstart = now_seconds();
+    while (!stopping || completed < launched) {
+        //enqueue a batch whenever it fits behind the launches in flight, the
+        //queue is out of order so the event chain alone keeps them in order
+        if (!stopping && launched - completed + opts->batch <= opts->in_flight) {
+            for (unsigned int b=0; b<opts->batch; b++) {
+                cl_event *prev = (completed < launched) ? &events[(launched - 1) % opts->in_flight] : NULL;
+                err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, global, local,
+                                             prev ? 1 : 0, prev, &events[launched % opts->in_flight]);
+                if (err != CL_SUCCESS) {
+                    printf("ERROR: Failed to execute kernel %d\n", err);
+                    failed = 1;
+                    break;
+                }
+                launched++;
+            }
+            clFlush(queue);
+            if (failed || now_seconds() - tstart >= opts->duration)
+                stopping = 1;
+            continue;
+        }
+
+        //otherwise retire the oldest launch
+        cl_event *oldest = &events[completed % opts->in_flight];
+        clWaitForEvents(1, oldest);
+        fpga_note_kernel(env, steady_account(&st, *oldest));
+        clReleaseEvent(*oldest);
+        *oldest = NULL;
+        completed++;
+    }
+    clFinish(queue);
+    wall = now_seconds() - tstart;
+    if (failed || completed == 0)
+        goto cleanup;
+
+    span = (st.last_end - st.first_start) / 1e9;
+    printf("Steady state: %llu launches in %f sec wall, %f sec from the first start to the last end\n",
+           (unsigned long long)completed, wall, span);
+    printf("Steady state: %f M accesses/sec, %f MB/sec, %.2f times the single launch wall rate\n",
+           completed * ap->iterations / span / 1e6, completed * dmlaunch / span,
+           (completed * dmlaunch / span) / (dmlaunch / single_wall));
+    printf("Per launch: %f ms kernel, %f us idle between launches (max %f us), %f ms from enqueue to start\n",
+           1e3 * st.kernel_seconds / completed,
+           (completed > 1) ? 1e6 * st.gap_seconds / (completed - 1) : 0.0, 1e6 * st.max_gap,
+           1e3 * st.latency_seconds / completed);
+    printf("Device busy %.1f%% of the span\n", 100.0 * st.kernel_seconds / span);
+
+    ret = fpga_bandwidth_check(env, &bw, opts);
+
+cleanup:
+    free(events);
+    if (queue)
+        clReleaseCommandQueue(queue);
+    fpga_bandwidth_release(&bw);
+    return ret;
+}
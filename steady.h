@@ -0,0 +1,32 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : steady.h
+Purpose             : Time bounded steady state mode keeping batches of
+                      chained bandwidth launches in flight
+Revision History    : 2017.09.08
+******************************************************************************
+*/
+#ifndef STEADY_H
+#define STEADY_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_steady
+//Run one bandwidth launch as the single launch reference, then keep up to
+//opts->in_flight launches of the same access stream queued, enqueued
+//opts->batch at a time with each launch waiting on the event of the one
+//before, until opts->duration seconds have passed. The launches are accounted
+//from their profiling timestamps as they complete: steady state accesses/sec
+//and bandwidth over the span from the first start to the last end, and the
+//per launch kernel time, device idle gap between launches and enqueue to
+//start latency.
+//Return value
+// 0    Success
+//-1    Allocation or OpenCL failure
+//-2    Output mismatch
+int fpga_run_steady(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
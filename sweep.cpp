@@ -0,0 +1,191 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : sweep.cpp
+Purpose             : Working set and access width sweep of the bandwidth mode
+Revision History    : 2017.07.24
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sweep.h"
+#include "cpu_backend.h"
+
+struct sweep_stats {
+    double      median;
+    double      min;
+    double      stddev;
+};
+
+static int sweep_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+//sorts samples in place
+static void sweep_compute_stats(double *samples, unsigned int n, struct sweep_stats *st)
+{
+    double mean = 0, var = 0;
+
+    qsort(samples, n, sizeof(double), sweep_compare);
+    st->min = samples[0];
+    st->median = (n % 2) ? samples[n/2] : (samples[n/2 - 1] + samples[n/2]) / 2;
+    for (unsigned int i=0; i<n; i++)
+        mean += samples[i];
+    mean /= n;
+    for (unsigned int i=0; i<n; i++)
+        var += (samples[i] - mean) * (samples[i] - mean);
+    st->stddev = (n > 1) ? sqrt(var / (n - 1)) : 0;
+}
+
+static void sweep_header(FILE *out, int format)
+{
+    if (format == SWEEP_JSON)
+        fprintf(out, "[\n");
+    else
+        fprintf(out, "backend,banks,placement,pattern,seed,buffer_bytes,access_bytes,accesses,reps,"
+                     "median_s,min_s,stddev_s,median_mbps,best_mbps,median_accesses_per_s,verified\n");
+}
+
+static void sweep_row(FILE *out, int format, int first, const struct bench_options *opts,
+                      size_t size, uint64_t bytes, const struct sweep_stats *st, int verified)
+{
+    const char *backend = (opts->backend == BACKEND_CPU) ? "cpu" : "fpga";
+    const char *placement = (opts->backend == BACKEND_CPU) ? "host" : fpga_placement_name(opts->placement);
+    unsigned int banks = (opts->backend == BACKEND_CPU) ? 1 : opts->banks;
+    double mb = bytes / (((double)1024) * ((double)1024));
+
+    if (format == SWEEP_JSON) {
+        fprintf(out, "%s  {\"backend\": \"%s\", \"banks\": %u, \"placement\": \"%s\", "
+                     "\"pattern\": \"%s\", \"seed\": %llu, "
+                     "\"buffer_bytes\": %zu, \"access_bytes\": %u, \"accesses\": %llu, \"reps\": %u, "
+                     "\"median_s\": %.9f, \"min_s\": %.9f, \"stddev_s\": %.9f, "
+                     "\"median_mbps\": %.3f, \"best_mbps\": %.3f, \"median_accesses_per_s\": %.1f, "
+                     "\"verified\": %s}",
+                first ? "" : ",\n", backend, banks, placement, ap_pattern_name(opts->ap.pattern),
+                (unsigned long long)opts->ap.seed, size, opts->access_bytes,
+                (unsigned long long)opts->ap.iterations, opts->reps,
+                st->median, st->min, st->stddev, mb / st->median, mb / st->min,
+                opts->ap.iterations / st->median, verified ? "true" : "false");
+    } else {
+        fprintf(out, "%s,%u,%s,%s,%llu,%zu,%u,%llu,%u,%.9f,%.9f,%.9f,%.3f,%.3f,%.1f,%d\n",
+                backend, banks, placement, ap_pattern_name(opts->ap.pattern), (unsigned long long)opts->ap.seed,
+                size, opts->access_bytes, (unsigned long long)opts->ap.iterations, opts->reps,
+                st->median, st->min, st->stddev, mb / st->median, mb / st->min,
+                opts->ap.iterations / st->median, verified);
+    }
+    fflush(out);
+}
+
+int sweep_run(const struct bench_options *base, struct fpga_env *env)
+{
+    struct bench_options opts = *base;
+    unsigned int reps = (base->reps > 0) ? base->reps : 1;
+    double *samples;
+    FILE *out = stdout;
+    int first = 1;
+    int ret = 0;
+
+    opts.reps = reps;
+    if (base->output != NULL) {
+        out = fopen(base->output, "w");
+        if (out == NULL) {
+            printf("Error: Failed to open sweep output %s\n", base->output);
+            return -1;
+        }
+    }
+    samples = (double *)malloc(reps * sizeof(double));
+    if (samples == NULL) {
+        if (out != stdout)
+            fclose(out);
+        return -1;
+    }
+
+    sweep_header(out, base->format);
+    for (unsigned int si=0; si<base->num_sweep_sizes && ret != -1; si++) {
+        size_t size = base->sweep_sizes[si];
+        struct fpga_bandwidth fbw;
+        struct cpu_bandwidth cbw;
+        int err;
+
+        if (env != NULL)
+            err = fpga_bandwidth_setup(env, &opts, size, &fbw);
+        else
+            err = cpu_bandwidth_setup(&opts, size, &cbw);
+        if (err != 0) {
+            ret = -1;
+            break;
+        }
+
+        for (unsigned int wi=0; wi<base->num_sweep_widths; wi++) {
+            opts.access_bytes = base->sweep_widths[wi];
+            if (opts.access_bytes > size)
+                continue;
+            if (env != NULL && fpga_layout_units(&fbw.layout, size, opts.access_bytes) == 0)
+                continue;
+
+            for (unsigned int r=0; r<base->warmup + reps; r++) {
+                double seconds;
+                //earlier widths and the warmup left the same stream in the
+                //outputs, the check must only see what the measured reps wrote
+                if (r == base->warmup && opts.verify) {
+                    if (env != NULL) {
+                        if (fpga_bandwidth_clear_outputs(env, &fbw) != 0) {
+                            ret = -1;
+                            break;
+                        }
+                    } else {
+                        memset(cbw.output, 0, size);
+                    }
+                }
+                if (env != NULL)
+                    err = fpga_bandwidth_launch(env, &fbw, &opts, &seconds);
+                else
+                    err = cpu_bandwidth_launch(&cbw, &opts, &seconds);
+                if (err != 0) {
+                    ret = -1;
+                    break;
+                }
+                if (r >= base->warmup)
+                    samples[r - base->warmup] = seconds;
+            }
+            if (ret == -1)
+                break;
+
+            if (env != NULL)
+                err = fpga_bandwidth_check(env, &fbw, &opts);
+            else
+                err = cpu_bandwidth_check(&cbw, &opts);
+            if (err == -1) {
+                ret = -1;
+                break;
+            }
+            if (err != 0)
+                ret = -2;
+
+            struct sweep_stats st;
+            sweep_compute_stats(samples, reps, &st);
+            uint64_t bytes = (env != NULL) ? 2 * fpga_bandwidth_bytes(&fbw, &opts)
+                                           : 2 * opts.ap.iterations * opts.access_bytes;
+            sweep_row(out, base->format, first, &opts, size, bytes, &st, err == 0);
+            first = 0;
+        }
+
+        if (env != NULL)
+            fpga_bandwidth_release(&fbw);
+        else
+            cpu_bandwidth_release(&cbw);
+    }
+    if (base->format == SWEEP_JSON)
+        fprintf(out, "%s]\n", first ? "" : "\n");
+
+    if (out != stdout)
+        fclose(out);
+    free(samples);
+    return ret;
+}
@@ -0,0 +1,27 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : sweep.h
+Purpose             : Working set and access width sweep of the bandwidth mode
+Revision History    : 2017.07.24
+******************************************************************************
+*/
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//sweep_run
+//For every size of opts->sweep_sizes and width of opts->sweep_widths run
+//opts->warmup unmeasured and opts->reps measured launches, then write one
+//CSV or JSON row per point to opts->output (stdout when NULL).
+//env selects the FPGA backend, NULL runs the sweep on the CPU backend.
+//Return value
+// 0    Success
+//-1    Setup or launch failure
+//-2    At least one point failed its result check
+int sweep_run(const struct bench_options *opts, struct fpga_env *env);
+
+#endif
@@ -0,0 +1,351 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : trace.cpp
+Purpose             : Replay of a memory mapped binary block address trace
+                      through the bandwidth_trace kernel
+Revision History    : 2017.08.14
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "fill.h"
+#include "mapped_file.h"
+
+//uint lanes of one block
+#define TRACE_LANES             (AP_BLOCK_BYTES / 4)
+
+//last operation a block saw, kept per block for the output check
+#define TRACE_UNTOUCHED         0
+#define TRACE_COPIED            1
+#define TRACE_WRITTEN           2
+
+struct trace_window {
+    uint64_t    first;
+    uint64_t    entries;
+    uint64_t    ops[3];
+    uint32_t    sum[TRACE_LANES];
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//trace_scan
+//Count the operations of a window and compute the checksum the kernel must
+//return for it, the sum over every read only entry of the input block each
+//pair read. last_op, when given, tracks the final state of every block.
+
+static void trace_scan(const uint64_t *entries, uint64_t first, uint64_t count,
+                       const struct fpga_layout *layout, uint64_t num_blocks,
+                       unsigned char *last_op, struct trace_window *win)
+{
+    memset(win, 0, sizeof(*win));
+    win->first = first;
+    win->entries = count;
+    for (uint64_t i=0; i<count; i++) {
+        uint64_t entry = entries[i];
+        unsigned int op = ap_trace_op(entry);
+        uint64_t block = ap_trace_block(entry, num_blocks);
+
+        win->ops[op]++;
+        if (op == AP_TRACE_READ) {
+            ap_uint pairs = ap_pair_mask(layout->port_mode, layout->pair_shift, block);
+            uint64_t unit = ap_pair_unit(layout->port_mode, layout->pair_shift, block);
+            uint32_t lanes[TRACE_LANES];
+            memcpy(lanes, fill_template_at(unit * AP_BLOCK_BYTES), sizeof(lanes));
+            for (unsigned int p=0; p<layout->num_pairs; p++) {
+                if (!(pairs & (1U << p)))
+                    continue;
+                for (unsigned int l=0; l<TRACE_LANES; l++)
+                    win->sum[l] += lanes[l];
+            }
+        } else if (last_op != NULL) {
+            last_op[block] = (op == AP_TRACE_WRITE) ? TRACE_WRITTEN : TRACE_COPIED;
+        }
+    }
+}
+
+//bytes a window moves in global memory, reads plus writes
+static uint64_t trace_window_bytes(const struct trace_window *win, const struct fpga_layout *layout)
+{
+    uint64_t pairs = (layout->port_mode == AP_PORTS_INTERLEAVE) ? 1 : layout->num_pairs;
+    return (2 * win->ops[AP_TRACE_COPY] + win->ops[AP_TRACE_READ] + win->ops[AP_TRACE_WRITE])
+           * AP_BLOCK_BYTES * pairs;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//trace_check_output
+//Compare every block the trace copied or wrote, in every pair holding it,
+//against the input pattern or the block index
+//Return value
+// 0    No mismatch
+//-1    Error
+//-2    Mismatch found
+
+static int trace_check_output(struct fpga_env *env, struct fpga_bandwidth *bw,
+                              const struct bench_options *opts, uint64_t num_blocks,
+                              const unsigned char *last_op)
+{
+    const struct fpga_layout *layout = &bw->layout;
+    const unsigned char *map_output[AP_MAX_PAIRS];
+    uint64_t checked = 0, mismatches = 0;
+    double tstart = now_seconds();
+    cl_int err;
+
+    for (unsigned int p=0; p<layout->num_pairs; p++) {
+        map_output[p] = (const unsigned char *)clEnqueueMapBuffer(env->command_queue, bw->output[p],
+                                                                 CL_TRUE, CL_MAP_READ, 0, bw->pair_size,
+                                                                 0, NULL, NULL, &err);
+        if (err != CL_SUCCESS) {
+            printf("ERROR: Failed to read output buffer %u %d\n", p, err);
+            return -1;
+        }
+    }
+
+    for (uint64_t block=0; block<num_blocks; block++) {
+        if (last_op[block] == TRACE_UNTOUCHED)
+            continue;
+
+        ap_uint pairs = ap_pair_mask(layout->port_mode, layout->pair_shift, block);
+        uint64_t unit = ap_pair_unit(layout->port_mode, layout->pair_shift, block);
+        uint32_t expect[TRACE_LANES];
+        if (last_op[block] == TRACE_WRITTEN) {
+            for (unsigned int l=0; l<TRACE_LANES; l++)
+                expect[l] = (uint32_t)block;
+        } else {
+            memcpy(expect, fill_template_at(unit * AP_BLOCK_BYTES), sizeof(expect));
+        }
+
+        checked++;
+        for (unsigned int p=0; p<layout->num_pairs; p++) {
+            if (!(pairs & (1U << p)))
+                continue;
+            if (memcmp(map_output[p] + unit * AP_BLOCK_BYTES, expect, sizeof(expect)) == 0)
+                continue;
+            if (mismatches < opts->verify_report) {
+                printf("ERROR : kernel failed to %s block %llu (bank %u) of output%u\n",
+                       (last_op[block] == TRACE_WRITTEN) ? "write" : "copy",
+                       (unsigned long long)block, layout->output_bank[p], p);
+            }
+            mismatches++;
+        }
+    }
+    printf("Verify trace output: %llu distinct blocks checked in %f sec, %llu mismatches\n",
+           (unsigned long long)checked, now_seconds() - tstart, (unsigned long long)mismatches);
+
+    for (unsigned int p=0; p<layout->num_pairs; p++)
+        clEnqueueUnmapMemObject(env->command_queue, bw->output[p], (void *)map_output[p], 0, NULL, NULL);
+    clFinish(env->command_queue);
+    return (mismatches == 0) ? 0 : -2;
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//trace_report
+//Wait for window w, read its checksum back and print its results
+//Return value
+// 0    Success
+//-1    Error
+//-2    Checksum mismatch
+
+static int trace_report(cl_command_queue queue, cl_mem result, cl_event kernel_event,
+                        const struct trace_window *win, const struct fpga_layout *layout,
+                        uint64_t w, int verify, double *kernel_seconds, uint64_t *bytes)
+{
+    uint32_t sum[TRACE_LANES];
+    double mb = ((double)1024) * ((double)1024);
+    cl_int err;
+
+    err = clEnqueueReadBuffer(queue, result, CL_TRUE, 0, sizeof(sum), sum, 1, &kernel_event, NULL);
+    if (err != CL_SUCCESS) {
+        printf("ERROR: Failed to read trace checksum %d\n", err);
+        return -1;
+    }
+    double seconds = event_seconds(kernel_event);
+    uint64_t window_bytes = trace_window_bytes(win, layout);
+    int match = (memcmp(sum, win->sum, sizeof(sum)) == 0);
+
+    printf("Window %llu: entries %llu..%llu (%llu copy, %llu read, %llu write), %f sec, "
+           "%f MB/sec, %f accesses/sec%s\n",
+           (unsigned long long)w, (unsigned long long)win->first,
+           (unsigned long long)(win->first + win->entries - 1),
+           (unsigned long long)win->ops[AP_TRACE_COPY], (unsigned long long)win->ops[AP_TRACE_READ],
+           (unsigned long long)win->ops[AP_TRACE_WRITE], seconds, window_bytes / mb / seconds,
+           win->entries / seconds, !verify ? "" : (match ? ", checksum ok" : ", CHECKSUM MISMATCH"));
+    *kernel_seconds += seconds;
+    *bytes += window_bytes;
+    return (!verify || match) ? 0 : -2;
+}
+
+int fpga_run_trace(struct fpga_env *env, const struct bench_options *opts)
+{
+    struct mapped_file mf;
+    struct fpga_bandwidth bw;
+    struct trace_window win[2];
+    cl_command_queue transfer_queue = NULL;
+    cl_kernel kernel = NULL;
+    cl_mem index[2] = {NULL, NULL};
+    cl_mem result[2] = {NULL, NULL};
+    cl_event kernel_event[2] = {NULL, NULL};
+    unsigned char *last_op = NULL;
+    const uint64_t *entries;
+    uint64_t num_entries, num_windows, num_blocks, window;
+    uint64_t bytes = 0;
+    double kernel_seconds = 0;
+    double tstart;
+    cl_int err;
+    int ret = -1;
+    int mismatch = 0;
+    int status;
+
+    memset(&bw, 0, sizeof(bw));
+    if (mapped_file_open(opts->trace, &mf) != 0) {
+        printf("Error: Failed to map trace %s\n", opts->trace);
+        return -1;
+    }
+    if (mf.size == 0 || mf.size % sizeof(uint64_t) != 0) {
+        printf("Error: trace %s must hold a whole number of 8 byte entries\n", opts->trace);
+        goto cleanup;
+    }
+    entries = (const uint64_t *)mf.data;
+    num_entries = mf.size / sizeof(uint64_t);
+    window = (opts->trace_window > 0) ? opts->trace_window : num_entries;
+    if (window > num_entries)
+        window = num_entries;
+    num_windows = (num_entries + window - 1) / window;
+
+    if (fpga_bandwidth_setup(env, opts, opts->buffer_size, &bw) != 0)
+        goto cleanup;
+    num_blocks = fpga_layout_units(&bw.layout, bw.size, AP_BLOCK_BYTES);
+
+    kernel = fpga_create_kernel(env, "bandwidth_trace", &err);
+    if (!kernel || err != CL_SUCCESS) {
+        printf("Error: Failed to create bandwidth_trace kernel!\n");
+        goto cleanup;
+    }
+    transfer_queue = clCreateCommandQueue(env->context, env->device_id, CL_QUEUE_PROFILING_ENABLE, &err);
+    if (!transfer_queue || err != CL_SUCCESS) {
+        printf("Error: Failed to create trace transfer queue %d\n", err);
+        goto cleanup;
+    }
+    for (unsigned int s=0; s<2; s++) {
+        cl_int err1;
+        index[s] = fpga_create_buffer(env, window * sizeof(uint64_t), &err);
+        result[s] = fpga_create_buffer(env, AP_BLOCK_BYTES, &err1);
+        if (err != CL_SUCCESS || err1 != CL_SUCCESS) {
+            printf("Error: Failed to allocate trace window buffers of %llu entries\n",
+                   (unsigned long long)window);
+            goto cleanup;
+        }
+    }
+    if (opts->verify) {
+        last_op = (unsigned char *)calloc(num_blocks, 1);
+        if (last_op == NULL) {
+            printf("Error: Failed to allocate the output check map\n");
+            goto cleanup;
+        }
+        //pooled output buffers still hold what an earlier run wrote
+        if (fpga_bandwidth_clear_outputs(env, &bw) != 0)
+            goto cleanup;
+    }
+
+    printf("Trace %s: %llu entries in %llu windows of %llu over %llu blocks, placement %s over %u banks\n",
+           opts->trace, (unsigned long long)num_entries, (unsigned long long)num_windows,
+           (unsigned long long)window, (unsigned long long)num_blocks,
+           fpga_placement_name(opts->placement), opts->banks);
+
+    //window w runs in slot w % 2, the slot is reported and freed before the
+    //index write of window w + 2 reuses it
+    tstart = now_seconds();
+    for (uint64_t w=0; w<=num_windows; w++) {
+        unsigned int slot = w % 2;
+
+        if (w < num_windows) {
+            cl_ulong first = w * window;
+            cl_ulong count = (num_entries - first < window) ? num_entries - first : window;
+            cl_event write_event;
+
+            err = clEnqueueWriteBuffer(transfer_queue, index[slot], CL_FALSE, 0, count * sizeof(uint64_t),
+                                       entries + first, 0, NULL, &write_event);
+            if (err != CL_SUCCESS) {
+                printf("Error: Failed to write trace window %llu %d\n", (unsigned long long)w, err);
+                goto cleanup;
+            }
+            clFlush(transfer_queue);
+
+            int arg_num = 0;
+            err  = fpga_set_pair_args(kernel, &bw.layout, bw.input, bw.output, &arg_num);
+            err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_mem),   &index[slot]);
+            err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_mem),   &result[slot]);
+            err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_ulong), &count);
+            err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_ulong), &num_blocks);
+            err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_uint),  &bw.layout.pair_shift);
+            err |= clSetKernelArg(kernel, arg_num++, sizeof(cl_uint),  &bw.layout.port_mode);
+            if (err != CL_SUCCESS) {
+                printf("ERROR: Failed to set kernel arguments! %d\n", err);
+                clReleaseEvent(write_event);
+                goto cleanup;
+            }
+
+            size_t global[1] = {1};
+            size_t local[1] = {1};
+            err = clEnqueueNDRangeKernel(env->command_queue, kernel, 1, NULL, global, local,
+                                         1, &write_event, &kernel_event[slot]);
+            clReleaseEvent(write_event);
+            if (err != CL_SUCCESS) {
+                printf("ERROR: Failed to execute kernel %d\n", err);
+                goto cleanup;
+            }
+            clFlush(env->command_queue);
+
+            //scan on the host while the device works
+            trace_scan(entries + first, first, count, &bw.layout, num_blocks, last_op, &win[slot]);
+        }
+
+        //report the previous window
+        if (w > 0) {
+            unsigned int prev = (w - 1) % 2;
+            double before = kernel_seconds;
+            status = trace_report(transfer_queue, result[prev], kernel_event[prev], &win[prev],
+                                  &bw.layout, w - 1, opts->verify, &kernel_seconds, &bytes);
+            fpga_note_kernel(env, kernel_seconds - before);
+            clReleaseEvent(kernel_event[prev]);
+            kernel_event[prev] = NULL;
+            if (status == -1)
+                goto cleanup;
+            if (status != 0)
+                mismatch = 1;
+        }
+    }
+    {
+        double wall = now_seconds() - tstart;
+        double mb = ((double)1024) * ((double)1024);
+        printf("Trace total: %.1f MB in %f sec of kernel time (%f MB/sec, %f accesses/sec), "
+               "%f sec wall\n", bytes / mb, kernel_seconds, bytes / mb / kernel_seconds,
+               num_entries / kernel_seconds, wall);
+    }
+
+    ret = mismatch ? -2 : 0;
+    if (opts->verify) {
+        status = trace_check_output(env, &bw, opts, num_blocks, last_op);
+        if (status != 0 && ret == 0)
+            ret = status;
+        else if (status == -1)
+            ret = -1;
+    }
+
+cleanup:
+    for (unsigned int s=0; s<2; s++) {
+        if (kernel_event[s])
+            clReleaseEvent(kernel_event[s]);
+        fpga_release_buffer(env, index[s]);
+        fpga_release_buffer(env, result[s]);
+    }
+    if (transfer_queue)
+        clReleaseCommandQueue(transfer_queue);
+    fpga_release_kernel(env, kernel);
+    fpga_bandwidth_release(&bw);
+    free(last_op);
+    mapped_file_close(&mf);
+    return ret;
+}
@@ -0,0 +1,31 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : trace.h
+Purpose             : Replay of a memory mapped binary block address trace
+                      through the bandwidth_trace kernel
+Revision History    : 2017.08.14
+******************************************************************************
+*/
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_trace
+//Map opts->trace, an array of 64-bit entries in the format of access_pattern.h,
+//and replay it over the bandwidth buffers in windows of opts->trace_window
+//entries. The index buffer of the next window is written while the kernel
+//runs the current one, so traces larger than device memory stream through two
+//window sized buffers. Every window is reported with its own bandwidth and
+//checksum check, the final output is checked against the last operation of
+//every block the trace wrote.
+//Return value
+// 0    Success
+//-1    File, allocation or OpenCL failure
+//-2    Checksum or output mismatch
+int fpga_run_trace(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : transfer.cpp
+Purpose             : Host/device transfer strategies compared over the same
+                      buffer size, with wall and cpu time of each direction
+Revision History    : 2017.09.01
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "transfer.h"
+#include "fill.h"
+#include "host_alloc.h"
+
+static const char *transfer_names[NUM_TRANSFERS] = {
+    "map", "rw", "hostptr", "allochost"
+};
+
+const char *transfer_name(int strategy)
+{
+    return (strategy >= 0 && strategy < NUM_TRANSFERS) ? transfer_names[strategy] : "unknown";
+}
+
+int transfer_parse(const char *name)
+{
+    for (int t=0; t<NUM_TRANSFERS; t++) {
+        if (strcmp(name, transfer_names[t]) == 0)
+            return t;
+    }
+    return -1;
+}
+
+//wall and cpu seconds summed over the measured round trips
+struct transfer_times {
+    double      h2d_seconds;
+    double      h2d_cpu;
+    double      d2h_seconds;
+    double      d2h_cpu;
+};
+
+//Create the device buffer of strategy in bank 0, over host for hostptr. map
+//and rw use ordinary buffers and so the session pool.
+static cl_mem transfer_create(struct fpga_env *env, int strategy, size_t size,
+                              void *host, cl_int *err)
+{
+    cl_mem_flags flags = CL_MEM_READ_WRITE;
+
+    if (strategy == TRANSFER_HOSTPTR)
+        flags |= CL_MEM_USE_HOST_PTR;
+    else if (strategy == TRANSFER_ALLOCHOST)
+        flags |= CL_MEM_ALLOC_HOST_PTR;
+    else
+        return fpga_create_buffer(env, size, err);
+    if (strategy != TRANSFER_HOSTPTR)
+        host = NULL;
+
+    if (env->num_banks <= 1)
+        return clCreateBuffer(env->context, flags, size, host, err);
+
+    cl_mem_ext_ptr_t buffer_ext;
+    buffer_ext.flags = XCL_MEM_DDR_BANK0;
+    buffer_ext.obj = host;
+    buffer_ext.param = 0;
+    return clCreateBuffer(env->context, flags | CL_MEM_EXT_PTR_XILINX, size, &buffer_ext, err);
+}
+
+/////////////////////////////////////////////////////////////////////////////////
+//transfer_round_trip
+//One host to device and one device to host move of size bytes of src with
+//strategy, dst receives the data for map and rw. The zero copy strategies
+//time only the runtime calls that move the data, the producer writes into
+//allochost memory before the clock starts.
+//Return value
+// 0    Success, the times of both directions are added to *t
+//-1    OpenCL failure
+
+static int transfer_round_trip(struct fpga_env *env, int strategy, cl_mem mem, size_t size,
+                               const unsigned char *src, unsigned char *dst,
+                               struct transfer_times *t)
+{
+    cl_command_queue queue = env->command_queue;
+    unsigned char *map;
+    double wall, cpu;
+    cl_int err = CL_SUCCESS;
+
+    //host to device
+    if (strategy == TRANSFER_ALLOCHOST) {
+        map = (unsigned char *)clEnqueueMapBuffer(queue, mem, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION,
+                                                  0, size, 0, NULL, NULL, &err);
+        if (err != CL_SUCCESS) {
+            printf("Error: Failed to map allochost buffer %d\n", err);
+            return -1;
+        }
+        memcpy(map, src, size);
+    }
+    wall = now_seconds();
+    cpu = cpu_seconds();
+    switch (strategy) {
+    case TRANSFER_MAP:
+        map = (unsigned char *)clEnqueueMapBuffer(queue, mem, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION,
+                                                  0, size, 0, NULL, NULL, &err);
+        if (err != CL_SUCCESS)
+            break;
+        memcpy(map, src, size);
+        err = clEnqueueUnmapMemObject(queue, mem, map, 0, NULL, NULL);
+        break;
+    case TRANSFER_RW:
+        err = clEnqueueWriteBuffer(queue, mem, CL_TRUE, 0, size, src, 0, NULL, NULL);
+        break;
+    case TRANSFER_HOSTPTR:
+        err = clEnqueueMigrateMemObjects(queue, 1, &mem, 0, 0, NULL, NULL);
+        break;
+    case TRANSFER_ALLOCHOST:
+        err = clEnqueueUnmapMemObject(queue, mem, map, 0, NULL, NULL);
+        break;
+    }
+    clFinish(queue);
+    t->h2d_cpu += cpu_seconds() - cpu;
+    t->h2d_seconds += now_seconds() - wall;
+    if (err != CL_SUCCESS) {
+        printf("Error: %s host to device transfer failed %d\n", transfer_name(strategy), err);
+        return -1;
+    }
+
+    //device to host
+    wall = now_seconds();
+    cpu = cpu_seconds();
+    switch (strategy) {
+    case TRANSFER_MAP:
+    case TRANSFER_ALLOCHOST:
+        map = (unsigned char *)clEnqueueMapBuffer(queue, mem, CL_TRUE, CL_MAP_READ,
+                                                  0, size, 0, NULL, NULL, &err);
+        if (err != CL_SUCCESS)
+            break;
+        if (strategy == TRANSFER_MAP)
+            memcpy(dst, map, size);
+        err = clEnqueueUnmapMemObject(queue, mem, map, 0, NULL, NULL);
+        break;
+    case TRANSFER_RW:
+        err = clEnqueueReadBuffer(queue, mem, CL_TRUE, 0, size, dst, 0, NULL, NULL);
+        break;
+    case TRANSFER_HOSTPTR:
+        err = clEnqueueMigrateMemObjects(queue, 1, &mem, CL_MIGRATE_MEM_OBJECT_HOST, 0, NULL, NULL);
+        break;
+    }
+    clFinish(queue);
+    t->d2h_cpu += cpu_seconds() - cpu;
+    t->d2h_seconds += now_seconds() - wall;
+    if (err != CL_SUCCESS) {
+        printf("Error: %s device to host transfer failed %d\n", transfer_name(strategy), err);
+        return -1;
+    }
+    return 0;
+}
+
+static void transfer_print(int strategy, size_t size, unsigned int reps, const struct transfer_times *t)
+{
+    double dmbytes = reps * (size / (((double)1024) * ((double)1024)));
+
+    printf("%-10s host to device %f MB/sec, %f sec cpu per GB (%.0f%% of wall), "
+           "device to host %f MB/sec, %f sec cpu per GB (%.0f%% of wall)\n",
+           transfer_name(strategy),
+           dmbytes / t->h2d_seconds, 1024 * t->h2d_cpu / dmbytes, 100.0 * t->h2d_cpu / t->h2d_seconds,
+           dmbytes / t->d2h_seconds, 1024 * t->d2h_cpu / dmbytes, 100.0 * t->d2h_cpu / t->d2h_seconds);
+}
+
+int fpga_run_transfer(struct fpga_env *env, const struct bench_options *opts)
+{
+    size_t size = opts->buffer_size;
+    unsigned char *src = NULL, *dst = NULL;
+    int ret = 0;
+
+    src = (unsigned char *)host_alloc(size, opts->host_pages, opts->host_node);
+    dst = (unsigned char *)host_alloc(size, opts->host_pages, opts->host_node);
+    if (src == NULL || dst == NULL) {
+        printf("Error: Failed to allocate %zu bytes of host memory\n", size);
+        host_free(src);
+        host_free(dst);
+        return -1;
+    }
+    fill_pattern(src, size, 0, opts->threads);
+    printf("Transfers of %.1f MB, %u measured round trips per strategy\n",
+           size / (((double)1024) * ((double)1024)), opts->reps);
+
+    for (unsigned int i=0; i<opts->num_transfers && ret == 0; i++) {
+        int strategy = opts->transfers[i];
+        struct transfer_times t;
+        cl_int err;
+
+        memset(&t, 0, sizeof(t));
+        //hostptr migrates the device copy back into the memory it wraps, so
+        //it gets a copy of src and src stays the reference of the check
+        unsigned char *backing = NULL;
+        if (strategy == TRANSFER_HOSTPTR) {
+            backing = (unsigned char *)host_alloc(size, opts->host_pages, opts->host_node);
+            if (backing == NULL) {
+                printf("Error: Failed to allocate %zu bytes of hostptr backing\n", size);
+                ret = -1;
+                break;
+            }
+            memcpy(backing, src, size);
+        }
+        cl_mem mem = transfer_create(env, strategy, size, backing ? backing : src, &err);
+        if (!mem || err != CL_SUCCESS) {
+            printf("Error: Failed to create %s buffer %d\n", transfer_name(strategy), err);
+            host_free(backing);
+            ret = -1;
+            break;
+        }
+
+        for (unsigned int r=0; r<opts->warmup + opts->reps && ret == 0; r++) {
+            if (r == opts->warmup)
+                memset(&t, 0, sizeof(t));
+            ret = transfer_round_trip(env, strategy, mem, size, src, dst, &t);
+        }
+
+        //the zero copy strategies leave nothing in dst, read the device copy
+        if (ret == 0 && opts->verify && (strategy == TRANSFER_HOSTPTR || strategy == TRANSFER_ALLOCHOST)) {
+            err = clEnqueueReadBuffer(env->command_queue, mem, CL_TRUE, 0, size, dst, 0, NULL, NULL);
+            if (err != CL_SUCCESS) {
+                printf("Error: Failed to read back %s buffer %d\n", transfer_name(strategy), err);
+                ret = -1;
+            }
+        }
+        if (ret == 0) {
+            transfer_print(strategy, size, opts->reps, &t);
+            if (opts->verify && memcmp(src, dst, size) != 0) {
+                printf("Verify %s transfer: FAIL, data read back differs\n", transfer_name(strategy));
+                ret = -2;
+            }
+        }
+        fpga_release_buffer(env, mem);
+        host_free(backing);
+        memset(dst, 0, size);
+    }
+
+    host_free(src);
+    host_free(dst);
+    return ret;
+}
@@ -0,0 +1,40 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : transfer.h
+Purpose             : Host/device transfer strategies compared over the same
+                      buffer size, with wall and cpu time of each direction
+Revision History    : 2017.09.01
+******************************************************************************
+*/
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "bench.h"
+#include "fpga_backend.h"
+
+const char *transfer_name(int strategy);
+
+//TRANSFER_* of name, -1 when unknown
+int transfer_parse(const char *name);
+
+/////////////////////////////////////////////////////////////////////////////////
+//fpga_run_transfer
+//Move opts->buffer_size bytes of the fill pattern from page aligned host
+//memory to a device buffer and back with every strategy of opts->transfers:
+//map       clEnqueueMapBuffer, memcpy and unmap, as the bandwidth mode fills
+//rw        clEnqueueWriteBuffer / clEnqueueReadBuffer from and to host memory
+//hostptr   CL_MEM_USE_HOST_PTR over the host memory, moved with
+//          clEnqueueMigrateMemObjects
+//allochost CL_MEM_ALLOC_HOST_PTR memory the producer writes through a
+//          mapping, moved by the unmap and by a read map
+//Each strategy runs opts->warmup unmeasured and opts->reps measured round
+//trips and reports the mean wall bandwidth and cpu time of both directions.
+//The device copy is read back and compared after the last round trip.
+//Return value
+// 0    Success
+//-1    Allocation or OpenCL failure
+//-2    Data read back differs from the host data
+int fpga_run_transfer(struct fpga_env *env, const struct bench_options *opts);
+
+#endif
@@ -0,0 +1,187 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : verify.cpp
+Purpose             : Parallel result verification of the units an access
+                      stream touched
+Revision History    : 2017.08.07
+******************************************************************************
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "verify.h"
+#include "fill.h"
+#include "bench.h"
+#include "cpu_backend.h"
+
+//compare len bytes at p against the pattern at offset, 64 bytes per step
+static int verify_range(const unsigned char *p, uint64_t offset, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for (; i + 64 <= len; i += 64) {
+        const unsigned char *e = fill_template_at(offset + i);
+        __m128i c0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)),
+                                    _mm_loadu_si128((const __m128i *)(e)));
+        __m128i c1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 16)),
+                                    _mm_loadu_si128((const __m128i *)(e + 16)));
+        __m128i c2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 32)),
+                                    _mm_loadu_si128((const __m128i *)(e + 32)));
+        __m128i c3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 48)),
+                                    _mm_loadu_si128((const __m128i *)(e + 48)));
+        __m128i c = _mm_and_si128(_mm_and_si128(c0, c1), _mm_and_si128(c2, c3));
+        if (_mm_movemask_epi8(c) != 0xffff)
+            return -1;
+    }
+#endif
+    while (i < len) {
+        size_t n = (len - i < 256) ? len - i : 256;
+        if (memcmp(p + i, fill_template_at(offset + i), n) != 0)
+            return -1;
+        i += n;
+    }
+    return 0;
+}
+
+struct verify_job {
+    pthread_t                   thread;
+    int                         running;
+    unsigned int                id;
+    const unsigned char *const  *outputs;
+    const unsigned int          *banks;
+    unsigned int                stripes;
+    const struct access_pattern *ap;
+    uint64_t                    num_units;
+    unsigned int                unit_bytes;
+    uint64_t                    first;
+    uint64_t                    last;
+    uint64_t                    *seen;
+    unsigned int                max_report;
+    struct verify_report        report;
+};
+
+static void verify_job_run(struct verify_job *job)
+{
+    struct verify_report *r = &job->report;
+
+    for (uint64_t i=job->first; i<job->last; i++) {
+        uint64_t unit = ap_pattern_block(job->ap, i, job->num_units);
+
+        //every distinct unit is compared once, whichever thread claims it
+        uint64_t bit = 1ULL << (unit & 63);
+        if (__atomic_fetch_or(&job->seen[unit >> 6], bit, __ATOMIC_RELAXED) & bit)
+            continue;
+
+        unsigned int stripe = unit % job->stripes;
+        uint64_t offset = (unit / job->stripes) * job->unit_bytes;
+        r->checked++;
+        if (verify_range(job->outputs[stripe] + offset, offset, job->unit_bytes) != 0) {
+            if (r->reported < job->max_report) {
+                r->first[r->reported].access = i;
+                r->first[r->reported].unit = unit;
+                r->first[r->reported].bank = job->banks[stripe];
+                r->reported++;
+            }
+            r->mismatches++;
+        }
+    }
+}
+
+//only threads of their own are pinned, the calling thread keeps its mask so
+//threads it starts later still spread over every allowed cpu
+static void *verify_worker(void *arg)
+{
+    struct verify_job *job = (struct verify_job *)arg;
+
+    cpu_pin_self(job->id);
+    verify_job_run(job);
+    return NULL;
+}
+
+int verify_touched(const unsigned char *const *outputs, const unsigned int *banks,
+                   unsigned int stripes, const struct access_pattern *ap,
+                   uint64_t num_units, unsigned int unit_bytes,
+                   unsigned int threads, unsigned int max_report,
+                   struct verify_report *report)
+{
+    double tstart = now_seconds();
+    struct verify_job *jobs;
+    uint64_t *seen;
+
+    memset(report, 0, sizeof(*report));
+    if (max_report > VERIFY_MAX_REPORT)
+        max_report = VERIFY_MAX_REPORT;
+    if (threads == 0)
+        threads = cpu_default_threads();
+    //not worth a thread below 64K accesses per thread
+    while (threads > 1 && ap->iterations / threads < 65536)
+        threads--;
+
+    seen = (uint64_t *)calloc((num_units + 63) / 64, sizeof(uint64_t));
+    jobs = (struct verify_job *)calloc(threads, sizeof(struct verify_job));
+    if (seen == NULL || jobs == NULL) {
+        free(seen);
+        free(jobs);
+        return -2;
+    }
+
+    for (unsigned int t=0; t<threads; t++) {
+        struct verify_job *job = &jobs[t];
+        job->id = t;
+        job->outputs = outputs;
+        job->banks = banks;
+        job->stripes = stripes;
+        job->ap = ap;
+        job->num_units = num_units;
+        job->unit_bytes = unit_bytes;
+        job->first = ap->iterations * t / threads;
+        job->last = ap->iterations * (t+1) / threads;
+        job->seen = seen;
+        job->max_report = max_report;
+    }
+    //job 0, and any job whose thread fails to start, runs on the calling thread
+    for (unsigned int t=1; t<threads; t++)
+        jobs[t].running = (pthread_create(&jobs[t].thread, NULL, verify_worker, &jobs[t]) == 0);
+    for (unsigned int t=0; t<threads; t++) {
+        if (!jobs[t].running)
+            verify_job_run(&jobs[t]);
+    }
+    for (unsigned int t=1; t<threads; t++) {
+        if (jobs[t].running)
+            pthread_join(jobs[t].thread, NULL);
+    }
+
+    //jobs cover increasing access ranges, so concatenating keeps access order
+    for (unsigned int t=0; t<threads; t++) {
+        struct verify_report *r = &jobs[t].report;
+        report->checked += r->checked;
+        report->mismatches += r->mismatches;
+        for (unsigned int m=0; m<r->reported && report->reported<max_report; m++)
+            report->first[report->reported++] = r->first[m];
+    }
+    report->seconds = now_seconds() - tstart;
+
+    free(seen);
+    free(jobs);
+    return (report->mismatches == 0) ? 0 : -1;
+}
+
+void verify_print(const char *name, const struct verify_report *report)
+{
+    printf("Verify %s: %llu distinct units checked in %f sec, %llu mismatches\n", name,
+           (unsigned long long)report->checked, report->seconds,
+           (unsigned long long)report->mismatches);
+    for (unsigned int m=0; m<report->reported; m++) {
+        printf("ERROR : kernel failed to copy block %llu (access %llu, bank %u) to %s\n",
+               (unsigned long long)report->first[m].unit,
+               (unsigned long long)report->first[m].access,
+               report->first[m].bank, name);
+    }
+}
@@ -0,0 +1,52 @@
+/*
+******************************************************************************
+Vendor              : BGI
+Associated Filename : verify.h
+Purpose             : Parallel result verification of the units an access
+                      stream touched
+Revision History    : 2017.08.07
+******************************************************************************
+*/
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include "access_pattern.h"
+
+//most mismatches a report keeps
+#define VERIFY_MAX_REPORT       64
+
+struct verify_mismatch {
+    uint64_t        access;
+    uint64_t        unit;
+    unsigned int    bank;
+};
+
+struct verify_report {
+    uint64_t                checked;
+    uint64_t                mismatches;
+    unsigned int            reported;
+    double                  seconds;
+    struct verify_mismatch  first[VERIFY_MAX_REPORT];
+};
+
+/////////////////////////////////////////////////////////////////////////////////
+//verify_touched
+//Replay ap over num_units units of unit_bytes and compare every distinct unit
+//it touched against the input data pattern of fill.h. The units are striped
+//over stripes buffers, unit u is unit u / stripes of outputs[u % stripes],
+//which sits in bank banks[u % stripes] and was filled from offset 0. The
+//stream is split over threads threads (0 means all cpus). The first
+//max_report mismatches in access order are kept.
+//Return value
+// 0    No mismatch
+//-1    Mismatch found
+//-2    Out of memory
+int verify_touched(const unsigned char *const *outputs, const unsigned int *banks,
+                   unsigned int stripes, const struct access_pattern *ap,
+                   uint64_t num_units, unsigned int unit_bytes,
+                   unsigned int threads, unsigned int max_report,
+                   struct verify_report *report);
+
+void verify_print(const char *name, const struct verify_report *report);
+
+#endif